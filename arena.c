@@ -0,0 +1,190 @@
+/*
+ 0-Software. Implements an arena allocator. Objects are placed one after
+ another into big chunks and are only freed all at once.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "arena.h"
+
+#ifdef TESTX
+#include <CUnit/Cunit.h>
+#include <CUnit/Basic.h>
+#endif
+
+/* every allocation is aligned like malloc would do it */
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+#define ARENA_HEAD ARENA_ROUND(sizeof(struct arena_chunk))
+
+/* Initializes an empty arena
+	Param: chunk_size = The number of bytes which are requested from 
+		malloc at once. Bigger allocations get a chunk of their own
+	Return: A valid pointer to an arena structure or NULL on failure */
+struct arena *arena_init(size_t chunk_size){
+	struct arena *a = (struct arena *) malloc(sizeof(struct arena));
+	if(a == NULL || chunk_size == 0){
+		free(a);
+		return NULL;
+	}
+	if(pthread_mutex_init(&a->mutex, NULL)){
+		free(a);
+		return NULL;
+	}
+	a->head = NULL;
+	a->chunk_size = chunk_size;
+	memset(&a->stats, 0, sizeof(struct arena_stats));
+	return a;
+}
+
+/* Allocates memory from the arena. The memory can't be freed on its own,
+	it lives until arena_free is called. This function is thread safe
+	Param: a = A valid pointer to an arena structure
+		size = The number of bytes
+	Return: A pointer to the memory or NULL on failure */
+void *arena_alloc(struct arena *a, size_t size){
+	struct arena_chunk *c;
+	size_t need, cap;
+	void *res;
+	if(a == NULL || size == 0)
+		return NULL;
+
+	need = ARENA_ROUND(size);
+	pthread_mutex_lock(&a->mutex);
+	c = a->head;
+	if(c == NULL || c->size - c->used < need){
+		cap = need > a->chunk_size ? need : a->chunk_size;
+		c = (struct arena_chunk *) malloc(ARENA_HEAD + cap);
+		if(c == NULL){
+			pthread_mutex_unlock(&a->mutex);
+			return NULL;
+		}
+		c->size = cap;
+		c->used = 0;
+		/* an oversized chunk is put behind the current one, so the rest
+		 	of the current chunk can still be used */
+		if(a->head != NULL && cap > a->chunk_size){
+			c->next = a->head->next;
+			a->head->next = c;
+		} else {
+			c->next = a->head;
+			a->head = c;
+		}
+		a->stats.reserved += ARENA_HEAD + cap;
+		a->stats.chunks++;
+	}
+	res = (char *) c + ARENA_HEAD + c->used;
+	c->used += need;
+	a->stats.allocs++;
+	a->stats.used += need;
+	pthread_mutex_unlock(&a->mutex);
+	return res;
+}
+
+/* Copies a string into the arena
+	Param: a = A valid pointer to an arena structure
+		s = A valid pointer to a null terminated string
+	Return: A pointer to the copy or NULL on failure */
+char *arena_strdup(struct arena *a, const char *s){
+	char *res;
+	if(s == NULL)
+		return NULL;
+	res = (char *) arena_alloc(a, strlen(s) + 1);
+	if(res != NULL)
+		strcpy(res, s);
+	return res;
+}
+
+/* Queries the allocation statistics of an arena
+	Param: a = A valid pointer to an arena structure
+		st = A valid pointer where the statistics are stored
+	Return: 0 on success, -1 on failure */
+int arena_get_stats(struct arena *a, struct arena_stats *st){
+	if(a == NULL || st == NULL)
+		return -1;
+	pthread_mutex_lock(&a->mutex);
+	*st = a->stats;
+	pthread_mutex_unlock(&a->mutex);
+	return 0;
+}
+
+/* Frees all chunks and the arena itself. Every pointer returned by
+	arena_alloc becomes invalid
+	Param: a = A valid pointer to an arena structure
+	Return: 0 on success, -1 on failure */
+int arena_free(struct arena *a){
+	struct arena_chunk *c, *next;
+	if(a == NULL)
+		return -1;
+	for(c = a->head; c != NULL; c = next){
+		next = c->next;
+		free(c);
+	}
+	pthread_mutex_destroy(&a->mutex);
+	free(a);
+	return 0;
+}
+
+#ifdef TESTX
+
+int init_test(void){return 0;}
+
+void test_usage(void){
+	struct arena *a = arena_init(256);
+	struct arena_stats st;
+	char *p, *q, *big;
+	int i;
+
+	CU_ASSERT(a != NULL);
+	CU_ASSERT(arena_init(0) == NULL);
+
+	/* small objects are placed one after another */
+	p = (char *) arena_alloc(a, 10);
+	q = (char *) arena_alloc(a, 10);
+	CU_ASSERT(p != NULL && q != NULL);
+	CU_ASSERT(q - p == 16);
+	CU_ASSERT(((unsigned long) p & 15) == 0);
+
+	/* an oversized object does not waste the current chunk */
+	big = (char *) arena_alloc(a, 1000);
+	CU_ASSERT(big != NULL);
+	CU_ASSERT((char *) arena_alloc(a, 10) - q == 16);
+
+	CU_ASSERT(!strcmp(arena_strdup(a, "4711"), "4711"));
+	for(i=0; i<100; i++)
+		CU_ASSERT(arena_alloc(a, 32) != NULL);
+
+	CU_ASSERT(arena_get_stats(a, &st) == 0);
+	CU_ASSERT(st.allocs == 105);
+	CU_ASSERT(st.used == 3 * 16 + 1008 + 16 + 100 * 32);
+	CU_ASSERT(st.chunks >= 14);
+	CU_ASSERT(st.reserved > st.used);
+	CU_ASSERT(arena_free(a) == 0);
+}
+
+int main(int argc, char **argv){
+	CU_pSuite suite = NULL;
+
+	if(CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	suite = CU_add_suite("Test arena impl", init_test, init_test);
+	if(NULL == suite){
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if(NULL == CU_add_test(suite, "Allokationen", test_usage)){
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* run tests */
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+	return CU_get_error();
+}
+#endif
@@ -0,0 +1,44 @@
+/*
+ ---arena allocator---
+ ---begin---
+ */
+
+#include <stddef.h>
+#include <pthread.h>
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+};
+
+struct arena_stats {
+	/* number of allocations and the bytes handed out by them */
+	size_t allocs;
+	size_t used;
+	/* bytes requested from malloc and the number of chunks */
+	size_t reserved;
+	size_t chunks;
+};
+
+struct arena {
+	pthread_mutex_t mutex;
+	struct arena_chunk *head;
+	size_t chunk_size;
+	struct arena_stats stats;
+};
+
+/* build an arena which requests chunk_size bytes at once */
+struct arena *arena_init(size_t chunk_size);
+
+/* allocate size bytes which live as long as the arena */
+void *arena_alloc(struct arena *a, size_t size);
+
+/* copy a string into the arena */
+char *arena_strdup(struct arena *a, const char *s);
+
+/* get the allocation statistics */
+int arena_get_stats(struct arena *a, struct arena_stats *st);
+
+/* frees every allocation of the arena and the arena itself */
+int arena_free(struct arena *a);
@@ -0,0 +1,266 @@
+/*
+ 0-Software. Implements an open addressing hash table with linear probing.
+ All slots live in one contiguous array, so a lookup usually touches a
+ single cache line.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "hktable.h"
+
+#ifdef TESTX
+#include <CUnit/Cunit.h>
+#include <CUnit/Basic.h>
+#endif
+
+#define HK_MIN_CAP 16
+
+/* Maps a key onto a slot index. The multiplicative (fibonacci) hash
+	spreads the densely packed keycode/modifier pairs over the whole table
+	Param: key = The key which should be hashed
+		cap = The capacity of the table. Has to be a power of two
+	Return: A slot index between 0 and cap-1 */
+static size_t hk_slot(uint64_t key, size_t cap){
+	uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+	return (size_t) (h >> 32) & (cap - 1);
+}
+
+/* Initializes an empty table which is able to hold hint entries
+	without being resized
+	Param: hint = The expected number of entries. May be 0
+	Return: A valid pointer to a hk_table structure or NULL on failure */
+struct hk_table *hk_table_init(size_t hint){
+	struct hk_table *t = (struct hk_table *) malloc(sizeof(struct hk_table));
+	size_t cap = HK_MIN_CAP;
+	if(t == NULL)
+		return NULL;
+	/* keep the load factor at or below 0.5 */
+	while(cap < hint * 2)
+		cap <<= 1;
+
+	t->slots = (struct hk_entry *) calloc(cap, sizeof(struct hk_entry));
+	if(t->slots == NULL){
+		free(t);
+		return NULL;
+	}
+	t->cap = cap;
+	t->len = 0;
+	return t;
+}
+
+/* Builds a copy of a table. The copy is independent of the original, so
+	it can be modified while the original is still being read
+	Param: t = A valid pointer to a hk_table structure
+		extra = The number of entries which will be added to the copy
+	Return: A valid pointer to a hk_table structure or NULL on failure */
+struct hk_table *hk_table_copy(const struct hk_table *t, size_t extra){
+	struct hk_table *res;
+	size_t i;
+	if(t == NULL)
+		return NULL;
+
+	res = hk_table_init(t->len + extra);
+	if(res == NULL)
+		return NULL;
+	if(res->cap == t->cap){
+		memcpy(res->slots, t->slots, sizeof(struct hk_entry) * t->cap);
+		res->len = t->len;
+		return res;
+	}
+	for(i=0; i<t->cap; i++)
+		if(t->slots[i].val != NULL)
+			hk_table_put(res, t->slots[i].key, t->slots[i].val);
+	return res;
+}
+
+/* Doubles the capacity of the table and rehashes all entries
+	Param: t = A valid pointer to a hk_table structure
+	Return: 0 on success, -1 on failure */
+static int hk_table_grow(struct hk_table *t){
+	size_t i, j, cap = t->cap << 1;
+	struct hk_entry *slots = (struct hk_entry *)
+									calloc(cap, sizeof(struct hk_entry));
+	if(slots == NULL)
+		return -1;
+
+	for(i=0; i<t->cap; i++){
+		if(t->slots[i].val == NULL)
+			continue;
+		j = hk_slot(t->slots[i].key, cap);
+		while(slots[j].val != NULL)
+			j = (j + 1) & (cap - 1);
+		slots[j] = t->slots[i];
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->cap = cap;
+	return 0;
+}
+
+/* Stores val under key. An already existing value with the same key
+	will be replaced
+	Param: t = A valid pointer to a hk_table structure
+		key = An arbitrary key
+		val = A arbitrary pointer. Must not be NULL
+	Return: 0 on success, -1 on failure */
+int hk_table_put(struct hk_table *t, uint64_t key, void *val){
+	size_t i;
+	if(t == NULL || val == NULL)
+		return -1;
+	if((t->len + 1) * 2 > t->cap && hk_table_grow(t))
+		return -1;
+
+	i = hk_slot(key, t->cap);
+	while(t->slots[i].val != NULL){
+		if(t->slots[i].key == key){
+			t->slots[i].val = val;
+			return 0;
+		}
+		i = (i + 1) & (t->cap - 1);
+	}
+	t->slots[i].key = key;
+	t->slots[i].val = val;
+	t->len++;
+	return 0;
+}
+
+/* Returns the value stored under key
+	Param: t = A valid pointer to a hk_table structure
+		key = The key to look for
+	Return: The stored pointer or NULL if there is no such key */
+void *hk_table_get(const struct hk_table *t, uint64_t key){
+	size_t i;
+	if(t == NULL)
+		return NULL;
+
+	i = hk_slot(key, t->cap);
+	while(t->slots[i].val != NULL){
+		if(t->slots[i].key == key)
+			return t->slots[i].val;
+		i = (i + 1) & (t->cap - 1);
+	}
+	return NULL;
+}
+
+/* Removes the entry stored under key. The following entries of the
+	probe sequence are shifted back, so no tombstones are needed
+	Param: t = A valid pointer to a hk_table structure
+		key = The key of the entry which should be removed
+	Return: 0 if the entry has been removed, -1 if there is no such key */
+int hk_table_del(struct hk_table *t, uint64_t key){
+	size_t i, j, home;
+	if(t == NULL)
+		return -1;
+
+	i = hk_slot(key, t->cap);
+	while(t->slots[i].key != key || t->slots[i].val == NULL){
+		if(t->slots[i].val == NULL)
+			return -1;
+		i = (i + 1) & (t->cap - 1);
+	}
+
+	j = i;
+	for(;;){
+		j = (j + 1) & (t->cap - 1);
+		if(t->slots[j].val == NULL)
+			break;
+		home = hk_slot(t->slots[j].key, t->cap);
+		/* move j into the hole at i if its home slot is not in (i, j] */
+		if((j > i && (home <= i || home > j)) ||
+				(j < i && (home <= i && home > j))){
+			t->slots[i] = t->slots[j];
+			i = j;
+		}
+	}
+	t->slots[i].val = NULL;
+	t->slots[i].key = 0;
+	t->len--;
+	return 0;
+}
+
+/* Frees the table. Note, that this function does not attempt to free
+	the value pointers!
+	Param: t = A valid pointer to a hk_table structure
+	Return: 0 on success, -1 on failure */
+int hk_table_free(struct hk_table *t){
+	if(t == NULL)
+		return -1;
+	free(t->slots);
+	free(t);
+	return 0;
+}
+
+#ifdef TESTX
+
+int init_test(void){return 0;}
+
+void test_usage(void){
+	struct hk_table *t = hk_table_init(0), *c;
+	uint64_t i;
+	int cnt;
+
+	CU_ASSERT(t != NULL);
+	CU_ASSERT(t->len == 0);
+
+	/* enough entries to force some resizes */
+	for(i=1; i<=1000; i++)
+		CU_ASSERT(hk_table_put(t, i << 32 | (i & 0xff), (void *) i) == 0);
+	CU_ASSERT(t->len == 1000);
+	CU_ASSERT(t->cap >= 2000);
+
+	for(i=1; i<=1000; i++)
+		CU_ASSERT(hk_table_get(t, i << 32 | (i & 0xff)) == (void *) i);
+	CU_ASSERT(hk_table_get(t, 4711) == NULL);
+
+	/* replacing keeps the length */
+	CU_ASSERT(hk_table_put(t, 1ULL << 32 | 1, (void *) 4711) == 0);
+	CU_ASSERT(hk_table_get(t, 1ULL << 32 | 1) == (void *) 4711);
+	CU_ASSERT(t->len == 1000);
+
+	/* every second entry is removed, the others have to stay reachable */
+	for(i=1; i<=1000; i+=2)
+		CU_ASSERT(hk_table_del(t, i << 32 | (i & 0xff)) == 0);
+	CU_ASSERT(hk_table_del(t, 1ULL << 32 | 1) == -1);
+	CU_ASSERT(t->len == 500);
+	cnt = 0;
+	for(i=2; i<=1000; i+=2)
+		cnt += hk_table_get(t, i << 32 | (i & 0xff)) == (void *) i;
+	CU_ASSERT(cnt == 500);
+
+	/* a copy must not share the slots with the original */
+	c = hk_table_copy(t, 1000);
+	CU_ASSERT(c != NULL);
+	CU_ASSERT(c->len == 500);
+	CU_ASSERT(hk_table_get(c, 2ULL << 32 | 2) == (void *) 2);
+	CU_ASSERT(hk_table_del(c, 2ULL << 32 | 2) == 0);
+	CU_ASSERT(hk_table_get(t, 2ULL << 32 | 2) == (void *) 2);
+	CU_ASSERT(hk_table_free(c) == 0);
+
+	CU_ASSERT(hk_table_free(t) == 0);
+}
+
+int main(int argc, char **argv){
+	CU_pSuite suite = NULL;
+
+	if(CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	suite = CU_add_suite("Test hash table impl", init_test, init_test);
+	if(NULL == suite){
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if(NULL == CU_add_test(suite, "Einfügen und Löschen", test_usage)){
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* run tests */
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+	return CU_get_error();
+}
+#endif
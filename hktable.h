@@ -0,0 +1,38 @@
+/*
+ ---open addressing hash table implementation---
+ ---begin---
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* A slot is free if val is NULL */
+struct hk_entry {
+	uint64_t key;
+	void *val;
+};
+
+/* cap is always a power of two and at least twice as big as len */
+struct hk_table {
+	size_t cap;
+	size_t len;
+	struct hk_entry *slots;
+};
+
+/* build an empty table which can hold hint entries without growing */
+struct hk_table *hk_table_init(size_t hint);
+
+/* inserts or replaces the value stored under key */
+int hk_table_put(struct hk_table *t, uint64_t key, void *val);
+
+/* build a copy of t which can hold extra more entries without growing */
+struct hk_table *hk_table_copy(const struct hk_table *t, size_t extra);
+
+/* get the value stored under key */
+void *hk_table_get(const struct hk_table *t, uint64_t key);
+
+/* removes the entry stored under key */
+int hk_table_del(struct hk_table *t, uint64_t key);
+
+/* frees the table but not the values */
+int hk_table_free(struct hk_table *t);
@@ -0,0 +1,92 @@
+/*
+ ---input backends---
+ ---begin---
+ */
+
+#include <stdint.h>
+
+/* Interface of an input backend. Everything which depends on the
+   platform and/or api is done by these functions. Each of them gets the
+   keyact structure whose member be_data holds the private data of the
+   backend */
+struct kact_backend {
+	const char *name;
+	/* connects to the input source and sets be_data. cfg may be NULL */
+	int (*open)(struct keyact *k, const struct kact_config *cfg);
+	/* disconnects and frees be_data */
+	int (*close)(struct keyact *k);
+	/* called by the event loop thread before it reads the first event */
+	int (*setup)(struct keyact *k);
+	/* a descriptor which is readable if new input arrived */
+	int (*fd)(struct keyact *k);
+	/* number of events which can be read without blocking */
+	int (*pending)(struct keyact *k);
+	/* decodes up to max key events into batch. A change of the keyboard
+	   mapping is passed on as an event of type MappingNotify */
+	int (*read)(struct keyact *k, struct kact_event *batch, int max);
+	/* grabs (grab = 1) or ungrabs n hotkeys. If rc is NULL the requests
+	   are only sent, otherwise rc[i] is set to -1 if keys[i] failed and
+	   entries whose rc is already set are skipped */
+	int (*grab)(struct keyact *k, const struct hotkey *keys, size_t n,
+			int grab, int *rc);
+	/* resolves a keysym and the name of a modifier */
+	int (*keycode)(struct keyact *k, unsigned long keysym,
+			unsigned int *keycode);
+	int (*modifier)(struct keyact *k, const char *name, unsigned int *mask);
+	/* a hash of everything the resolution depends on, see kcache.h */
+	int (*fingerprint)(struct keyact *k, uint64_t *fp);
+};
+
+/* Xlib, the default backend */
+extern const struct kact_backend kact_x11;
+
+#ifdef KACT_XCB
+/* XCB, grabs are checked per request without an error handler. Needs
+   -DKACT_XCB -lxcb -lxcb-xkb */
+extern const struct kact_backend kact_xcb;
+
+/* number of errors of ungrabs and grabs which were sent without rc */
+unsigned long kact_xcb_errors(struct keyact *k);
+
+/* whether held keys are reported without releases, see kact_x11 */
+int kact_xcb_autorepeat(struct keyact *k);
+#endif
+
+#ifdef KACT_XI2
+/* XInput2 raw key events, nothing is grabbed. Needs -DKACT_XI2 -lXi */
+extern const struct kact_backend kact_xi2;
+#endif
+
+/* Linux input devices, needs no x-server. See kact_config.device */
+extern const struct kact_backend kact_evdev;
+
+#define EV_BUF 256
+#define EV_DEVS 16
+#define EV_KEYS 768
+
+/* in memory backend. Events are injected by kact_mem_inject */
+extern const struct kact_backend kact_mem;
+
+#define MEM_QUEUE_LEN 4096
+#define MEM_SWAPS 16
+
+#ifdef _X11_XLIB_H_
+/* the display of a keyact using kact_x11 */
+Display *kact_x11_display(struct keyact *k);
+#endif
+
+/* append a key event to the input of a keyact using kact_mem */
+int kact_mem_inject(struct keyact *k, int type, unsigned int keycode,
+		unsigned int state, unsigned long time);
+
+/* exchange the keycodes of two keysyms and notify the event loop */
+int kact_mem_swap(struct keyact *k, unsigned long a, unsigned long b);
+
+/* wait until the event loop has dispatched every injected event */
+int kact_mem_wait(struct keyact *k);
+
+/* number of currently grabbed hotkeys of a keyact using kact_mem */
+long kact_mem_grabs(struct keyact *k);
+
+/* read struct input_event records of a pipe or file by kact_evdev */
+int kact_evdev_add_fd(struct keyact *k, int fd);
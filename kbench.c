@@ -0,0 +1,450 @@
+/*
+ 0-Software. Microbenchmarks of libkeyact. They run headless on the in
+ memory backend. Every result is printed as a single line of JSON, e.g.
+
+ {"bench":"dispatch_latency","hotkeys":1000,"n":2000,"p50_ns":..., ...}
+
+ so the output of two releases can be compared line by line. The number
+ of iterations can be scaled by the first argument, e.g. "kactbench 0.1"
+ for a quick run.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include "keyact.h"
+#include "kbackend.h"
+#include "slist.h"
+#include "kvec.h"
+#include "kcache.h"
+#include "kbind.h"
+#include "krec.h"
+#include "kring.h"
+
+/* the keysyms of the generated hotkeys start here */
+#define BENCH_KEY 0x10000
+
+static double scale = 1.0;
+static long call_ns;
+static int stop_inject;
+
+/* Returns a monotonic timestamp
+	Param: void
+	Return: Nanoseconds since an arbitrary point in time */
+static long bench_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Param: n = The number of iterations at scale 1
+	Return: The scaled number of iterations, at least 1 */
+static long iters(long n){
+	long res = (long) (n * scale);
+	return res > 0 ? res : 1;
+}
+
+static int cmp_long(const void *a, const void *b){
+	long x = *(const long *) a, y = *(const long *) b;
+	return x < y ? -1 : x > y;
+}
+
+/* The function of every generated hotkey. It remembers when it has been
+	called */
+static int bench_func(void *mp){
+	__atomic_store_n(&call_ns, bench_ns(), __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Param: cfg = The configuration or NULL for the defaults
+	Return: A keyact structure using the in memory backend */
+static struct keyact *bench_init(const struct kact_config *cfg){
+	struct kact_config def;
+	struct keyact *k;
+
+	memset(&def, 0, sizeof(def));
+	if(cfg != NULL)
+		def = *cfg;
+	def.backend = &kact_mem;
+	k = kact_init_cfg(&def);
+	if(k == NULL){
+		fprintf(stderr, "kactbench: kact_init_cfg failed\n");
+		exit(1);
+	}
+	return k;
+}
+
+/* Registers n distinct hotkeys "ctrl" + BENCH_KEY + i by a single batch
+	Param: k = A valid pointer to a keyact structure
+		n = The number of hotkeys
+	Return: nothing */
+static void bench_fill(struct keyact *k, long n){
+	struct keycomb **c = (struct keycomb **) malloc(sizeof(void *) * n);
+	long i;
+
+	for(i=0; i<n; i++)
+		c[i] = kact_new_hk(k, bench_func, "ctrl", BENCH_KEY + (int) i, NULL);
+	if(kact_reg_hk_batch(c, (size_t) n, k, NULL) != 0){
+		fprintf(stderr, "kactbench: registration failed\n");
+		exit(1);
+	}
+	free(c);
+}
+
+/* Resolves and allocates hotkeys in the arena, once by the backend and
+	once from the cache file the first run has written */
+static void bench_new_hk(void){
+	struct keyact *k = bench_init(NULL);
+	struct keycomb **c;
+	long i, n = iters(200000), start, d;
+	char path[64];
+
+	c = (struct keycomb **) malloc(sizeof(void *) * n);
+	start = bench_ns();
+	for(i=0; i<n; i++)
+		c[i] = kact_new_hk(k, bench_func, "ctrl,alt,shift", 
+				BENCH_KEY + (int) i, NULL);
+	d = bench_ns() - start;
+	printf("{\"bench\":\"new_hk\",\"n\":%ld,\"ns_per_op\":%.1f}\n",
+			n, (double) d / n);
+	kact_reg_hk_batch(c, (size_t) n, k, NULL);
+	sprintf(path, "/tmp/kactbench-%d.cache", (int) getpid());
+	kact_cache_save(k, path);
+	kact_clear(k);
+
+	k = bench_init(NULL);
+	start = bench_ns();
+	kact_cache_load(k, path);
+	for(i=0; i<n; i++)
+		kact_new_hk(k, bench_func, "ctrl,alt,shift", BENCH_KEY + (int) i,
+				NULL);
+	d = bench_ns() - start;
+	printf("{\"bench\":\"new_hk_cached\",\"n\":%ld,\"ns_per_op\":%.1f}\n",
+			n, (double) d / n);
+	kact_clear(k);
+	unlink(path);
+	free(c);
+}
+
+/* Loads a generated keymap file of n lines into a new keyact structure
+	Param: n = The number of lines
+	Return: nothing */
+static void bench_keymap(long n){
+	struct keyact *k = bench_init(NULL);
+	struct kact_action actions[] = {
+		{ "bench", bench_func, NULL },
+		{ "other", bench_func, NULL }
+	};
+	struct kact_keymap_err err;
+	char path[64];
+	long i, start, d;
+	FILE *f;
+
+	sprintf(path, "/tmp/kactbench-%d.keymap", (int) getpid());
+	f = fopen(path, "w");
+	if(f == NULL){
+		fprintf(stderr, "kactbench: can't write %s\n", path);
+		exit(1);
+	}
+	for(i=0; i<n; i++)
+		fprintf(f, "ctrl,alt  0x%lx\t%s\n", BENCH_KEY + i, 
+				actions[i & 1].name);
+	fclose(f);
+
+	start = bench_ns();
+	if(kact_load_keymap(k, path, actions, 2, &err) != 0){
+		fprintf(stderr, "kactbench: line %u: %s\n", err.line, err.msg);
+		exit(1);
+	}
+	d = bench_ns() - start;
+	printf("{\"bench\":\"load_keymap\",\"lines\":%ld,\"ms\":%.2f,"
+			"\"ns_per_line\":%.1f}\n", n, d / 1e6, (double) d / n);
+	kact_clear(k);
+	unlink(path);
+}
+
+/* Records bursts of presses of hotkeys and dispatches the recording
+	again as fast as possible
+	Param: hotkeys = The number of registered hotkeys
+	Return: nothing */
+static void bench_replay(long hotkeys){
+	struct keyact *k = bench_init(NULL);
+	struct kact_replay_stats st;
+	long i, n = iters(100000);
+	char path[64];
+
+	bench_fill(k, hotkeys);
+	sprintf(path, "/tmp/kactbench-%d.rec", (int) getpid());
+	if(kact_record_start(k, path, (size_t) n)){
+		fprintf(stderr, "kactbench: can't record into %s\n", path);
+		exit(1);
+	}
+	/* bursts of BATCH_LEN events like a busy keyboard */
+	for(i=0; i<n; i++){
+		kact_mem_inject(k, KeyPress, BENCH_KEY + (int) (i % hotkeys),
+				ControlMask, (unsigned long) i);
+		if(i % BATCH_LEN == BATCH_LEN - 1 || i == n - 1)
+			kact_dispatch_pending(k, BATCH_LEN);
+	}
+	kact_record_stop(k);
+
+	if(kact_replay(k, path, KACT_REPLAY_FAST, &st) < 0){
+		fprintf(stderr, "kactbench: replay failed\n");
+		exit(1);
+	}
+	printf("{\"bench\":\"replay\",\"hotkeys\":%ld,\"n\":%lu,"
+			"\"batches\":%lu,\"events_per_s\":%.0f,\"p50_ns\":%lu,"
+			"\"p99_ns\":%lu,\"max_ns\":%lu}\n", hotkeys, st.events,
+			st.batches, st.events_per_s, st.p50_ns, st.p99_ns, st.max_ns);
+	kact_clear(k);
+	unlink(path);
+}
+
+/* Injects presses of a registered hotkey until stop_inject is set
+	Param: k = A valid pointer to a keyact structure
+	Return: NULL */
+static void *bench_injector(void *k){
+	unsigned long t = 0;
+	while(!__atomic_load_n(&stop_inject, __ATOMIC_ACQUIRE))
+		kact_mem_inject((struct keyact *) k, KeyPress, BENCH_KEY,
+				ControlMask, t++);
+	return NULL;
+}
+
+/* Registers hotkeys one by one while another thread keeps the event
+	loop busy */
+static void bench_reg_hk(void){
+	struct keyact *k = bench_init(NULL);
+	struct keycomb **c;
+	struct kact_stats st;
+	pthread_t injector;
+	long i, n = iters(2000), start, d;
+
+	c = (struct keycomb **) malloc(sizeof(void *) * n);
+	for(i=0; i<n; i++)
+		c[i] = kact_new_hk(k, bench_func, "ctrl", BENCH_KEY + (int) i, NULL);
+	kact_reg_hk(c[0], k);
+	kact_start(k);
+	stop_inject = 0;
+	pthread_create(&injector, NULL, bench_injector, (void *) k);
+
+	start = bench_ns();
+	for(i=1; i<n; i++)
+		kact_reg_hk(c[i], k);
+	d = bench_ns() - start;
+
+	__atomic_store_n(&stop_inject, 1, __ATOMIC_RELEASE);
+	pthread_join(injector, NULL);
+	kact_mem_wait(k);
+	kact_stats(k, &st);
+	printf("{\"bench\":\"reg_hk_concurrent\",\"n\":%ld,\"ns_per_op\":%.1f,"
+			"\"events_dispatched\":%lu}\n", n - 1, (double) d / (n - 1),
+			st.events);
+	kact_clear(k);
+	free(c);
+}
+
+/* Measures the time from the injection of a single KeyPress until the
+	function of the hotkey is entered and the throughput of bursts
+	Param: hotkeys = The number of registered hotkeys
+	Return: nothing */
+static void bench_dispatch(long hotkeys){
+	struct keyact *k = bench_init(NULL);
+	long i, n = iters(2000), burst = iters(200000), start, d, *lat;
+	unsigned int seed = 4711;
+
+	bench_fill(k, hotkeys);
+	kact_start(k);
+	lat = (long *) malloc(sizeof(long) * n);
+
+	for(i=0; i<n; i++){
+		start = bench_ns();
+		kact_mem_inject(k, KeyPress, BENCH_KEY + rand_r(&seed) % hotkeys,
+				ControlMask, (unsigned long) (start / 1000000L));
+		kact_mem_wait(k);
+		lat[i] = __atomic_load_n(&call_ns, __ATOMIC_ACQUIRE) - start;
+	}
+	qsort(lat, n, sizeof(long), cmp_long);
+	printf("{\"bench\":\"dispatch_latency\",\"hotkeys\":%ld,\"n\":%ld,"
+			"\"p50_ns\":%ld,\"p99_ns\":%ld,\"max_ns\":%ld}\n", hotkeys, n,
+			lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+
+	start = bench_ns();
+	for(i=0; i<burst; i++)
+		kact_mem_inject(k, KeyPress, BENCH_KEY + rand_r(&seed) % hotkeys,
+				ControlMask, (unsigned long) i);
+	kact_mem_wait(k);
+	d = bench_ns() - start;
+	printf("{\"bench\":\"dispatch_throughput\",\"hotkeys\":%ld,\"n\":%ld,"
+			"\"ns_per_op\":%.1f}\n", hotkeys, burst, (double) d / burst);
+
+	free(lat);
+	kact_clear(k);
+}
+
+/* Measures a burst through the ring: how fast the loop reads and hands
+	the events over and how long the dispatcher needs for all of them
+	Param: hotkeys = The number of registered hotkeys
+	Return: nothing */
+static void bench_ring(long hotkeys){
+	struct kact_config cfg;
+	struct keyact *k;
+	struct kact_stats st;
+	long i, burst = iters(200000), start, read, all;
+	unsigned int seed = 4711;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.ring_len = 4096;
+	cfg.ring_policy = KACT_RING_BLOCK;
+	k = bench_init(&cfg);
+	bench_fill(k, hotkeys);
+	kact_start(k);
+	start = bench_ns();
+	for(i=0; i<burst; i++)
+		kact_mem_inject(k, KeyPress, BENCH_KEY + rand_r(&seed) % hotkeys,
+				ControlMask, (unsigned long) i);
+	kact_mem_wait(k);
+	read = bench_ns() - start;
+	do
+		kact_stats(k, &st);
+	while(st.matches < (unsigned long) burst);
+	all = bench_ns() - start;
+	printf("{\"bench\":\"ring_throughput\",\"hotkeys\":%ld,\"n\":%ld,"
+			"\"read_ns_per_op\":%.1f,\"ns_per_op\":%.1f,\"waits\":%lu,"
+			"\"max_len\":%lu}\n", hotkeys, burst, (double) read / burst,
+			(double) all / burst, st.ring_waits, st.ring_max);
+	kact_clear(k);
+}
+
+/* Measures how long kact_stop and kact_clear take with a running loop
+	Param: hotkeys = The number of registered hotkeys
+	Return: nothing */
+static void bench_stop(long hotkeys){
+	struct kact_config cfg;
+	struct keyact *k;
+	long start, stop, clear;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.workers = 2;
+	k = bench_init(&cfg);
+	bench_fill(k, hotkeys);
+	kact_start(k);
+	kact_mem_inject(k, KeyPress, BENCH_KEY, ControlMask, 0);
+	kact_mem_wait(k);
+
+	start = bench_ns();
+	kact_stop(k);
+	stop = bench_ns() - start;
+	kact_start(k);
+	start = bench_ns();
+	kact_clear(k);
+	clear = bench_ns() - start;
+	printf("{\"bench\":\"stop_clear\",\"hotkeys\":%ld,\"stop_ns\":%ld,"
+			"\"clear_ns\":%ld}\n", hotkeys, stop, clear);
+}
+
+/* Appends like slist_add did before the list remembered its tail, the
+	reference for the containers benchmark
+	Param: list = A valid pointer to a slist structure
+		content = An arbitrary pointer
+	Return: nothing */
+static void walk_add(struct slist *list, void *content){
+	struct snode *n = (struct snode *) malloc(sizeof(struct snode)), *t;
+	n->content = content;
+	n->next = NULL;
+	if(list->start == NULL){
+		list->start = list->tail = n;
+	} else {
+		for(t = list->start; t->next != NULL; t = t->next)
+			;
+		t->next = list->tail = n;
+	}
+	list->len++;
+}
+
+static int sum_item(void *content, void *ctx){
+	*(long *) ctx += (long) content;
+	return 0;
+}
+
+/* Prints a result of the containers benchmark
+	Param: op = The name of the operation
+		n = The number of items
+		d = The time of all n operations in nanoseconds
+		sum = The checksum which keeps the compiler from dropping the loop
+	Return: nothing */
+static void print_container(const char *op, long n, long d, long sum){
+	printf("{\"bench\":\"containers\",\"op\":\"%s\",\"n\":%ld,"
+			"\"ns_per_op\":%.1f,\"sum\":%ld}\n", op, n, (double) d / n, sum);
+}
+
+/* Compares appending and iterating of the linked list, also with its
+	former append by walking, against the growable array
+	Param: n = The number of items at scale 1
+	Return: nothing */
+static void bench_containers(long n){
+	struct slist *walk = slist_init(), *list = slist_init();
+	struct kvec *v = kvec_init(0);
+	long i, start, sum;
+	size_t j;
+	int rc;
+
+	n = iters(n);
+	start = bench_ns();
+	for(i=0; i<n; i++)
+		walk_add(walk, (void *) i);
+	print_container("slist_add_walk", n, bench_ns() - start, walk->len);
+	start = bench_ns();
+	for(i=0; i<n; i++)
+		slist_add(list, (void *) i);
+	print_container("slist_add", n, bench_ns() - start, list->len);
+	start = bench_ns();
+	for(i=0; i<n; i++)
+		kvec_add(v, (void *) i);
+	print_container("kvec_add", n, bench_ns() - start, (long) v->len);
+
+	sum = 0;
+	start = bench_ns();
+	for(i=0; i<n; i++)
+		sum += (long) slist_get_at((int) i, list, &rc);
+	print_container("slist_get_at", n, bench_ns() - start, sum);
+	sum = 0;
+	start = bench_ns();
+	slist_foreach(list, sum_item, &sum);
+	print_container("slist_foreach", n, bench_ns() - start, sum);
+	sum = 0;
+	start = bench_ns();
+	KVEC_EACH(v, j)
+		sum += (long) kvec_get(v, j);
+	print_container("kvec_get", n, bench_ns() - start, sum);
+
+	slist_free(walk);
+	slist_free(list);
+	kvec_free(v);
+}
+
+int main(int argc, char **argv){
+	if(argc > 1)
+		scale = atof(argv[1]);
+	if(scale <= 0){
+		fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+		return 1;
+	}
+
+	bench_new_hk();
+	bench_keymap(10000);
+	bench_reg_hk();
+	bench_dispatch(10);
+	bench_dispatch(1000);
+	bench_dispatch(100000);
+	bench_ring(1000);
+	bench_replay(1000);
+	bench_stop(10);
+	bench_stop(100000);
+	bench_containers(20000);
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ 0-Software. Loads bindings from a text file. Every line holds the
+ modifiers, the key and the name of an action, separated by blanks:
+
+ # modifiers   key      action
+ ctrl,alt      t        terminal
+ super         F5       reload
+
+ The modifiers are written like the ones of kact_get_hk, but without
+ blanks. The key is a single character or the name of a keysym. Text
+ after '#' is ignored. The file is mapped privately and split in place,
+ so no token is copied before kact_new_hk stores it in the arena.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <X11/Xlib.h>
+#include "keyact.h"
+#include "hktable.h"
+#include "kmap.h"
+#include "kvec.h"
+#include "kbind.h"
+
+static char *kbind_token(char **p);
+static const struct kact_action *kbind_action(const struct hk_table *t,
+		const struct kact_action *actions, size_t nactions,
+		const char *name);
+static int kbind_fail(struct kact_keymap_err *err, unsigned int line,
+		const char *msg);
+
+/* Parses a keymap file and registers all of its bindings in one batch.
+	Nothing is registered if a line can't be parsed. Keycombs which have
+	been created before stay in the arena of k until kact_clear
+	Param: k = A valid pointer to a keyact structure
+		path = The path of the file
+		actions = An array of nactions actions the file may refer to. If
+			two have the same name, the last one is used
+		nactions = The number of actions
+		err = A valid pointer where the line and the reason of the first
+			error are stored or NULL
+	Return: The number of bindings which could not be grabbed or -1 if
+		the file can't be read or contains an invalid line */
+int kact_load_keymap(struct keyact *k, const char *path,
+		const struct kact_action *actions, size_t nactions,
+		struct kact_keymap_err *err){
+	const struct kact_action *a;
+	struct hk_table *names = NULL;
+	struct kvec *combs = NULL, *lines = NULL;
+	struct keycomb *c;
+	struct stat st;
+	char *map = MAP_FAILED, *p, *end, *eol, *mod, *key, *name;
+	unsigned long sym;
+	unsigned int line = 0;
+	size_t i, len = 0;
+	int fd, *rc = NULL, res = -1;
+	if(k == NULL || path == NULL || (actions == NULL && nactions > 0))
+		return kbind_fail(err, 0, "invalid argument");
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return kbind_fail(err, 0, "can't open the file");
+	if(fstat(fd, &st)){
+		close(fd);
+		return kbind_fail(err, 0, "can't open the file");
+	}
+	/* one byte more than the file, so the last line can be terminated
+	 	even if the size is a multiple of the page size. A private mapping
+	 	is writable without touching the file */
+	len = (size_t) st.st_size + 1;
+	map = (char *) mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(map != MAP_FAILED && st.st_size > 0 && mmap(map, len - 1,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+			MAP_FAILED){
+		munmap(map, len);
+		map = MAP_FAILED;
+	}
+	close(fd);
+	if(map == MAP_FAILED)
+		return kbind_fail(err, 0, "can't map the file");
+	map[len - 1] = '\0';
+
+	/* a name is found by its hash, like the hotkeys */
+	names = hk_table_init(nactions);
+	combs = kvec_init((size_t) st.st_size / 16);
+	lines = kvec_init((size_t) st.st_size / 16);
+	if(names == NULL || combs == NULL || lines == NULL){
+		kbind_fail(err, 0, "out of memory");
+		goto out;
+	}
+	for(i=0; i<nactions; i++)
+		if(actions[i].name == NULL || actions[i].func == NULL ||
+				hk_table_put(names, kmap_hash(KMAP_SEED, actions[i].name,
+				strlen(actions[i].name)), (void *) &actions[i])){
+			kbind_fail(err, 0, "invalid action");
+			goto out;
+		}
+
+	end = map + len - 1;
+	for(p = map; p < end; p = eol + 1){
+		line++;
+		eol = (char *) memchr(p, '\n', (size_t) (end - p));
+		if(eol == NULL)
+			eol = end;
+		*eol = '\0';
+		mod = kbind_token(&p);
+		if(mod == NULL)
+			continue;
+		key = kbind_token(&p);
+		name = kbind_token(&p);
+		if(key == NULL || name == NULL){
+			kbind_fail(err, line, "expected modifiers, key and action");
+			goto out;
+		}
+		if(kbind_token(&p) != NULL){
+			kbind_fail(err, line, "unexpected text after the action");
+			goto out;
+		}
+		sym = key[1] == '\0' ? (unsigned char) key[0] : XStringToKeysym(key);
+		if(sym == NoSymbol){
+			kbind_fail(err, line, "unknown key");
+			goto out;
+		}
+		a = kbind_action(names, actions, nactions, name);
+		if(a == NULL){
+			kbind_fail(err, line, "unknown action");
+			goto out;
+		}
+		c = kact_new_hk(k, a->func, mod, (int) sym, a->mp);
+		if(c == NULL){
+			kbind_fail(err, line, "no valid modifier or the key isn't on "
+					"the keyboard");
+			goto out;
+		}
+		if(kvec_add(combs, (void *) c) ||
+				kvec_add(lines, (void *) (uintptr_t) line)){
+			kbind_fail(err, line, "out of memory");
+			goto out;
+		}
+	}
+
+	if(combs->len == 0){
+		res = 0;
+		goto out;
+	}
+	rc = (int *) malloc(sizeof(int) * combs->len);
+	if(rc == NULL){
+		kbind_fail(err, 0, "out of memory");
+		goto out;
+	}
+	res = kact_reg_hk_batch((struct keycomb **) combs->items, combs->len,
+			k, rc);
+	if(res < 0){
+		kbind_fail(err, 0, "can't register the bindings");
+		goto out;
+	}
+	KVEC_EACH(combs, i)
+		if(rc[i]){
+			kbind_fail(err, (unsigned int) (uintptr_t) lines->items[i],
+					"can't grab the key");
+			break;
+		}
+out:
+	munmap(map, len);
+	hk_table_free(names);
+	kvec_free(combs);
+	kvec_free(lines);
+	free(rc);
+	return res;
+}
+
+/* Splits the next token off a terminated line. The blank after the
+	token is overwritten by the terminator
+	Param: p = A valid pointer to the rest of the line. It is advanced
+			behind the token
+	Return: The token or NULL if the rest of the line is empty or a
+		comment */
+static char *kbind_token(char **p){
+	char *s = *p, *res;
+	while(*s == ' ' || *s == '\t' || *s == '\r')
+		s++;
+	if(*s == '\0' || *s == '#'){
+		*p = s;
+		return NULL;
+	}
+	res = s;
+	while(*s != '\0' && *s != ' ' && *s != '\t' && *s != '\r' && *s != '#')
+		s++;
+	/* a comment right behind the token ends the line */
+	if(*s == '#')
+		*s = '\0';
+	else if(*s != '\0')
+		*s++ = '\0';
+	*p = s;
+	return res;
+}
+
+/* Looks an action up by its name
+	Param: t = The actions by the hash of their names
+		actions = The array of actions
+		nactions = The number of actions
+		name = The name
+	Return: The action or NULL if there is none of that name */
+static const struct kact_action *kbind_action(const struct hk_table *t,
+		const struct kact_action *actions, size_t nactions,
+		const char *name){
+	const struct kact_action *a;
+	size_t i;
+
+	a = (const struct kact_action *) hk_table_get(t,
+			kmap_hash(KMAP_SEED, name, strlen(name)));
+	if(a != NULL && !strcmp(a->name, name))
+		return a;
+	/* another name with the same hash or none at all */
+	for(i=nactions; a != NULL && i > 0; i--)
+		if(!strcmp(actions[i - 1].name, name))
+			return &actions[i - 1];
+	return NULL;
+}
+
+/* Records an error
+	Param: err = A pointer where the error is stored or NULL
+		line = The line of the error or 0
+		msg = The reason
+	Return: -1 */
+static int kbind_fail(struct kact_keymap_err *err, unsigned int line,
+		const char *msg){
+	if(err != NULL){
+		err->line = line;
+		err->msg = msg;
+	}
+	return -1;
+}
@@ -0,0 +1,26 @@
+/*
+ ---keymap files---
+ ---begin---
+ */
+
+#include <stddef.h>
+
+/* An action a keymap file may bind. The name is the one used in the
+   file, func and mp are passed on to kact_new_hk */
+struct kact_action {
+	const char *name;
+	int (*func)(void *mp);
+	void *mp;
+};
+
+/* Where a keymap file has been rejected */
+struct kact_keymap_err {
+	/* the line starting at 1 or 0 if the error belongs to no line */
+	unsigned int line;
+	const char *msg;
+};
+
+/* parse the keymap file at path and register all of its bindings */
+int kact_load_keymap(struct keyact *k, const char *path,
+		const struct kact_action *actions, size_t nactions,
+		struct kact_keymap_err *err);
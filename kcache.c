@@ -0,0 +1,299 @@
+/*
+ 0-Software. Stores resolved hotkeys in a binary file which is mapped on
+ the next start. A hotkey found in the file needs neither the parsing of
+ its modifier string nor any lookup of the backend. The file carries the
+ fingerprint of the keyboard mapping it was written for and is ignored
+ as soon as the mapping differs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "keyact.h"
+#include "slist.h"
+#include "hktable.h"
+#include "kvec.h"
+#include "kbackend.h"
+#include "kmap.h"
+#include "kcache.h"
+
+static uint64_t kcache_id(const char *mod, int key);
+static int kcache_add(struct kcache_rec *recs, size_t *n,
+		struct keycomb *c, size_t *strings);
+
+/* Maps a cache file. It is only used if it has been written for the
+	current mapping of the backend of k, otherwise the hotkeys are
+	resolved as usual. Must not be called while another thread creates
+	hotkeys of k
+	Param: k = A valid pointer to a keyact structure
+		path = The path of a file written by kact_cache_save
+	Return: 0 if the cache is used, -1 if it is missing, broken or
+		outdated */
+int kact_cache_load(struct keyact *k, const char *path){
+	const struct kcache_head *head;
+	struct kcache *c;
+	struct stat st;
+	uint64_t fp;
+	size_t body;
+	uint32_t i;
+	void *map;
+	int fd;
+	if(k == NULL || path == NULL || k->be->fingerprint(k, &fp))
+		return -1;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return -1;
+	if(fstat(fd, &st) || (size_t) st.st_size < sizeof(struct kcache_head)){
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return -1;
+
+	/* everything is checked once, so lookups can trust the file */
+	head = (const struct kcache_head *) map;
+	body = (size_t) st.st_size - sizeof(struct kcache_head);
+	c = (struct kcache *) malloc(sizeof(struct kcache));
+	if(c == NULL || head->magic != KCACHE_MAGIC ||
+			head->version != KCACHE_VERSION || head->fingerprint != fp ||
+			head->nslots <= head->count || 
+			(head->nslots & (head->nslots - 1)) != 0 ||
+			(size_t) head->count * sizeof(struct kcache_rec) +
+			(size_t) head->nslots * sizeof(uint32_t) + head->strings != body ||
+			head->strings == 0)
+		goto fail;
+	c->map = map;
+	c->size = (size_t) st.st_size;
+	c->fingerprint = fp;
+	c->recs = (const struct kcache_rec *) (head + 1);
+	c->count = head->count;
+	c->slots = (const uint32_t *) (c->recs + c->count);
+	c->nslots = head->nslots;
+	c->strings = (const char *) (c->slots + c->nslots);
+	c->nstrings = head->strings;
+	if(c->strings[c->nstrings - 1] != '\0')
+		goto fail;
+	for(i=0; i<c->count; i++)
+		if(c->recs[i].mod >= c->nstrings)
+			goto fail;
+	for(i=0; i<c->nslots; i++)
+		if(c->slots[i] != KCACHE_FREE && c->slots[i] >= c->count)
+			goto fail;
+
+	kcache_free(k);
+	k->cache = c;
+	return 0;
+
+fail:
+	free(c);
+	munmap(map, (size_t) st.st_size);
+	return -1;
+}
+
+/* Writes every hotkey which is registered or part of a profile into a
+	cache file. Sequences are not cached. The file is replaced atomically,
+	so a concurrent kact_cache_load sees either the old or the new one
+	Param: k = A valid pointer to a keyact structure
+		path = The path of the file
+	Return: 0 on success, -1 on failure */
+int kact_cache_save(struct keyact *k, const char *path){
+	struct kcache_head head;
+	struct kcache_rec *recs = NULL;
+	struct kact_profile *p;
+	struct keycomb *c;
+	struct snode *node;
+	size_t i, j, n = 0, cap = 0, strings = 0, len, nslots = 2;
+	uint32_t *slots = NULL;
+	char *tmp = NULL, *buf = NULL;
+	FILE *f;
+	int fd, rc = -1;
+	if(k == NULL || path == NULL || k->mutex == NULL)
+		return -1;
+	memset(&head, 0, sizeof(head));
+	if(k->be->fingerprint(k, &head.fingerprint))
+		return -1;
+
+	/* begin synchronisation with other writers */
+	pthread_mutex_lock(k->mutex);
+	cap = (size_t) k->mapping->len;
+	for(node = k->profiles->start; node != NULL; node = node->next)
+		cap += ((struct kact_profile *) node->content)->binds->len;
+	recs = (struct kcache_rec *) malloc(sizeof(struct kcache_rec) *
+			(cap + 1));
+	if(recs == NULL){
+		pthread_mutex_unlock(k->mutex);
+		return -1;
+	}
+	KVEC_EACH(k->mapping, i)
+		kcache_add(recs, &n, (struct keycomb *) k->mapping->items[i], 
+				&strings);
+	for(node = k->profiles->start; node != NULL; node = node->next){
+		p = (struct kact_profile *) node->content;
+		for(i=0; i<p->binds->cap; i++)
+			if((c = (struct keycomb *) p->binds->slots[i].val) != NULL)
+				kcache_add(recs, &n, c, &strings);
+	}
+
+	/* the modifier strings are copied while the keycombs are safe */
+	buf = (char *) malloc(strings + 1);
+	if(buf == NULL){
+		pthread_mutex_unlock(k->mutex);
+		free(recs);
+		return -1;
+	}
+	strings = 0;
+	for(i=0; i<n; i++){
+		c = (struct keycomb *) (uintptr_t) recs[i].id;
+		len = strlen(c->user_mod) + 1;
+		memcpy(buf + strings, c->user_mod, len);
+		recs[i].id = kcache_id(c->user_mod, c->key);
+		recs[i].mod = (uint32_t) strings;
+		strings += len;
+	}
+	pthread_mutex_unlock(k->mutex);
+	/* an empty cache still needs a terminator for kact_cache_load */
+	if(strings == 0)
+		buf[strings++] = '\0';
+
+	/* keep the load factor at or below 0.5 */
+	while(nslots < n * 2)
+		nslots <<= 1;
+	slots = (uint32_t *) malloc(sizeof(uint32_t) * nslots);
+	if(slots == NULL)
+		goto out;
+	memset(slots, 0xff, sizeof(uint32_t) * nslots);
+	for(i=0; i<n; i++){
+		/* keycombs of the same strings share their hotkey, so the first
+		 	one wins */
+		for(j = recs[i].id & (nslots - 1); slots[j] != KCACHE_FREE;
+				j = (j + 1) & (nslots - 1))
+			if(recs[slots[j]].id == recs[i].id)
+				break;
+		if(slots[j] == KCACHE_FREE)
+			slots[j] = (uint32_t) i;
+	}
+	head.magic = KCACHE_MAGIC;
+	head.version = KCACHE_VERSION;
+	head.count = (uint32_t) n;
+	head.nslots = (uint32_t) nslots;
+	head.strings = (uint32_t) strings;
+
+	tmp = (char *) malloc(strlen(path) + 8);
+	if(tmp == NULL)
+		goto out;
+	sprintf(tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if(fd < 0)
+		goto out;
+	f = fdopen(fd, "wb");
+	if(f == NULL){
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+	if(fwrite(&head, sizeof(head), 1, f) != 1 ||
+			fwrite(recs, sizeof(struct kcache_rec), n, f) != n ||
+			fwrite(slots, sizeof(uint32_t), nslots, f) != nslots ||
+			fwrite(buf, 1, strings, f) != strings){
+		fclose(f);
+		unlink(tmp);
+		goto out;
+	}
+	if(fclose(f) || rename(tmp, path)){
+		unlink(tmp);
+		goto out;
+	}
+	rc = 0;
+out:
+	free(tmp);
+	free(slots);
+	free(buf);
+	free(recs);
+	return rc;
+}
+
+/* Remembers a keycomb in the next record. The record temporarily holds
+	the keycomb itself instead of its id. Has to be called with k->mutex
+	held
+	Param: recs = The records
+		n = A valid pointer to the number of records
+		c = A valid pointer to a keycomb structure
+		strings = A valid pointer to the size of the modifier strings
+	Return: 0 on success, -1 if c can't be cached */
+static int kcache_add(struct kcache_rec *recs, size_t *n,
+		struct keycomb *c, size_t *strings){
+	if(c->key == 0 || c->user_mod == NULL)
+		return -1;
+	recs[*n].id = (uint64_t) (uintptr_t) c;
+	recs[*n].key = (uint32_t) c->key;
+	recs[*n].keycode = c->internal.keycode;
+	recs[*n].mod_mask = c->internal.mod_mask;
+	(*n)++;
+	*strings += strlen(c->user_mod) + 1;
+	return 0;
+}
+
+/* Looks a hotkey up in the cache of k. Used instead of transform by
+	make_hk, so no modifier string is parsed and the backend resolves
+	nothing
+	Param: k = A valid pointer to a keyact structure
+		mod = The modifier string as given to kact_new_hk
+		key = The keysym
+		h = A valid pointer where the hotkey is stored
+	Return: 0 on success, -1 if the hotkey isn't cached or the mapping
+		has changed since the cache has been written */
+int kcache_lookup(struct keyact *k, const char *mod, int key,
+		struct hotkey *h){
+	const struct kcache *c = k->cache;
+	const struct kcache_rec *r;
+	uint64_t id, fp;
+	uint32_t i, n;
+	if(c == NULL || k->be->fingerprint(k, &fp) || fp != c->fingerprint)
+		return -1;
+
+	id = kcache_id(mod, key);
+	/* there is always a free slot, so probing ends. n only guards
+	 	against a file whose slots have been tampered with */
+	for(i = (uint32_t) id & (c->nslots - 1), n = 0; 
+			c->slots[i] != KCACHE_FREE && n < c->nslots;
+			i = (i + 1) & (c->nslots - 1), n++){
+		r = &c->recs[c->slots[i]];
+		if(r->id != id)
+			continue;
+		/* a different hotkey with the same id is resolved as usual */
+		if(r->key != (uint32_t) key || strcmp(c->strings + r->mod, mod))
+			return -1;
+		h->keycode = r->keycode;
+		h->mod_mask = r->mod_mask;
+		return 0;
+	}
+	return -1;
+}
+
+/* Unmaps the cache of k if there is one
+	Param: k = A valid pointer to a keyact structure
+	Return: nothing */
+void kcache_free(struct keyact *k){
+	if(k->cache == NULL)
+		return;
+	munmap(k->cache->map, k->cache->size);
+	free(k->cache);
+	k->cache = NULL;
+}
+
+/* Param: mod = A modifier string
+		key = A keysym
+	Return: The id of a hotkey in the cache */
+static uint64_t kcache_id(const char *mod, int key){
+	uint32_t k = (uint32_t) key;
+	return kmap_hash(kmap_hash(KMAP_SEED, &k, sizeof(k)), mod, strlen(mod));
+}
@@ -0,0 +1,66 @@
+/*
+ ---binary cache of resolved hotkeys---
+ ---begin---
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* "KACT" in the byte order of the machine which wrote the file */
+#define KCACHE_MAGIC 0x5443414bU
+#define KCACHE_VERSION 1
+
+/* marks an empty slot */
+#define KCACHE_FREE 0xffffffffU
+
+/* The file starts with the head, followed by count records, the slots
+   of a hash table and the modifier strings. It is mapped as it is, so
+   every member has a fixed size */
+struct kcache_head {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t fingerprint;
+	uint32_t count;
+	/* a power of two bigger than count. A slot holds the index of a
+	   record or KCACHE_FREE, collisions are resolved by linear probing */
+	uint32_t nslots;
+	/* bytes of the modifier strings, including their terminators */
+	uint32_t strings;
+	uint32_t pad;
+};
+
+struct kcache_rec {
+	/* hash of key and modifier string, see kcache_id */
+	uint64_t id;
+	uint32_t key;
+	/* offset of the modifier string */
+	uint32_t mod;
+	uint32_t keycode;
+	uint32_t mod_mask;
+};
+
+/* A mapped cache file */
+struct kcache {
+	void *map;
+	size_t size;
+	uint64_t fingerprint;
+	const struct kcache_rec *recs;
+	uint32_t count;
+	const uint32_t *slots;
+	uint32_t nslots;
+	const char *strings;
+	uint32_t nstrings;
+};
+
+/* map the cache file at path if it was written for the mapping of k */
+int kact_cache_load(struct keyact *k, const char *path);
+
+/* write the resolved hotkeys of k into the cache file at path */
+int kact_cache_save(struct keyact *k, const char *path);
+
+/* look a hotkey up in the cache of k, see make_hk */
+int kcache_lookup(struct keyact *k, const char *mod, int key,
+		struct hotkey *h);
+
+/* unmap the cache of k */
+void kcache_free(struct keyact *k);
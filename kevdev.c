@@ -0,0 +1,504 @@
+/*
+ 0-Software. The evdev backend for machines without an x-server. It reads
+ struct input_event records from /dev/input/event* or from any other
+ descriptor, e.g. a pipe or a recorded file. Keycodes are the evdev codes
+ plus 8 like in X11, keysyms are resolved by a US layout and the
+ modifiers are tracked by the backend itself.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include "keyact.h"
+#include "kbackend.h"
+#include "kmap.h"
+
+static int ev_open(struct keyact *k, const struct kact_config *cfg);
+static int ev_close(struct keyact *k);
+static int ev_setup(struct keyact *k);
+static int ev_fd(struct keyact *k);
+static int ev_pending(struct keyact *k);
+static int ev_read(struct keyact *k, struct kact_event *batch, int max);
+static int ev_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc);
+static int ev_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode);
+static int ev_modifier(struct keyact *k, const char *name,
+		unsigned int *mask);
+static int ev_fingerprint(struct keyact *k, uint64_t *fp);
+
+const struct kact_backend kact_evdev = {
+	"evdev",
+	ev_open,
+	ev_close,
+	ev_setup,
+	ev_fd,
+	ev_pending,
+	ev_read,
+	ev_grab,
+	ev_keycode,
+	ev_modifier,
+	ev_fingerprint
+};
+
+/* An input device. Descriptors which epoll doesn't support, e.g. regular
+   files, are read on every wakeup until their end */
+struct kev_dev {
+	int fd;
+	int owned;
+	int polled;
+	/* the beginning of a record which has been read partially */
+	size_t part;
+	unsigned char buf[sizeof(struct input_event)];
+};
+
+/* The private data of the backend. devs is protected by mutex, because
+   kact_evdev_add_fd may be called while the loop is running. Everything
+   else is owned by the event loop */
+struct kevdev {
+	pthread_mutex_t mutex;
+	int epfd;
+	struct kev_dev devs[EV_DEVS];
+	int ndevs;
+	struct input_event records[EV_BUF];
+	/* decoded events which have not been read yet */
+	struct kact_event queue[EV_BUF];
+	unsigned int head;
+	unsigned int len;
+	unsigned char down[EV_KEYS];
+	unsigned int state;
+	/* hash of the fixed tables, see ev_fingerprint */
+	uint64_t fingerprint;
+};
+
+/* Keysyms of a US keyboard and their evdev codes */
+static const struct {
+	unsigned long keysym;
+	unsigned short code;
+} ev_syms[] = {
+	{ XK_Escape, KEY_ESC }, { XK_1, KEY_1 }, { XK_2, KEY_2 },
+	{ XK_3, KEY_3 }, { XK_4, KEY_4 }, { XK_5, KEY_5 }, { XK_6, KEY_6 },
+	{ XK_7, KEY_7 }, { XK_8, KEY_8 }, { XK_9, KEY_9 }, { XK_0, KEY_0 },
+	{ XK_minus, KEY_MINUS }, { XK_equal, KEY_EQUAL },
+	{ XK_BackSpace, KEY_BACKSPACE }, { XK_Tab, KEY_TAB },
+	{ XK_q, KEY_Q }, { XK_w, KEY_W }, { XK_e, KEY_E }, { XK_r, KEY_R },
+	{ XK_t, KEY_T }, { XK_y, KEY_Y }, { XK_u, KEY_U }, { XK_i, KEY_I },
+	{ XK_o, KEY_O }, { XK_p, KEY_P }, { XK_bracketleft, KEY_LEFTBRACE },
+	{ XK_bracketright, KEY_RIGHTBRACE }, { XK_Return, KEY_ENTER },
+	{ XK_a, KEY_A }, { XK_s, KEY_S }, { XK_d, KEY_D }, { XK_f, KEY_F },
+	{ XK_g, KEY_G }, { XK_h, KEY_H }, { XK_j, KEY_J }, { XK_k, KEY_K },
+	{ XK_l, KEY_L }, { XK_semicolon, KEY_SEMICOLON },
+	{ XK_apostrophe, KEY_APOSTROPHE }, { XK_grave, KEY_GRAVE },
+	{ XK_backslash, KEY_BACKSLASH }, { XK_z, KEY_Z }, { XK_x, KEY_X },
+	{ XK_c, KEY_C }, { XK_v, KEY_V }, { XK_b, KEY_B }, { XK_n, KEY_N },
+	{ XK_m, KEY_M }, { XK_comma, KEY_COMMA }, { XK_period, KEY_DOT },
+	{ XK_slash, KEY_SLASH }, { XK_space, KEY_SPACE },
+	{ XK_F1, KEY_F1 }, { XK_F2, KEY_F2 }, { XK_F3, KEY_F3 },
+	{ XK_F4, KEY_F4 }, { XK_F5, KEY_F5 }, { XK_F6, KEY_F6 },
+	{ XK_F7, KEY_F7 }, { XK_F8, KEY_F8 }, { XK_F9, KEY_F9 },
+	{ XK_F10, KEY_F10 }, { XK_F11, KEY_F11 }, { XK_F12, KEY_F12 },
+	{ XK_Home, KEY_HOME }, { XK_Up, KEY_UP }, { XK_Prior, KEY_PAGEUP },
+	{ XK_Left, KEY_LEFT }, { XK_Right, KEY_RIGHT }, { XK_End, KEY_END },
+	{ XK_Down, KEY_DOWN }, { XK_Next, KEY_PAGEDOWN },
+	{ XK_Insert, KEY_INSERT }, { XK_Delete, KEY_DELETE },
+	{ XK_Print, KEY_SYSRQ }, { XK_Pause, KEY_PAUSE },
+	{ XK_Menu, KEY_COMPOSE }
+};
+
+/* Modifier keys and the mask they set. The left and the right key of a
+   modifier are neighbours, ev_track relies on that. Lock and NumLock
+   toggle */
+static const struct {
+	unsigned short code;
+	unsigned int mask;
+	int toggle;
+} ev_mods[] = {
+	{ KEY_LEFTSHIFT, ShiftMask, 0 }, { KEY_RIGHTSHIFT, ShiftMask, 0 },
+	{ KEY_LEFTCTRL, ControlMask, 0 }, { KEY_RIGHTCTRL, ControlMask, 0 },
+	{ KEY_LEFTALT, Mod1Mask, 0 }, { KEY_RIGHTALT, Mod1Mask, 0 },
+	{ KEY_LEFTMETA, Mod4Mask, 0 }, { KEY_RIGHTMETA, Mod4Mask, 0 },
+	{ KEY_CAPSLOCK, LockMask, 1 }, { KEY_NUMLOCK, Mod2Mask, 1 }
+};
+
+static const struct x11_mask ev_names[] = {
+	{ "shift", ShiftMask },
+	{ "lock", LockMask },
+	{ "ctrl", ControlMask },
+	{ "mod1", Mod1Mask },
+	{ "mod2", Mod2Mask },
+	{ "mod3", Mod3Mask },
+	{ "mod4", Mod4Mask },
+	{ "mod5", Mod5Mask },
+	{ "alt", Mod1Mask },
+	{ "super", Mod4Mask }
+};
+
+/* Adds a descriptor to the devices. Has to be called with the mutex held
+	Param: x = A valid pointer to the private data of the backend
+		fd = A readable descriptor
+		owned = 1 if the descriptor is closed by the backend
+	Return: 0 on success, -1 on failure */
+static int ev_add(struct kevdev *x, int fd, int owned){
+	struct epoll_event ev;
+	struct kev_dev *d;
+	if(x->ndevs == EV_DEVS)
+		return -1;
+
+	d = &x->devs[x->ndevs];
+	d->fd = fd;
+	d->owned = owned;
+	d->part = 0;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	d->polled = epoll_ctl(x->epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+	/* epoll refuses regular files, they are always readable */
+	if(!d->polled && errno != EPERM)
+		return -1;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	x->ndevs++;
+	return 0;
+}
+
+/* Removes a device. Has to be called with the mutex held
+	Param: x = A valid pointer to the private data of the backend
+		i = The index of the device
+	Return: nothing */
+static void ev_remove(struct kevdev *x, int i){
+	struct kev_dev *d = &x->devs[i];
+	if(d->polled)
+		epoll_ctl(x->epfd, EPOLL_CTL_DEL, d->fd, NULL);
+	if(d->owned)
+		close(d->fd);
+	x->devs[i] = x->devs[--x->ndevs];
+}
+
+/* Opens every device in /dev/input which has the keys of a keyboard
+	Param: x = A valid pointer to the private data of the backend
+	Return: nothing */
+static void ev_scan(struct kevdev *x){
+	unsigned long bits[KEY_MAX / (8 * sizeof(long)) + 1];
+	char path[300];
+	struct dirent *e;
+	DIR *dir;
+	int fd;
+
+	dir = opendir("/dev/input");
+	if(dir == NULL)
+		return;
+	while((e = readdir(dir)) != NULL){
+		if(strncmp(e->d_name, "event", 5))
+			continue;
+		snprintf(path, sizeof(path), "/dev/input/%s", e->d_name);
+		fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if(fd < 0)
+			continue;
+		memset(bits, 0, sizeof(bits));
+		/* a keyboard has at least the letters */
+		if(ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(bits)), bits) < 0 ||
+				!(bits[KEY_A / (8 * sizeof(long))] &
+				1UL << KEY_A % (8 * sizeof(long))) || ev_add(x, fd, 1))
+			close(fd);
+	}
+	closedir(dir);
+}
+
+/* Opens the configured device or all keyboards
+	Param: k = A valid pointer to a keyact structure
+		cfg = The configuration or NULL. Its member device is the path of
+			an input device, NULL for all keyboards in /dev/input or an
+			empty string for no device at all. Further descriptors can be
+			added by kact_evdev_add_fd
+	Return: 0 on success, -1 on failure */
+static int ev_open(struct keyact *k, const struct kact_config *cfg){
+	const char *dev = cfg != NULL ? cfg->device : NULL;
+	struct kevdev *x;
+	int fd;
+
+	x = (struct kevdev *) calloc(1, sizeof(struct kevdev));
+	if(x == NULL)
+		return -1;
+	x->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(x->epfd < 0){
+		free(x);
+		return -1;
+	}
+	pthread_mutex_init(&x->mutex, NULL);
+	x->fingerprint = kmap_hash(kmap_hash(KMAP_SEED, ev_syms, 
+			sizeof(ev_syms)), ev_names, sizeof(ev_names));
+	k->be_data = (void *) x;
+
+	if(dev == NULL){
+		ev_scan(x);
+		if(x->ndevs > 0)
+			return 0;
+	} else if(dev[0] == '\0')
+		return 0;
+	else if((fd = open(dev, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) >= 0){
+		if(!ev_add(x, fd, 1))
+			return 0;
+		close(fd);
+	}
+	ev_close(k);
+	return -1;
+}
+
+/* Closes the devices which have been opened by the backend
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success */
+static int ev_close(struct keyact *k){
+	struct kevdev *x = (struct kevdev *) k->be_data;
+	while(x->ndevs > 0)
+		ev_remove(x, x->ndevs - 1);
+	close(x->epfd);
+	pthread_mutex_destroy(&x->mutex);
+	free(x);
+	k->be_data = NULL;
+	return 0;
+}
+
+/* Nothing has to be prepared
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 */
+static int ev_setup(struct keyact *k){
+	(void) k;
+	return 0;
+}
+
+/* Param: k = A valid pointer to a keyact structure
+	Return: The epoll descriptor. It is readable if any device is */
+static int ev_fd(struct keyact *k){
+	return ((struct kevdev *) k->be_data)->epfd;
+}
+
+/* Updates the tracked modifiers by a key event
+	Param: x = A valid pointer to the private data of the backend
+		code = The evdev code of the key
+		press = 1 for a press, 0 for a release
+	Return: 1 if the key is a modifier, 0 otherwise */
+static int ev_track(struct kevdev *x, unsigned int code, int press){
+	size_t i;
+	for(i=0; i<sizeof(ev_mods) / sizeof(ev_mods[0]); i++){
+		if(ev_mods[i].code != code)
+			continue;
+		if(ev_mods[i].toggle){
+			if(press && !x->down[code])
+				x->state ^= ev_mods[i].mask;
+			break;
+		}
+		/* the other key of the modifier might still be held down */
+		if(press)
+			x->state |= ev_mods[i].mask;
+		else if(!x->down[ev_mods[i ^ 1].code])
+			x->state &= ~ev_mods[i].mask;
+		break;
+	}
+	if(code < EV_KEYS)
+		x->down[code] = press;
+	return i < sizeof(ev_mods) / sizeof(ev_mods[0]);
+}
+
+/* Decodes the records of a device into the queue. An autorepeat is
+	reported as another KeyPress. Modifier keys only change the state of
+	the following events, like grabbed keys in X11 they never become
+	events themselves. So pressing ctrl again between the strokes of a
+	sequence doesn't end it
+	Param: x = A valid pointer to the private data of the backend
+		r = The records
+		n = The number of records
+	Return: nothing */
+static void ev_decode(struct kevdev *x, struct input_event *r, size_t n){
+	struct kact_event *e;
+	unsigned int state;
+	size_t i;
+
+	for(i=0; i<n; i++){
+		if(r[i].type != EV_KEY || r[i].value < 0 || r[i].value > 2)
+			continue;
+		/* like in X11 the state before the event */
+		state = x->state;
+		if(ev_track(x, r[i].code, r[i].value != 0))
+			continue;
+		e = &x->queue[(x->head + x->len++) % EV_BUF];
+		e->type = r[i].value ? KeyPress : KeyRelease;
+		e->keycode = r[i].code + 8;
+		e->state = state;
+		e->time = r[i].time.tv_sec * 1000UL + r[i].time.tv_usec / 1000;
+	}
+}
+
+/* Reads a device with as few read calls as possible. At most as many
+	records are read as the queue has room for
+	Param: x = A valid pointer to the private data of the backend
+		i = The index of the device
+	Return: 0 on success, -1 if the device has ended or failed */
+static int ev_drain(struct kevdev *x, int i){
+	struct kev_dev *d = &x->devs[i];
+	const size_t size = sizeof(struct input_event);
+	unsigned char *buf = (unsigned char *) x->records;
+	size_t room, got;
+	ssize_t rc;
+
+	while((room = EV_BUF - x->len) > 0){
+		/* a partial record of the last read comes first */
+		memcpy(buf, d->buf, d->part);
+		rc = read(d->fd, buf + d->part, room * size - d->part);
+		if(rc < 0 && errno == EINTR)
+			continue;
+		if(rc <= 0)
+			return rc < 0 && errno == EAGAIN ? 0 : -1;
+		got = d->part + (size_t) rc;
+		d->part = got % size;
+		memcpy(d->buf, buf + got - d->part, d->part);
+		ev_decode(x, x->records, got / size);
+		if(got < room * size)
+			return 0;
+	}
+	return 0;
+}
+
+/* Reads every device which is ready. Regular files are always ready
+	Param: x = A valid pointer to the private data of the backend
+	Return: nothing */
+static void ev_fill(struct kevdev *x){
+	struct epoll_event ready[EV_DEVS];
+	int i, j, n;
+
+	pthread_mutex_lock(&x->mutex);
+	n = epoll_wait(x->epfd, ready, EV_DEVS, 0);
+	for(i=x->ndevs - 1; i >= 0 && x->len < EV_BUF; i--){
+		if(x->devs[i].polled){
+			for(j=0; j<n; j++)
+				if(ready[j].data.fd == x->devs[i].fd)
+					break;
+			if(j >= n)
+				continue;
+		}
+		if(ev_drain(x, i))
+			ev_remove(x, i);
+	}
+	pthread_mutex_unlock(&x->mutex);
+}
+
+/* Param: k = A valid pointer to a keyact structure
+	Return: The number of decoded events which can be read */
+static int ev_pending(struct keyact *k){
+	struct kevdev *x = (struct kevdev *) k->be_data;
+	if(x->len == 0)
+		ev_fill(x);
+	return (int) x->len;
+}
+
+/* Takes up to max decoded events
+	Param: k = A valid pointer to a keyact structure
+		batch = An array of at least max kact_event structures
+		max = The size of batch
+	Return: The number of events */
+static int ev_read(struct keyact *k, struct kact_event *batch, int max){
+	struct kevdev *x = (struct kevdev *) k->be_data;
+	int n = 0;
+
+	if(x->len == 0)
+		ev_fill(x);
+	while(x->len > 0 && n < max){
+		batch[n++] = x->queue[x->head];
+		x->head = (x->head + 1) % EV_BUF;
+		x->len--;
+	}
+	return n;
+}
+
+/* Single keys can't be grabbed from an input device, the events of other
+	keys would be lost. The hotkeys are only matched by the event loop
+	Param: k = A valid pointer to a keyact structure
+		keys = An array of n hotkeys
+		n = The number of hotkeys
+		grab = 1 to grab the hotkeys, 0 to ungrab them
+		rc = An array of n integers or NULL. It is left untouched
+	Return: 0 */
+static int ev_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc){
+	(void) k; (void) keys; (void) n; (void) grab; (void) rc;
+	return 0;
+}
+
+/* Resolves a keysym by the US layout. Upper case letters share the key of
+	the lower case ones
+	Param: k = A valid pointer to a keyact structure
+		keysym = A X11 keysym
+		keycode = A valid pointer where the keycode is stored
+	Return: 0 on success, -1 if the keysym isn't on the layout */
+static int ev_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode){
+	size_t i;
+	(void) k;
+	if(keysym >= XK_A && keysym <= XK_Z)
+		keysym += XK_a - XK_A;
+	for(i=0; i<sizeof(ev_syms) / sizeof(ev_syms[0]); i++)
+		if(ev_syms[i].keysym == keysym){
+			*keycode = ev_syms[i].code + 8;
+			return 0;
+		}
+	return -1;
+}
+
+/* Resolves a modifier by a fixed table
+	Param: k = A valid pointer to a keyact structure
+		name = The name of the modifier
+		mask = A valid pointer where the mask is stored
+	Return: 0 on success, -1 if the name is unknown */
+static int ev_modifier(struct keyact *k, const char *name,
+		unsigned int *mask){
+	size_t i;
+	(void) k;
+	for(i=0; i<sizeof(ev_names) / sizeof(ev_names[0]); i++)
+		if(!strcmp(ev_names[i].modstr, name)){
+			*mask = (unsigned int) ev_names[i].mask;
+			return 0;
+		}
+	return -1;
+}
+
+/* The layout is fixed, so the hash only changes with the tables of a
+	new release
+	Param: k = A valid pointer to a keyact structure
+		fp = A valid pointer where the hash is stored
+	Return: 0 */
+static int ev_fingerprint(struct keyact *k, uint64_t *fp){
+	*fp = ((struct kevdev *) k->be_data)->fingerprint;
+	return 0;
+}
+
+/* Adds a descriptor which delivers struct input_event records, e.g. a
+	pipe or a recorded file. It is not closed by the backend. At the end
+	of its input it is dropped
+	Param: k = A valid pointer to a keyact structure using kact_evdev
+		fd = A readable descriptor
+	Return: 0 on success, -1 on failure */
+int kact_evdev_add_fd(struct keyact *k, int fd){
+	struct kevdev *x;
+	int rc;
+	if(k == NULL || k->be != &kact_evdev || fd < 0)
+		return -1;
+
+	x = (struct kevdev *) k->be_data;
+	pthread_mutex_lock(&x->mutex);
+	rc = ev_add(x, fd, 0);
+	pthread_mutex_unlock(&x->mutex);
+	/* a file isn't signalled by epoll */
+	if(!rc && write(k->wakeup[1], "", 1) < 0)
+		return 0;
+	return rc;
+}
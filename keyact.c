@@ -18,23 +18,103 @@
 #include <string.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/XKBlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include <time.h>
 #include "keyact.h"
 #include "slist.h"
+#include "hktable.h"
+#include "kpool.h"
+#include "kmap.h"
+#include "arena.h"
+#include "kbackend.h"
+#include "kloop.h"
+#include "kcache.h"
+#include "krec.h"
+#include "kring.h"
+#include "kvec.h"
 
 #ifdef TEST
 #include <CUnit/Cunit.h>
 #include <CUnit/Basic.h>
+#include <linux/input.h>
+#include "kbind.h"
 #endif 
 
-static int transform(struct hotkey *h, struct keycomb *k);
+static int transform(struct keyact *k, struct hotkey *h, struct keycomb *c);
+static int resolve_key(struct keyact *k, unsigned long keysym, 
+		unsigned int *keycode);
+static int resolve_mod(struct keyact *k, const char *name, unsigned int *mask);
+static struct keycomb *make_hk(struct keyact *k, int (*func)(void *mp), 
+		const char *mod, int key, void *mp);
+static void *arena_node(void *a, size_t size);
+static uint64_t hk_pack(unsigned int keycode, unsigned int mod_mask);
+static void table_publish(struct keyact *k, struct hk_table **slot,
+		struct hk_table *next);
+static void table_reclaim(struct keyact *k);
+static struct hk_table *table_acquire(struct keyact *k);
+static int parse_seq(struct keyact *k, const char *seq, 
+		struct hotkey *strokes);
+static int seq_insert(struct keyact *k, struct hk_table *next,
+		const struct hotkey *strokes, int n, struct keycomb *res,
+		unsigned int timeout, struct kvec *scratch);
+static struct seq_state *seq_node(struct keyact *k, size_t nnext,
+		struct kvec *scratch);
+static struct hk_table *seq_rebuild(struct keyact *k);
+static int seq_commit(struct keyact *k, const struct hk_table *scratch,
+		const struct seq_state *s, struct seq_state *old,
+		const struct seq_state *from, const struct hotkey *h,
+		struct hk_table *next);
+static int seq_same(const struct seq_state *a, const struct seq_state *b);
+static struct seq_state *seq_walk(const struct hk_table *seqs,
+		const struct hotkey *strokes, int n);
+static uint64_t seq_key(const struct seq_state *from, const struct hotkey *h);
+static void seq_move(struct keyact *k, struct seq_state *to, 
+		struct hk_table *table, struct hk_table *seqs);
+static long now_ms(void);
+static long now_us(void);
+static long now_ns(void);
+static int cmp_ulong(const void *a, const void *b);
+static void stat_add(unsigned long *c, unsigned long n);
+static void hist_add(struct kact_hist *h, long us);
+static long event_stamp(struct keyact *k, unsigned long time, long now);
+static unsigned int repeat_filter(struct keyact *k, struct keycomb *c, 
+		struct kact_event *e);
+static int call_hk(void *c, unsigned int n, long stamp);
+static void table_release(struct keyact *k);
 static void search_x11(struct keyact *k, XEvent *e);
 
 static void *event_loop(void *k);
+static void *ring_loop(void *k);
+static void dispatch_batch(struct keyact *k, struct kact_event *batch, 
+		int n);
+static int remap(struct keyact *k);
+static void remap_check(struct keyact *k, struct keycomb *c,
+		struct keycomb **moved, struct hotkey *keys, size_t *n);
 static void loop_clean(void *k);
-static void send_devent(struct keyact *k);
-static int *on_error(Display *d, XErrorEvent *e);
+static void wakeup(struct keyact *k);
+static int wait_event(struct keyact *k);
+static int seq_timeout(struct keyact *k);
+static int epoll_add(int epfd, int fd);
+static struct kact_profile *profile_find(struct keyact *k, const char *name);
+static int mapping_add(struct keyact *k, struct keycomb *c);
+static int mapping_has(struct keyact *k, struct keycomb *c);
+static int sym_add(struct keyact *k, struct keycomb *c);
+static void sym_rm(struct keyact *k, struct keycomb *c);
+static int mod_add(struct keyact *k, const char *name);
+static int remap_mods(struct keyact *k);
+static int mapping_rm(struct keyact *k, struct keycomb *c);
+static int chain_link(struct keyact *k, struct keycomb *c);
+static void chain_unlink(struct keyact *k, struct keycomb *c);
+static int first_stroke(struct keyact *k, const struct hotkey *h);
+static int profile_free(void *p, void *ctx);
 
 /* Registers the hotkey c in the system k 
  	Param: c = A valid pointer to a keycomb structure. get_keycomb returns
@@ -43,27 +123,1132 @@ static int *on_error(Display *d, XErrorEvent *e);
  		can be queried by init. 
  	Return: 0 on success and -1 on failure */
 int kact_reg_hk(struct keycomb *c, struct keyact *k){
-	int i;
-	if(c == NULL || k == NULL)
+	struct hk_table *next;
+	int grabbed;
+	if(c == NULL || k == NULL || c->profile != NULL)
 		return -1;
 	if(k->mutex == NULL)
 		return -1;
-	/* begin synchronisation */
+	c->stats = &k->stats;
+	/* begin synchronisation with other writers. The event loop is never
+	 	blocked, it keeps reading the old snapshot until the new one is
+	 	published */
 	pthread_mutex_lock(k->mutex);
-	if(slist_prepend(k->mapping, (void*) c)){
+	/* the latest registration of a hotkey shadows the older ones, their
+	 	grab is kept */
+	grabbed = hk_table_get(k->table, hk_pack(c->internal.keycode,
+			c->internal.mod_mask)) != NULL || first_stroke(k, &c->internal);
+	if(mapping_add(k, c)){
+		pthread_mutex_unlock(k->mutex);
+		return -1;
+	}
+	next = hk_table_copy(k->table, 1);
+	if(next == NULL || hk_table_put(next, hk_pack(c->internal.keycode, 
+			c->internal.mod_mask), (void *) c)){
+		hk_table_free(next);
+		mapping_rm(k, c);
 		pthread_mutex_unlock(k->mutex);
 		return -1;
 	}
+	table_publish(k, &k->table, next);
 	pthread_mutex_unlock(k->mutex);
 
 	/* Register the Hotkey */
-	for(i=0; i<XScreenCount(k->display); i++)
-		XGrabKey(k->display, c->internal.keycode, c->internal.mod_mask,
-				XRootWindow(k->display, i), 0, GrabModeAsync, GrabModeAsync);
+	if(!grabbed)
+		k->be->grab(k, &c->internal, 1, 1, NULL);
+
+	return 0;
+}
+
+/* Registers n hotkeys at once. All grabs are sent to the x-server in
+	one go and there is only a single round trip at the end to collect
+	their errors. Hotkeys which could be grabbed are inserted into the
+	mapping and published in one new snapshot
+	Param: c = An array of n pointers to keycomb structures
+		n = The number of hotkeys
+		k = A valid pointer to a keyact structure
+		rc = An array of n integers or NULL. rc[i] is set to 0 if c[i] has
+			been registered, -1 if it is invalid or could not be grabbed
+	Return: The number of hotkeys which could not be registered or -1 if
+		an invalid value has been given as argument */
+int kact_reg_hk_batch(struct keycomb **c, size_t n, struct keyact *k, 
+		int *rc){
+	struct hk_table *next;
+	struct hotkey *keys;
+	int *res;
+	size_t i;
+	int failed = 0;
+	if(c == NULL || k == NULL || k->mutex == NULL)
+		return -1;
+	if(n == 0)
+		return 0;
+
+	keys = (struct hotkey *) malloc(sizeof(struct hotkey) * n);
+	res = rc != NULL ? rc : (int *) malloc(sizeof(int) * n);
+	if(keys == NULL || res == NULL){
+		free(keys);
+		if(res != rc)
+			free(res);
+		return -1;
+	}
+	for(i=0; i<n; i++){
+		res[i] = c[i] == NULL ? -1 : 0;
+		if(c[i] == NULL)
+			continue;
+		keys[i] = c[i]->internal;
+		c[i]->stats = &k->stats;
+	}
+	k->be->grab(k, keys, n, 1, res);
+	free(keys);
+
+	/* begin synchronisation with other writers */
+	pthread_mutex_lock(k->mutex);
+	next = hk_table_copy(k->table, n);
+	for(i=0; i<n; i++){
+		if(res[i])
+			continue;
+		if(next == NULL || mapping_add(k, c[i])){
+			res[i] = -1;
+			continue;
+		}
+		if(hk_table_put(next, hk_pack(c[i]->internal.keycode, 
+				c[i]->internal.mod_mask), (void *) c[i])){
+			mapping_rm(k, c[i]);
+			res[i] = -1;
+		}
+	}
+	if(next != NULL)
+		table_publish(k, &k->table, next);
+	pthread_mutex_unlock(k->mutex);
+
+	for(i=0; i<n; i++)
+		failed += res[i] != 0;
+	if(res != rc)
+		free(res);
+	return failed;
+}
+
+/* Unregisters a hotkey which has been registered by kact_reg_hk or added
+	to a profile by kact_profile_add. If it is the active binding of its
+	key, the key falls back to the binding of the active profile or to the
+	latest older registration, otherwise it is ungrabbed. The keycomb may
+	still be called by a worker, so a keycomb of kact_get_hk must not be
+	freed before kact_clear
+	Param: c = A valid pointer to a keycomb structure
+		k = A valid pointer to a keyact structure
+	Return: 0 on success, -1 if c is not registered or on failure */
+int kact_unreg_hk(struct keycomb *c, struct keyact *k){
+	struct keycomb *fallback = NULL;
+	struct hk_table *next;
+	uint64_t key;
+	if(c == NULL || k == NULL || k->mutex == NULL)
+		return -1;
+	key = hk_pack(c->internal.keycode, c->internal.mod_mask);
+
+	/* begin synchronisation with other writers */
+	pthread_mutex_lock(k->mutex);
+	if(c->profile != NULL){
+		if(hk_table_get(c->profile->binds, key) != (void *) c ||
+				hk_table_del(c->profile->binds, key)){
+			pthread_mutex_unlock(k->mutex);
+			return -1;
+		}
+		c->profile = NULL;
+		sym_rm(k, c);
+	} else if(mapping_rm(k, c)){
+		/* the registration before c takes over by its chain */
+		pthread_mutex_unlock(k->mutex);
+		return -1;
+	}
+
+	/* c might be shadowed, then the loop never sees it anyway */
+	if(hk_table_get(k->table, key) != (void *) c){
+		pthread_mutex_unlock(k->mutex);
+		return 0;
+	}
+	next = hk_table_copy(k->table, 0);
+	if(next == NULL){
+		pthread_mutex_unlock(k->mutex);
+		return -1;
+	}
+	fallback = k->profile != NULL ? 
+			(struct keycomb *) hk_table_get(k->profile->binds, key) : NULL;
+	if(fallback == NULL)
+		fallback = (struct keycomb *) hk_table_get(k->globals, key);
+	if(fallback != NULL)
+		hk_table_put(next, key, (void *) fallback);
+	else {
+		hk_table_del(next, key);
+		if(!first_stroke(k, &c->internal))
+			k->be->grab(k, &c->internal, 1, 0, NULL);
+	}
+	table_publish(k, &k->table, next);
+	pthread_mutex_unlock(k->mutex);
+	return 0;
+}
+
+/* Adds a binding to a profile. The profile is created by its first
+	binding. A binding of the same hotkey which the profile already holds
+	is replaced. If the profile is active, the binding is grabbed and
+	published at once
+	Param: k = A valid pointer to a keyact structure
+		name = The name of the profile
+		c = A valid pointer to a keycomb structure which is neither
+			registered by kact_reg_hk nor part of another profile
+	Return: 0 on success, -1 on failure. A binding of the active profile
+		which could not be grabbed stays in the profile nonetheless */
+int kact_profile_add(struct keyact *k, const char *name, struct keycomb *c){
+	struct kact_profile *p;
+	struct keycomb *old;
+	struct hk_table *next;
+	uint64_t key;
+	int rc = 0;
+	if(k == NULL || name == NULL || c == NULL || c->profile != NULL)
+		return -1;
+	key = hk_pack(c->internal.keycode, c->internal.mod_mask);
+
+	/* begin synchronisation with other writers */
+	pthread_mutex_lock(k->mutex);
+	p = profile_find(k, name);
+	if(p == NULL){
+		p = (struct kact_profile *) arena_alloc(k->arena, 
+				sizeof(struct kact_profile));
+		if(p == NULL || (p->binds = hk_table_init(0)) == NULL){
+			pthread_mutex_unlock(k->mutex);
+			return -1;
+		}
+		p->name = arena_strdup(k->arena, name);
+		if(p->name == NULL || slist_prepend(k->profiles, (void *) p)){
+			hk_table_free(p->binds);
+			pthread_mutex_unlock(k->mutex);
+			return -1;
+		}
+	}
+	old = (struct keycomb *) hk_table_get(p->binds, key);
+	if(sym_add(k, c)){
+		pthread_mutex_unlock(k->mutex);
+		return -1;
+	}
+	if(hk_table_put(p->binds, key, (void *) c)){
+		sym_rm(k, c);
+		pthread_mutex_unlock(k->mutex);
+		return -1;
+	}
+	if(old != NULL){
+		old->profile = NULL;
+		sym_rm(k, old);
+	}
+	c->profile = p;
+	c->stats = &k->stats;
+
+	if(p == k->profile){
+		next = hk_table_copy(k->table, 1);
+		if(next == NULL){
+			pthread_mutex_unlock(k->mutex);
+			return -1;
+		}
+		if(hk_table_get(next, key) == NULL && !first_stroke(k, &c->internal))
+			k->be->grab(k, &c->internal, 1, 1, &rc);
+		if(rc == 0 && hk_table_put(next, key, (void *) c))
+			rc = -1;
+		table_publish(k, &k->table, next);
+	}
+	pthread_mutex_unlock(k->mutex);
+	return rc;
+}
+
+/* Activates a profile. Only the differences to the active profile are
+	sent to the backend: keys which are bound by the new profile only are
+	grabbed, keys which are bound by the old profile only are ungrabbed
+	unless a global hotkey takes over, keys bound by both just change
+	their keycomb. All of this happens in one batch and the resulting
+	table is published at once
+	Param: k = A valid pointer to a keyact structure
+		name = The name of the profile or NULL for none
+	Return: The number of bindings which could not be grabbed or -1 if the
+		profile is unknown or on failure */
+int kact_switch_profile(struct keyact *k, const char *name){
+	struct kact_profile *from, *to = NULL;
+	struct hotkey *drop, *keys;
+	struct keycomb **add, *c, *g;
+	struct hk_table *next;
+	size_t i, n, ndrop = 0, nadd = 0;
+	int *rc, failed = 0;
+	uint64_t key;
+	if(k == NULL || k->mutex == NULL)
+		return -1;
+
+	/* begin synchronisation with other writers */
+	pthread_mutex_lock(k->mutex);
+	if(name != NULL && (to = profile_find(k, name)) == NULL){
+		pthread_mutex_unlock(k->mutex);
+		return -1;
+	}
+	from = k->profile;
+	if(from == to){
+		pthread_mutex_unlock(k->mutex);
+		return 0;
+	}
+	n = (from != NULL ? from->binds->len : 0) + 
+			(to != NULL ? to->binds->len : 0) + 1;
+	drop = (struct hotkey *) malloc(sizeof(struct hotkey) * n);
+	keys = (struct hotkey *) malloc(sizeof(struct hotkey) * n);
+	add = (struct keycomb **) malloc(sizeof(struct keycomb *) * n);
+	rc = (int *) malloc(sizeof(int) * n);
+	next = hk_table_copy(k->table, n);
+	if(drop == NULL || keys == NULL || add == NULL || rc == NULL || 
+			next == NULL){
+		free(drop);
+		free(keys);
+		free(add);
+		free(rc);
+		hk_table_free(next);
+		pthread_mutex_unlock(k->mutex);
+		return -1;
+	}
+
+	/* bindings of the old profile which the new one doesn't replace */
+	for(i=0; from != NULL && i < from->binds->cap; i++){
+		c = (struct keycomb *) from->binds->slots[i].val;
+		key = from->binds->slots[i].key;
+		if(c == NULL || hk_table_get(next, key) != (void *) c)
+			continue;
+		if(to != NULL && hk_table_get(to->binds, key) != NULL)
+			continue;
+		g = (struct keycomb *) hk_table_get(k->globals, key);
+		if(g != NULL){
+			hk_table_put(next, key, (void *) g);
+			continue;
+		}
+		hk_table_del(next, key);
+		if(!first_stroke(k, &c->internal))
+			drop[ndrop++] = c->internal;
+	}
+	/* keys which are still grabbed just change their keycomb */
+	for(i=0; to != NULL && i < to->binds->cap; i++){
+		c = (struct keycomb *) to->binds->slots[i].val;
+		key = to->binds->slots[i].key;
+		if(c == NULL)
+			continue;
+		if(hk_table_get(next, key) != NULL || first_stroke(k, &c->internal)){
+			failed += hk_table_put(next, key, (void *) c) != 0;
+			continue;
+		}
+		rc[nadd] = 0;
+		keys[nadd] = c->internal;
+		add[nadd++] = c;
+	}
+
+	if(ndrop > 0)
+		k->be->grab(k, drop, ndrop, 0, NULL);
+	if(nadd > 0)
+		k->be->grab(k, keys, nadd, 1, rc);
+	for(i=0; i<nadd; i++)
+		if(rc[i] || hk_table_put(next, hk_pack(add[i]->internal.keycode,
+				add[i]->internal.mod_mask), (void *) add[i]))
+			failed++;
+	table_publish(k, &k->table, next);
+	k->profile = to;
+	pthread_mutex_unlock(k->mutex);
+
+	free(drop);
+	free(keys);
+	free(add);
+	free(rc);
+	return failed;
+}
+
+/* Looks a profile up by its name. Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		name = The name of the profile
+	Return: The profile or NULL if there is none of that name */
+static struct kact_profile *profile_find(struct keyact *k, const char *name){
+	struct snode *node;
+	for(node = k->profiles->start; node != NULL; node = node->next)
+		if(!strcmp(((struct kact_profile *) node->content)->name, name))
+			return (struct kact_profile *) node->content;
+	return NULL;
+}
+
+/* Adds a keycomb to the mapping and makes it the latest registration of
+	its hotkey. Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		c = A valid pointer to a keycomb structure which isn't registered
+	Return: 0 on success, -1 if c is registered already or on failure */
+static int mapping_add(struct keyact *k, struct keycomb *c){
+	if(mapping_has(k, c) || sym_add(k, c))
+		return -1;
+	if(kvec_add(k->mapping, (void *) c)){
+		sym_rm(k, c);
+		return -1;
+	}
+	c->slot = k->mapping->len - 1;
+	c->order = ++k->regs;
+	if(chain_link(k, c)){
+		kvec_rm_at(k->mapping, c->slot);
+		sym_rm(k, c);
+		return -1;
+	}
+	return 0;
+}
+
+/* Param: k = A valid pointer to a keyact structure
+		c = A valid pointer to a keycomb structure
+	Return: 1 if c is registered by kact_reg_hk, 0 otherwise */
+static int mapping_has(struct keyact *k, struct keycomb *c){
+	return c->slot < k->mapping->len && k->mapping->items[c->slot] == c;
+}
+
+/* Removes a keycomb from the mapping and from the chain of its hotkey.
+	Both take constant time, the last keycomb of the mapping moves into
+	the slot of c. Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		c = A valid pointer to a keycomb structure
+	Return: 0 on success, -1 if c isn't registered */
+static int mapping_rm(struct keyact *k, struct keycomb *c){
+	if(!mapping_has(k, c))
+		return -1;
+	chain_unlink(k, c);
+	sym_rm(k, c);
+	kvec_rm_at(k->mapping, c->slot);
+	if(c->slot < k->mapping->len)
+		((struct keycomb *) k->mapping->items[c->slot])->slot = c->slot;
+	return 0;
+}
+
+/* Inserts a registered keycomb into the chain of its hotkey, which
+	starts in globals with the latest registration. A keycomb whose
+	hotkey has moved by remap is placed by the order of its registration.
+	Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		c = A valid pointer to a registered keycomb structure
+	Return: 0 on success, -1 on failure */
+static int chain_link(struct keyact *k, struct keycomb *c){
+	uint64_t key = hk_pack(c->internal.keycode, c->internal.mod_mask);
+	struct keycomb *prev = (struct keycomb *) hk_table_get(k->globals, key);
+
+	c->newer = NULL;
+	c->older = NULL;
+	/* a keysym which isn't on the keyboard has no chain */
+	if(c->internal.keycode == 0)
+		return 0;
+	if(prev == NULL || prev->order < c->order){
+		if(hk_table_put(k->globals, key, (void *) c))
+			return -1;
+		c->older = prev;
+		if(prev != NULL)
+			prev->newer = c;
+		return 0;
+	}
+	while(prev->older != NULL && prev->older->order > c->order)
+		prev = prev->older;
+	c->newer = prev;
+	c->older = prev->older;
+	if(c->older != NULL)
+		c->older->newer = c;
+	prev->older = c;
+	return 0;
+}
+
+/* Takes a keycomb out of the chain of its hotkey. The next older
+	registration becomes the latest one if c was. Has to be called with
+	k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		c = A valid pointer to a registered keycomb structure
+	Return: nothing */
+static void chain_unlink(struct keyact *k, struct keycomb *c){
+	uint64_t key = hk_pack(c->internal.keycode, c->internal.mod_mask);
+	if(c->internal.keycode == 0)
+		return;
+
+	if(c->newer != NULL)
+		c->newer->older = c->older;
+	else if(c->older != NULL)
+		hk_table_put(k->globals, key, (void *) c->older);
+	else
+		hk_table_del(k->globals, key);
+	if(c->older != NULL)
+		c->older->newer = c->newer;
+	c->newer = NULL;
+	c->older = NULL;
+}
+
+/* Adds a binding to the keysym index which remap uses. A new keysym is
+	resolved once, the modifier names of the binding are remembered.
+	Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		c = A valid pointer to a keycomb structure which becomes bound
+	Return: 0 on success, -1 on failure */
+static int sym_add(struct keyact *k, struct keycomb *c){
+	char *temp, *save, scratch[64];
+	size_t len = strlen(c->user_mod) + 1;
+	char *mod_copy = len <= sizeof(scratch) ? scratch : 
+			(char *) malloc(sizeof(char) * len);
+	struct kact_sym *s;
+	int rc = 0;
+
+	if(mod_copy == NULL)
+		return -1;
+	strcpy(mod_copy, c->user_mod);
+	for(temp = strtok_r(mod_copy, DELIM, &save); temp != NULL && !rc; 
+			temp = strtok_r(NULL, DELIM, &save))
+		rc = mod_add(k, temp);
+	if(mod_copy != scratch)
+		free(mod_copy);
+	if(rc)
+		return -1;
+
+	s = (struct kact_sym *) hk_table_get(k->syms, (uint64_t) c->key);
+	if(s == NULL){
+		s = (struct kact_sym *) malloc(sizeof(struct kact_sym));
+		if(s == NULL)
+			return -1;
+		if(resolve_key(k, (unsigned long) c->key, &s->keycode))
+			s->keycode = 0;
+		s->combs = kvec_init(0);
+		if(s->combs == NULL || hk_table_put(k->syms, (uint64_t) c->key, 
+				(void *) s)){
+			kvec_free(s->combs);
+			free(s);
+			return -1;
+		}
+	}
+	return kvec_add(s->combs, (void *) c);
+}
+
+/* Takes a binding out of the keysym index. A keysym without bindings is
+	forgotten. Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		c = A valid pointer to a keycomb structure which isn't bound
+			anymore
+	Return: nothing */
+static void sym_rm(struct keyact *k, struct keycomb *c){
+	struct kact_sym *s = (struct kact_sym *) hk_table_get(k->syms, 
+			(uint64_t) c->key);
+	if(s == NULL || kvec_rm_content(s->combs, (void *) c) || 
+			s->combs->len > 0)
+		return;
+	hk_table_del(k->syms, (uint64_t) c->key);
+	kvec_free(s->combs);
+	free(s);
+}
+
+/* Remembers a modifier name and its mask. There are only a few names,
+	so they are kept until kact_clear. Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		name = The name of a modifier, e.g. "ctrl"
+	Return: 0 on success, -1 on failure */
+static int mod_add(struct keyact *k, const char *name){
+	struct kact_mod *m;
+	size_t i;
+
+	KVEC_EACH(k->mods, i)
+		if(!strcmp(((struct kact_mod *) k->mods->items[i])->name, name))
+			return 0;
+	m = (struct kact_mod *) malloc(sizeof(struct kact_mod) + 
+			strlen(name) + 1);
+	if(m == NULL)
+		return -1;
+	strcpy(m->name, name);
+	if(resolve_mod(k, name, &m->mask))
+		m->mask = 0;
+	if(kvec_add(k->mods, (void *) m)){
+		free(m);
+		return -1;
+	}
+	return 0;
+}
+
+/* Resolves the remembered modifier names again. Has to be called with
+	k->mutex held
+	Param: k = A valid pointer to a keyact structure
+	Return: 1 if the mask of any of them has changed, 0 otherwise */
+static int remap_mods(struct keyact *k){
+	struct kact_mod *m;
+	unsigned int mask;
+	int res = 0;
+	size_t i;
+
+	KVEC_EACH(k->mods, i){
+		m = (struct kact_mod *) k->mods->items[i];
+		if(resolve_mod(k, m->name, &mask))
+			mask = 0;
+		res |= mask != m->mask;
+		m->mask = mask;
+	}
+	return res;
+}
+
+/* Frees the bindings of a profile, the profile itself lives in the arena
+	Param: p = A valid pointer to a kact_profile structure
+		ctx = unused
+	Return: 0 */
+static int profile_free(void *p, void *ctx){
+	hk_table_free(((struct kact_profile *) p)->binds);
+	return 0;
+}
+
+/* Tells whether a hotkey is the first stroke of a sequence. Those stay
+	grabbed as long as the sequence is registered. Has to be called with 
+	k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		h = The hotkey
+	Return: 1 if it is a first stroke, else 0 */
+static int first_stroke(struct keyact *k, const struct hotkey *h){
+	return hk_table_get(k->seqs, seq_key(NULL, h)) != NULL;
+}
+
+/* Registers a sequence of keystrokes, e.g. "ctrl+x ctrl+s". All
+	sequences of k are compiled into one transition table. Only the first
+	strokes are grabbed permanently. The following strokes are grabbed
+	while their prefix is active
+	Param: k = A valid pointer to a keyact structure
+		seq = The strokes separated by spaces. A stroke consists of
+			modifiers and a key joined by '+'. The key is a single 
+			character or the name of a keysym, e.g. "ctrl+x", "F5"
+		func = A valid function pointer which is called with mp if the
+			whole sequence has been typed
+		mp = An arbitrary pointer
+		timeout = Milliseconds to wait for the next stroke after a 
+			prefix. 0 means SEQ_TIMEOUT. A prefix shared by several
+			sequences keeps the timeout of the first one
+	Return: The keycomb of the sequence, it lives in the arena of k, or
+		NULL if the sequence is invalid or conflicts with a registered
+		one */
+struct keycomb *kact_reg_seq(struct keyact *k, const char *seq, 
+		int (*func)(void *mp), void *mp, unsigned int timeout){
+	struct hotkey strokes[SEQ_LEN];
+	struct keycomb *res;
+	struct hk_table *next;
+	int i, n, grab;
+	if(k == NULL || seq == NULL || func == NULL)
+		return NULL;
+	n = parse_seq(k, seq, strokes);
+	if(n <= 0)
+		return NULL;
+
+	res = (struct keycomb *) 
+				arena_alloc(k->arena, sizeof(struct keycomb) + strlen(seq) + 1);
+	if(res == NULL)
+		return NULL;
+	res->func = func;
+	res->user_mod = strcpy((char *) (res + 1), seq);
+	res->key = 0;
+	res->internal = strokes[n - 1];
+	res->mod_param = mp;
+	kact_set_repeat(res, REPEAT_ALL, 0, NULL);
+	res->profile = NULL;
+	res->slot = 0;
+	res->order = 0;
+	res->newer = NULL;
+	res->older = NULL;
+	res->stats = &k->stats;
+	res->calls = 0;
+	res->call_sum = 0;
+	res->call_max = 0;
+
+	/* begin synchronisation with other writers */
+	pthread_mutex_lock(k->mutex);
+	next = hk_table_copy(k->seqs, n);
+	if(next == NULL){
+		pthread_mutex_unlock(k->mutex);
+		return NULL;
+	}
+	grab = seq_insert(k, next, strokes, n, res, timeout, NULL);
+	if(grab < 0){
+		hk_table_free(next);
+		pthread_mutex_unlock(k->mutex);
+		return NULL;
+	}
+	table_publish(k, &k->seqs, next);
+	pthread_mutex_unlock(k->mutex);
+
+	if(grab){
+		i = 0;
+		k->be->grab(k, strokes, 1, 1, &i);
+	}
+	return res;
+}
+
+/* Inserts the strokes of a sequence into a transition table which has
+	not been published yet. Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		next = The unpublished transition table
+		strokes = The strokes of the sequence
+		n = The number of strokes, at least 1
+		res = The keycomb of the sequence
+		timeout = see kact_reg_seq
+		scratch = NULL for states in the arena, otherwise the array
+			which collects the malloced states, see seq_node
+	Return: 1 if the first stroke has to be grabbed, 0 if it is grabbed
+		already or -1 if the sequence conflicts with another one or on
+		failure */
+static int seq_insert(struct keyact *k, struct hk_table *next,
+		const struct hotkey *strokes, int n, struct keycomb *res,
+		unsigned int timeout, struct kvec *scratch){
+	struct seq_state *cur = NULL, *node, *copy;
+	uint64_t key, prev = 0;
+	int i, grab = 0, fresh = 0;
+
+	for(i=0; i<n; i++){
+		key = seq_key(cur, &strokes[i]);
+		node = (struct seq_state *) hk_table_get(next, key);
+		/* a sequence must neither be a prefix of another nor extend one */
+		if(node != NULL && (node->comb != NULL || i == n - 1))
+			return -1;
+		if(node != NULL)
+			fresh = 0;
+		else {
+			/* a new state only ever leaves by the next stroke of this
+			 	sequence, so it is built with it */
+			node = seq_node(k, i < n - 1, scratch);
+			if(node == NULL || hk_table_put(next, key, node))
+				return -1;
+			node->timeout = timeout > 0 ? timeout : SEQ_TIMEOUT;
+			if(i < n - 1)
+				node->next[node->nnext++] = strokes[i + 1];
+			grab |= i == 0;
+			/* an old state is shared with the published table, so the
+			 	state learns about its new stroke in a copy. A state of
+			 	this call knows it already */
+			if(cur != NULL && !fresh){
+				copy = seq_node(k, cur->nnext + 1, scratch);
+				if(copy == NULL)
+					return -1;
+				memcpy(copy, cur, sizeof(struct seq_state) + 
+						sizeof(struct hotkey) * cur->nnext);
+				copy->next[copy->nnext++] = strokes[i];
+				hk_table_put(next, prev, copy);
+			}
+			fresh = 1;
+		}
+		if(i == n - 1)
+			node->comb = res;
+		cur = node;
+		prev = key;
+	}
+	return grab;
+}
+
+/* Splits a sequence into its strokes and resolves them
+	Param: k = A valid pointer to a keyact structure
+		seq = A sequence as described for kact_reg_seq
+		strokes = An array of at least SEQ_LEN hotkeys
+	Return: The number of strokes or -1 if the sequence is invalid */
+static int parse_seq(struct keyact *k, const char *seq, 
+		struct hotkey *strokes){
+	char copy[256], *stroke, *part, *key, *s1, *s2;
+	unsigned int mask;
+	unsigned long sym;
+	int n = 0;
+
+	if(strlen(seq) >= sizeof(copy))
+		return -1;
+	strcpy(copy, seq);
+	for(stroke = strtok_r(copy, " ", &s1); stroke != NULL; 
+			stroke = strtok_r(NULL, " ", &s1)){
+		if(n == SEQ_LEN)
+			return -1;
+		strokes[n].mod_mask = 0;
+		key = NULL;
+		for(part = strtok_r(stroke, "+", &s2); part != NULL; 
+				part = strtok_r(NULL, "+", &s2)){
+			/* every part but the last one is a modifier */
+			if(key != NULL){
+				if(resolve_mod(k, key, &mask))
+					return -1;
+				strokes[n].mod_mask |= mask;
+			}
+			key = part;
+		}
+		if(key == NULL)
+			return -1;
+		sym = strlen(key) == 1 ? (unsigned char) key[0] : 
+				XStringToKeysym(key);
+		if(sym == NoSymbol || resolve_key(k, sym, &strokes[n].keycode))
+			return -1;
+		n++;
+	}
+	return n;
+}
+
+/* Allocates a new state of the sequence automaton in the arena of k.
+	A scratch state is malloced instead and only lives until the
+	automaton it belongs to has been committed, see seq_rebuild. Has to
+	be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		nnext = The number of strokes leaving the state
+		scratch = NULL or the array which collects the scratch states
+	Return: A zeroed state with a new id or NULL on failure */
+static struct seq_state *seq_node(struct keyact *k, size_t nnext,
+		struct kvec *scratch){
+	size_t size = sizeof(struct seq_state) + sizeof(struct hotkey) * nnext;
+	struct seq_state *res;
+
+	if(scratch == NULL)
+		res = (struct seq_state *) arena_alloc(k->arena, size);
+	else {
+		res = (struct seq_state *) malloc(size);
+		if(res != NULL && kvec_add(scratch, (void *) res)){
+			free(res);
+			res = NULL;
+		}
+	}
+	if(res == NULL)
+		return NULL;
+	memset(res, 0, sizeof(struct seq_state));
+	/* the ids of scratch states only have to differ from each other */
+	res->id = scratch != NULL ? (unsigned int) scratch->len : ++k->seq_ids;
+	return res;
+}
+
+/* Compiles every sequence of k again after the keyboard mapping has
+	changed. The automaton is built from the strings in scratch memory
+	first. Then it is committed into a new transition table: a state of
+	the published automaton which is reached by the same strokes and
+	left by the same ones is used again, only the others are copied into
+	the arena. So the arena grows by the states of the moved sequences
+	alone. A sequence which conflicts with another one now is dropped.
+	Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+	Return: The unpublished transition table or NULL on failure */
+static struct hk_table *seq_rebuild(struct keyact *k){
+	struct hotkey strokes[SEQ_LEN], h;
+	struct hk_table *scratch, *res = NULL;
+	struct seq_state *state;
+	struct keycomb *c;
+	struct kvec *nodes;
+	size_t i;
+	int m, rc = 0;
+
+	scratch = hk_table_init(k->seqs->len);
+	nodes = kvec_init(k->seqs->len);
+	if(scratch == NULL || nodes == NULL)
+		goto out;
+	for(i=0; i<k->seqs->cap; i++){
+		state = (struct seq_state *) k->seqs->slots[i].val;
+		if(state == NULL || state->comb == NULL)
+			continue;
+		c = state->comb;
+		m = parse_seq(k, c->user_mod, strokes);
+		if(m <= 0 || seq_insert(k, scratch, strokes, m, c, 
+				state->timeout, nodes) < 0){
+			c->internal.keycode = 0;
+			c->internal.mod_mask = 0;
+			continue;
+		}
+		c->internal = strokes[m - 1];
+	}
+
+	res = hk_table_init(scratch->len);
+	if(res == NULL)
+		goto out;
+	/* every state is reached from one of the first strokes */
+	for(i=0; i<scratch->cap; i++){
+		if(scratch->slots[i].val == NULL || scratch->slots[i].key >> 48 != 0)
+			continue;
+		h.keycode = (unsigned int) scratch->slots[i].key;
+		h.mod_mask = (unsigned int) (scratch->slots[i].key >> 32);
+		rc |= seq_commit(k, scratch, 
+				(struct seq_state *) scratch->slots[i].val, 
+				(struct seq_state *) hk_table_get(k->seqs, 
+				scratch->slots[i].key), NULL, &h, res);
+	}
+	if(rc){
+		hk_table_free(res);
+		res = NULL;
+	}
+out:
+	if(nodes != NULL)
+		KVEC_EACH(nodes, i)
+			free(nodes->items[i]);
+	kvec_free(nodes);
+	hk_table_free(scratch);
+	return res;
+}
+
+/* Moves a scratch state and every state behind it into a transition
+	table. Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		scratch = The scratch transition table
+		s = The scratch state
+		old = The published state reached by the same strokes or NULL
+		from = The committed state s is reached from, NULL for the start
+		h = The stroke leading from from to s
+		next = The unpublished transition table
+	Return: 0 on success, -1 on failure */
+static int seq_commit(struct keyact *k, const struct hk_table *scratch,
+		const struct seq_state *s, struct seq_state *old,
+		const struct seq_state *from, const struct hotkey *h,
+		struct hk_table *next){
+	struct seq_state *res = old, *child;
+	size_t i;
+
+	if(old == NULL || !seq_same(old, s)){
+		res = seq_node(k, s->nnext, NULL);
+		if(res == NULL)
+			return -1;
+		res->timeout = s->timeout;
+		res->comb = s->comb;
+		res->nnext = s->nnext;
+		memcpy(res->next, s->next, sizeof(struct hotkey) * s->nnext);
+	}
+	if(hk_table_put(next, seq_key(from, h), (void *) res))
+		return -1;
+	for(i=0; i<s->nnext; i++){
+		child = old != NULL ? (struct seq_state *) hk_table_get(k->seqs, 
+				seq_key(old, &s->next[i])) : NULL;
+		if(seq_commit(k, scratch, (struct seq_state *) hk_table_get(
+				scratch, seq_key(s, &s->next[i])), child, res, 
+				&s->next[i], next))
+			return -1;
+	}
+	return 0;
+}
+
+/* Compares two states of the sequence automaton, apart from their ids
+	Param: a, b = Valid pointers to states
+	Return: 1 if both end the same sequence with the same timeout and are
+		left by the same strokes, 0 otherwise */
+static int seq_same(const struct seq_state *a, const struct seq_state *b){
+	size_t i, j;
+
+	if(a->comb != b->comb || a->timeout != b->timeout || 
+			a->nnext != b->nnext)
+		return 0;
+	/* the strokes are in the order of their registration, which differs
+	 	between a rebuilt state and the published one */
+	for(i=0; i<a->nnext; i++){
+		for(j=0; j<b->nnext; j++)
+			if(a->next[i].keycode == b->next[j].keycode &&
+					a->next[i].mod_mask == b->next[j].mod_mask)
+				break;
+		if(j == b->nnext)
+			return 0;
+	}
+	return 1;
+}
+
+/* Follows strokes through the sequence automaton
+	Param: seqs = A transition table
+		strokes = The strokes
+		n = The number of strokes
+	Return: The state reached by the strokes or NULL if there is none */
+static struct seq_state *seq_walk(const struct hk_table *seqs,
+		const struct hotkey *strokes, int n){
+	struct seq_state *cur = NULL;
+	int i;
+	for(i=0; i<n; i++){
+		cur = (struct seq_state *) hk_table_get(seqs, seq_key(cur, 
+				&strokes[i]));
+		if(cur == NULL)
+			return NULL;
+	}
+	return cur;
+}
+
+/* Builds the key of a transition of the sequence automaton. The id of
+	the state is put above the packed hotkey
+	Param: from = The current state or NULL for the start state
+		h = The stroke
+	Return: The key of the transition */
+static uint64_t seq_key(const struct seq_state *from, const struct hotkey *h){
+	uint64_t id = from != NULL ? from->id : 0;
+	return id << 48 | hk_pack(h->keycode, h->mod_mask);
+}
+
+/* Moves the sequence automaton of k into the state to. The strokes of 
+	the old state are ungrabbed and the strokes of to are grabbed. Only
+	called by the event loop
+	Param: k = A valid pointer to a keyact structure
+		to = The new state or NULL to return to the start state
+		table = The acquired hotkey table
+		seqs = The acquired sequence table
+	Return: nothing */
+static void seq_move(struct keyact *k, struct seq_state *to, 
+		struct hk_table *table, struct hk_table *seqs){
+	struct seq_state *from = k->seq_cur;
+	struct hotkey *h;
+	size_t i;
+
+	/* strokes which are hotkeys or first strokes stay grabbed */
+	for(i=0; from != NULL && i < from->nnext; i++){
+		h = &from->next[i];
+		if(hk_table_get(table, hk_pack(h->keycode, h->mod_mask)) ||
+				hk_table_get(seqs, seq_key(NULL, h)))
+			continue;
+		k->be->grab(k, h, 1, 0, NULL);
+	}
+	for(i=0; to != NULL && i < to->nnext; i++){
+		h = &to->next[i];
+		if(hk_table_get(table, hk_pack(h->keycode, h->mod_mask)) ||
+				hk_table_get(seqs, seq_key(NULL, h)))
+			continue;
+		k->be->grab(k, h, 1, 1, NULL);
+	}
+
+	k->seq_cur = to;
+	if(to != NULL)
+		k->seq_deadline = now_ms() + to->timeout;
+}
+
+/* Returns a monotonic timestamp
+	Param: void
+	Return: Milliseconds since an arbitrary point in time */
+static long now_ms(void){
+	return now_us() / 1000L;
+}
 
+/* Returns a monotonic timestamp
+	Param: void
+	Return: Microseconds since an arbitrary point in time */
+static long now_us(void){
+	return now_ns() / 1000L;
+}
+
+/* Returns a monotonic timestamp
+	Param: void
+	Return: Nanoseconds since an arbitrary point in time */
+static long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Adds to a counter which is read concurrently by kact_stats
+	Param: c = A valid pointer to the counter
+		n = The value to add
+	Return: nothing */
+static void stat_add(unsigned long *c, unsigned long n){
+	__atomic_fetch_add(c, n, __ATOMIC_RELAXED);
+}
+
+/* Records a duration in a histogram. Safe to be called by the event loop
+	and the workers at the same time
+	Param: h = A valid pointer to a kact_hist structure
+		us = The duration in microseconds. Negative values count as 0
+	Return: nothing */
+static void hist_add(struct kact_hist *h, long us){
+	unsigned long v = us > 0 ? (unsigned long) us : 0, max;
+	int i = 0;
+
+	while(i < HIST_LEN - 1 && (v + 1) >> (i + 1) != 0)
+		i++;
+	stat_add(&h->buckets[i], 1);
+	stat_add(&h->count, 1);
+	stat_add(&h->sum, v);
+	max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	while(v > max && !__atomic_compare_exchange_n(&h->max, &max, v, 1, 
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/* Maps the x-server time of an event to the clock of now_us. The offset
+	between both clocks is assumed to be the smallest one seen so far,
+	so the latency of the fastest event is taken as zero. Only called by
+	the event loop
+	Param: k = A valid pointer to a keyact structure
+		time = The time of the event in milliseconds
+		now = The current time of now_us
+	Return: The time of the event in microseconds of now_us */
+static long event_stamp(struct keyact *k, unsigned long time, long now){
+	long offset = now - (long) time * 1000L;
+
+	/* the first event or the clock of the x-server has wrapped around */
+	if(k->time_offset == 0 || offset < k->time_offset || 
+			offset - k->time_offset > 3600000000L)
+		k->time_offset = offset;
+	return (long) time * 1000L + k->time_offset;
+}
+
+/* Copies the counters of k. Every counter is read atomically, but the
+	snapshot as a whole is not, so the loop and the workers are never
+	blocked
+	Param: k = A valid pointer to a keyact structure
+		st = A valid pointer where the counters are stored
+	Return: 0 on success, -1 on failure */
+int kact_stats(struct keyact *k, struct kact_stats *st){
+	unsigned long *src, *dst;
+	size_t i;
+	if(k == NULL || st == NULL)
+		return -1;
+
+	src = (unsigned long *) &k->stats;
+	dst = (unsigned long *) st;
+	for(i=0; i<sizeof(struct kact_stats) / sizeof(unsigned long); i++)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Reports the duration of the function of a hotkey. Only count, sum and
+	max of h are filled in, the buckets are zeroed
+	Param: c = A valid pointer to a keycomb structure
+		h = A valid pointer where the durations are stored
+	Return: 0 on success, -1 on failure */
+int kact_hk_stats(struct keycomb *c, struct kact_hist *h){
+	if(c == NULL || h == NULL)
+		return -1;
+	memset(h, 0, sizeof(struct kact_hist));
+	h->count = __atomic_load_n(&c->calls, __ATOMIC_RELAXED);
+	h->sum = __atomic_load_n(&c->call_sum, __ATOMIC_RELAXED);
+	h->max = __atomic_load_n(&c->call_max, __ATOMIC_RELAXED);
 	return 0;
 }
 
+/* Replaces a table of k by next. The old table is retired and freed as
+	soon as no reader is inside of a critical section. Has to be called
+	with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		slot = The member of k which holds the table, e.g. &k->table
+		next = The new table. It must not be modified after this call
+	Return: nothing */
+static void table_publish(struct keyact *k, struct hk_table **slot,
+		struct hk_table *next){
+	struct hk_table *old = *slot;
+
+	__atomic_store_n(slot, next, __ATOMIC_SEQ_CST);
+	if(slist_prepend(k->retired, (void *) old)){
+		/* no memory left to defer the free, so wait for the readers */
+		while(__atomic_load_n(&k->readers, __ATOMIC_SEQ_CST) != 0)
+			sched_yield();
+		hk_table_free(old);
+	}
+	table_reclaim(k);
+}
+
+/* Frees all retired tables if there is currently no reader. A reader
+	which enters afterwards can only see the published table, so none of
+	the retired ones is reachable anymore. Has to be called with k->mutex
+	held
+	Param: k = A valid pointer to a keyact structure
+	Return: nothing */
+static void table_reclaim(struct keyact *k){
+	if(__atomic_load_n(&k->readers, __ATOMIC_SEQ_CST) != 0)
+		return;
+	while(k->retired->len > 0){
+		hk_table_free((struct hk_table *) k->retired->start->content);
+		slist_rm_at(k->retired, 0);
+	}
+}
+
+/* Enters a read side critical section and returns the current hotkey
+	table. The table stays valid until table_release is called. This
+	never blocks
+	Param: k = A valid pointer to a keyact structure
+	Return: The currently published table */
+static struct hk_table *table_acquire(struct keyact *k){
+	__atomic_add_fetch(&k->readers, 1, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&k->table, __ATOMIC_SEQ_CST);
+}
+
+/* Leaves a read side critical section which has been entered by 
+	table_acquire
+	Param: k = A valid pointer to a keyact structure
+	Return: nothing */
+static void table_release(struct keyact *k){
+	__atomic_sub_fetch(&k->readers, 1, __ATOMIC_RELEASE);
+}
+
 /* Returns an object of type struct keycomb. This object is later
  	used in the main event loop to identify an key combination.
  	Because the representation of key combination differs on the
@@ -74,108 +1259,255 @@ int kact_reg_hk(struct keycomb *c, struct keyact *k){
  	Param: func = A valid Functionpointer which should be associated
  		with the given hotkey
  		mod = A comma or space separated list of modifier substrings.
- 			e.g. "strg,alt,shift". Valid substrings are the following
- 				- "strg"
- 				- "alt"
- 				- "shift"
- 		key = A character 
+ 			e.g. "ctrl,alt,shift". Valid substrings are the following
+ 				- "shift", "lock", "ctrl"
+ 				- "mod1" to "mod5"
+ 				- "alt", "super" (the modifier the key is bound to)
+ 		key = A character or any other X11 keysym 
  		mp = An arbitrary pointer. This pointer will be passed to the 
 		function func if it is called
 	Return: A new object of type struct keycomb or NULL if an error
 		occured */
 struct keycomb *kact_get_hk(int (*func)(void *mp), const char *mod, int key, void *mp){
-	if(func == NULL)
+	return make_hk(NULL, func, mod, key, mp);
+}
+
+/* Like kact_get_hk, but the keycomb and its modifier string are placed
+	into the arena of k. They must not be freed by the caller, kact_clear
+	frees them together with all other resources of k. The hotkey is
+	resolved by the backend of k
+	Param: k = A valid pointer to a keyact structure
+		for the other parameters see kact_get_hk
+	Return: A new object of type struct keycomb or NULL if an error
+		occured */
+struct keycomb *kact_new_hk(struct keyact *k, int (*func)(void *mp), 
+		const char *mod, int key, void *mp){
+	if(k == NULL)
 		return NULL;
-	struct keycomb *res = (struct keycomb *) malloc(sizeof(struct keycomb));
+	return make_hk(k, func, mod, key, mp);
+}
+
+/* Resolves a hotkey and builds its keycomb object. The hotkey is resolved
+	before anything is allocated, so nothing has to be given back to the
+	arena on failure
+	Param: k = The keyact structure whose arena and backend are used or
+			NULL if the keycomb should be allocated by malloc and resolved by
+			the process wide mapping cache of $DISPLAY
+		for the other parameters see kact_get_hk
+	Return: A new object of type struct keycomb or NULL if an error
+		occured */
+static struct keycomb *make_hk(struct keyact *k, int (*func)(void *mp), 
+		const char *mod, int key, void *mp){
+	struct keycomb *res, probe;
+	struct hotkey temp = { 0, 0 };
+	size_t len;
+	if(func == NULL || mod == NULL)
+		return NULL;
+
+	/* Populate the hotkey structure. A cached hotkey needs no parsing */
+	probe.user_mod = (char *) mod;
+	probe.key = key;
+	if((k == NULL || kcache_lookup(k, mod, key, &temp)) && 
+			transform(k, &temp, &probe))
+		return NULL;
+
+	/* the modifier string directly follows its keycomb */
+	len = strlen(mod) + 1;
+	if(k != NULL)
+		res = (struct keycomb *) 
+					arena_alloc(k->arena, sizeof(struct keycomb) + len);
+	else
+		res = (struct keycomb *) malloc(sizeof(struct keycomb) + len);
 	if(res == NULL)
 		return NULL;
 	res->func = func;
-	res->user_mod = (char *) malloc(sizeof(char) * (strlen(mod) + 1));
-	strcpy(res->user_mod, mod);	
+	res->user_mod = (char *) (res + 1);
+	memcpy(res->user_mod, mod, len);
 	res->key = key;
-	struct hotkey temp = { 0, 0 };
-	/*temp.keycode = 0;*/
-	/*temp.mod_mask = 0;*/
-	/* Populate the hotkey structure */
-	if(transform(&temp, res))
-		return NULL; //TODO free!
 	res->internal = temp;
 	res->mod_param = mp;
+	kact_set_repeat(res, REPEAT_ALL, 0, NULL);
+	res->profile = NULL;
+	res->slot = 0;
+	res->order = 0;
+	res->newer = NULL;
+	res->older = NULL;
+	res->stats = NULL;
+	res->calls = 0;
+	res->call_sum = 0;
+	res->call_max = 0;
 	return res;
 }
 
-/* populates a given hotkey union with the x11 member content using 
- 	the runtime values from k
- 	Param: h = A valid (local) pointer of a hotkey union instance
- 		k = A valid pointer of the current keycombination object 
- 	Return: 0 on success or -1 on failure */
-static int transform(struct hotkey *h, struct keycomb *k){
-	if(h == NULL || k == NULL)
-		return -1;
-	struct x11_mask mask[] = {
-		{"shift", 1<<0},
-		{"lock", 1<<1},
-		{"ctrl", 1<<2},
-		{"mod1", 1<<3},
-		{"mod2", 1<<4},
-		{"mod3", 1<<5},
-		{"mod4", 1<<6},
-		{"mod5", 1<<7}
-	};
-	int i;
-
-	Display *display = XOpenDisplay(XDisplayName(NULL));
-	
-	char *temp;
-	char *keystr = (char *) malloc(sizeof(char));
-	char *mod_copy = (char *) malloc(sizeof(char) * (strlen(k->user_mod) + 1));
+/* Adapter which lets a slist take its nodes from an arena
+	Param: a = A valid pointer to an arena structure
+		size = The number of bytes
+	Return: A pointer to the memory or NULL on failure */
+static void *arena_node(void *a, size_t size){
+	return arena_alloc((struct arena *) a, size);
+}
 
-	if(keystr == NULL || mod_copy == NULL)
+/* Queries the allocation statistics of the arena of k
+	Param: k = A valid pointer to a keyact structure
+		st = A valid pointer where the statistics are stored
+	Return: 0 on success, -1 on failure */
+int kact_arena_stats(struct keyact *k, struct arena_stats *st){
+	if(k == NULL)
 		return -1;
+	return arena_get_stats(k->arena, st);
+}
 
-	if(!display)
+/* Packs the keycode and the modifier mask of a hotkey into a single key
+	for the lookup table
+	Param: keycode = The platform specific keycode
+		mod_mask = The platform specific modifier mask
+	Return: The packed key */
+static uint64_t hk_pack(unsigned int keycode, unsigned int mod_mask){
+	return ((uint64_t) mod_mask << 32) | keycode;
+}
+
+/* populates a given hotkey union with the x11 member content. The
+	modifiers and the key are resolved by the backend of k or by the
+	process wide mapping cache, so no connection to the x-server has to
+	be opened
+ 	Param: k = A pointer to a keyact structure or NULL
+ 		h = A valid (local) pointer of a hotkey union instance
+ 		c = A valid pointer of the current keycombination object 
+ 	Return: 0 on success or -1 on failure */
+static int transform(struct keyact *k, struct hotkey *h, struct keycomb *c){
+	if(h == NULL || c == NULL)
+		return -1;
+	unsigned int mask;
+	char *temp, *save, scratch[64];
+	size_t len = strlen(c->user_mod) + 1;
+	/* strtok needs a writable copy. Usually the stack is big enough */
+	char *mod_copy = len <= sizeof(scratch) ? scratch : 
+			(char *) malloc(sizeof(char) * len);
+
+	if(mod_copy == NULL)
 		return -1;
 
-	strcpy(mod_copy, k->user_mod);
-	temp = strtok(mod_copy, DELIM);
+	strcpy(mod_copy, c->user_mod);
+	temp = strtok_r(mod_copy, DELIM, &save);
 	while(1){
 		if(temp == NULL)
 			break;
-		//iterate through mask[]. TODO remove magic number
-		for(i=0; i<sizeof(mask)/sizeof(struct x11_mask) ; i++){
-			if(!strcmp(mask[i].modstr, temp))
-				h->mod_mask |= mask[i].mask;
-		}
-		temp = strtok(NULL, DELIM);
+		if(!resolve_mod(k, temp, &mask))
+			h->mod_mask |= mask;
+		temp = strtok_r(NULL, DELIM, &save);
 	}
+	if(mod_copy != scratch)
+		free(mod_copy);
 	// no modifiers have been found
 	if(h->mod_mask == 0)
 		return -1;
 
-	sprintf(keystr, "%c", (char) k->key);
-	h->keycode = XKeysymToKeycode(display, XStringToKeysym(keystr));
-
-	free(keystr);
-	free(mod_copy);
-	XCloseDisplay(display);
+	/* Latin-1 characters are identical with their keysyms */
+	if(resolve_key(k, (unsigned long) c->key, &h->keycode))
+		return -1;
 	return 0;
 }
 
+/* Resolves a keysym by the backend of k
+	Param: k = A pointer to a keyact structure or NULL for the process
+			wide mapping cache
+		keysym = A X11 keysym
+		keycode = A valid pointer where the keycode is stored
+	Return: 0 on success, -1 on failure */
+static int resolve_key(struct keyact *k, unsigned long keysym, 
+		unsigned int *keycode){
+	if(k == NULL)
+		return kmap_keycode(NULL, keysym, keycode);
+	return k->be->keycode(k, keysym, keycode);
+}
+
+/* Resolves the name of a modifier by the backend of k
+	Param: k = A pointer to a keyact structure or NULL for the process
+			wide mapping cache
+		name = The name of the modifier, e.g. "ctrl"
+		mask = A valid pointer where the mask is stored
+	Return: 0 on success, -1 on failure */
+static int resolve_mod(struct keyact *k, const char *name, unsigned int *mask){
+	if(k == NULL)
+		return kmap_modifier(NULL, name, mask);
+	return k->be->modifier(k, name, mask);
+}
+
 /* Returns an initialized keyact object
 	Param: void
 	Return: Initialized instance of struct keyact. The mutex and the singly
 		linked list members are populated with valid objects. */
 struct keyact *kact_init(){
+	return kact_init_cfg(NULL);
+}
+
+/* Returns an initialized keyact object which is configured by cfg
+	Param: cfg = A pointer to a kact_config structure or NULL for the
+		default configuration
+	Return: Initialized instance of struct keyact or NULL on failure. If
+		workers have been requested, the member pool holds the worker
+		threads */
+struct keyact *kact_init_cfg(const struct kact_config *cfg){
 	struct keyact *res = (struct keyact *) malloc(sizeof(struct keyact));
 	if(res == NULL)
 		return NULL;
 	res->event_loop = NULL;
-	res->mapping = slist_init();
+	res->pool = NULL;
+	if(cfg != NULL && cfg->workers > 0){
+		res->pool = kpool_init(cfg->workers, 
+				cfg->queue_len > 0 ? cfg->queue_len : QUEUE_LEN);
+		if(res->pool == NULL)
+			return NULL;
+	}
+	res->arena = arena_init(ARENA_CHUNK);
+	if(res->arena == NULL)
+		return NULL;
+	res->cache = NULL;
+	res->rec = NULL;
+	res->dispatcher = NULL;
+	res->ring = NULL;
+	res->ring_policy = cfg != NULL ? cfg->ring_policy : KACT_RING_BLOCK;
+	res->ring_done = 0;
+	if(cfg != NULL && cfg->ring_len > 0){
+		res->ring = kring_init(cfg->ring_len);
+		if(res->ring == NULL)
+			return NULL;
+	}
+	/* kact_unreg_hk takes a keycomb out of the mapping by its slot */
+	res->mapping = kvec_init(0);
 	if(res->mapping == NULL)
 		return NULL;
+	res->regs = 0;
+	res->syms = hk_table_init(0);
+	res->mods = kvec_init(0);
+	if(res->syms == NULL || res->mods == NULL)
+		return NULL;
+	res->globals = hk_table_init(0);
+	if(res->globals == NULL)
+		return NULL;
+	res->profiles = slist_init_alloc(arena_node, NULL, res->arena);
+	if(res->profiles == NULL)
+		return NULL;
+	res->profile = NULL;
+	res->table = hk_table_init(0);
+	if(res->table == NULL)
+		return NULL;
+	res->seqs = hk_table_init(0);
+	if(res->seqs == NULL)
+		return NULL;
+	res->seq_ids = 0;
+	res->seq_cur = NULL;
+	res->seq_deadline = 0;
+	res->ready = 0;
+	res->loop = NULL;
+	res->retired = slist_init();
+	if(res->retired == NULL)
+		return NULL;
+	res->readers = 0;
 
-	res->display = XOpenDisplay(XDisplayName(NULL));
-	if(!res->display)
+	res->be = cfg != NULL && cfg->backend != NULL ? cfg->backend : &kact_x11;
+	res->be_data = NULL;
+	if(res->be->open(res, cfg))
 		return NULL;
 	res->mutex = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
 	if(res->mutex == NULL)
@@ -183,180 +1515,877 @@ struct keyact *kact_init(){
 	if(pthread_mutex_init(res->mutex, NULL))
 		return NULL;
 
+	/* the read end is polled by the event loop, both ends must never
+	 	block */
+	if(pipe(res->wakeup))
+		return NULL;
+	fcntl(res->wakeup[0], F_SETFL, O_NONBLOCK);
+	fcntl(res->wakeup[1], F_SETFL, O_NONBLOCK);
+	/* an embedding application polls both by the descriptor of kact_fd */
+	res->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(res->epfd < 0 || epoll_add(res->epfd, res->be->fd(res)) ||
+			epoll_add(res->epfd, res->wakeup[0]))
+		return NULL;
+
 	res->cancel = 0;
+	memset(&res->stats, 0, sizeof(struct kact_stats));
+	res->time_offset = 0;
 	return res;
 }
 
 /* Starts the main event loop. This is a convenience function, since it
- 	would be very easy for the user to start the loop */
+ 	would be very easy for the user to start the loop 
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success, -1 if the loop is already running, k belongs to
+		a shared loop or the thread could not be created */
 int kact_start(struct keyact *k){
+	char buf[16];
+	if(k == NULL || k->event_loop != NULL || k->loop != NULL)
+		return -1;
 	pthread_t *thread = (pthread_t *) malloc(sizeof(pthread_t));
-	pthread_create(thread, NULL, event_loop, (void *) k);
+	if(thread == NULL)
+		return -1;
+
+	/* forget about wakeups of a previous run */
+	while(read(k->wakeup[0], buf, sizeof(buf)) > 0)
+		;
+	k->cancel = 0;
+	k->ring_done = 0;
+	/* the dispatcher is already waiting when the first event arrives */
+	if(k->ring != NULL){
+		k->dispatcher = (pthread_t *) malloc(sizeof(pthread_t));
+		if(k->dispatcher == NULL || pthread_create(k->dispatcher, NULL, 
+				ring_loop, (void *) k)){
+			free(k->dispatcher);
+			k->dispatcher = NULL;
+			free(thread);
+			return -1;
+		}
+	}
+	if(pthread_create(thread, NULL, event_loop, (void *) k)){
+		free(thread);
+		if(k->dispatcher != NULL){
+			__atomic_store_n(&k->ring_done, 1, __ATOMIC_SEQ_CST);
+			kring_wake(k->ring);
+			pthread_join(*k->dispatcher, NULL);
+			free(k->dispatcher);
+			k->dispatcher = NULL;
+		}
+		return -1;
+	}
+	k->event_loop = thread;
+	return 0;
+}
+
+/* Stops the main event loop and waits for its thread to terminate
+  	 leaving everything else untouched. The backend stays open, so the
+	 loop can be restarted by kact_start. The events which the loop has
+	 put into the ring are still dispatched, so a restart begins with an
+	 empty ring
+ 	Param: k = A Valid pointer to an keyact structure containing the 
+ 		display pointer 
+ 	Return: 0 on success -1 if an invalid value has been given as arguemnt */
+int kact_stop(struct keyact *k){
+	if(k == NULL)
+		return -1;
+	if(k->event_loop == NULL)
+		return 0;
+
+	__atomic_store_n(&k->cancel, 1, __ATOMIC_SEQ_CST);
+	wakeup(k);
+	if(k->ring != NULL)
+		kring_wake(k->ring);
+	pthread_join(*k->event_loop, NULL);
+	free(k->event_loop);
+	k->event_loop = NULL;
+	if(k->dispatcher != NULL){
+		/* nothing is pushed anymore, the dispatcher may drain and exit */
+		__atomic_store_n(&k->ring_done, 1, __ATOMIC_SEQ_CST);
+		kring_wake(k->ring);
+		pthread_join(*k->dispatcher, NULL);
+		free(k->dispatcher);
+		k->dispatcher = NULL;
+	}
+	
+	return 0;
+}
+
+/* Wakes the event loop up if it is waiting for events. A byte is
+	written into the wakeup pipe which is polled by the loop together with
+	the connection to the x-server
+	Param: k = A valid pointer to an keyact structure
+	Return: nothing */
+static void wakeup(struct keyact *k){
+	if(k == NULL)
+		return;
+
+	/* a full pipe already wakes the loop up */
+	if(write(k->wakeup[1], "", 1) < 0)
+		return;
+}
+
+/* Stops the main even loop and frees all resources occupied by a 
+	keyact structure including it's member mapping 
+ 	Param: k = A valid Pointer to a keyact structure */
+int kact_clear(struct keyact *k){
+	size_t i;
+	int rc = 0;
+	if(k == NULL)
+		return -1;
+
+	rc += kact_stop(k);
+	if(k->loop != NULL)
+		rc += kact_loop_remove(k->loop, k);
+	kact_record_stop(k);
+
+	rc += k->be->close(k);
+	close(k->wakeup[0]);
+	close(k->wakeup[1]);
+	close(k->epfd);
+
+	/* let the workers finish the already queued calls */
+	if(k->pool != NULL)
+		rc += kpool_free(k->pool);
+
+	if(k->mutex != NULL)
+		rc += pthread_mutex_destroy(k->mutex);
+
+	/* the event loop is gone, so no reader is left */
+	table_reclaim(k);
+	rc += slist_free(k->retired);
+	rc += hk_table_free(k->table);
+	rc += hk_table_free(k->seqs);
+	rc += hk_table_free(k->globals);
+	rc += slist_foreach(k->profiles, profile_free, NULL);
+	rc += slist_free(k->profiles);
+	rc += kvec_free(k->mapping);
+	for(i=0; i<k->syms->cap; i++)
+		if(k->syms->slots[i].val != NULL){
+			kvec_free(((struct kact_sym *) k->syms->slots[i].val)->combs);
+			free(k->syms->slots[i].val);
+		}
+	rc += hk_table_free(k->syms);
+	KVEC_EACH(k->mods, i)
+		free(k->mods->items[i]);
+	rc += kvec_free(k->mods);
+	if(k->ring != NULL)
+		rc += kring_free(k->ring);
+	kcache_free(k);
+	/* frees the keycombs of kact_new_hk at once */
+	rc += arena_free(k->arena);
+	free(k);
+	return rc;
+}
+
+
+/* The main event loop which queries the environment for keystrokes and
+ 	hotkeys. If a hotkey occures, the corresponding function will be 
+ 	called.
+ 	Param: k = A valid pointer to a keyact structure.
+ 	Return: (void *) -1 on failure or (void*) 0 on success */
+static void *event_loop(void *k){
+	struct keyact *env = (struct keyact *) k;
+	struct kact_event batch[BATCH_LEN];
+	unsigned long len;
+	int n;
+
+	if(env->be->setup(env))
+		pthread_exit((void *) -1);
+	memset(env->held, 0, sizeof(env->held));
+	env->ready = 1;
+
+	/* Every wakeup drains all events which are already queued and 
+		dispatches them together. The mapping only owns the keycomb 
+		objects and is never traversed here */
+	for(;;){
+		/* jump out of the loop if the cancel flag is set*/
+		if(wait_event(env))
+			break;
+		n = env->be->read(env, batch, BATCH_LEN);
+
+		stat_add(&env->stats.wakeups, 1);
+		stat_add(&env->stats.events, n);
+		if(env->ring == NULL){
+			dispatch_batch(env, batch, n);
+			continue;
+		}
+		/* the dispatcher matches the events, this thread only reads */
+		kring_push(env->ring, batch, n, env->ring_policy, &env->cancel,
+				&env->stats.ring_dropped, &env->stats.ring_waits);
+		len = kring_len(env->ring);
+		if(len > env->stats.ring_max)
+			__atomic_store_n(&env->stats.ring_max, len, __ATOMIC_RELAXED);
+	}
+
+	pthread_exit((void *) 0);
+}
+
+/* Dispatches the events which the event loop has put into the ring. It
+	owns everything which the loop owns without a ring: the sequence
+	automaton, the held hotkeys and the calls of the hotkeys. It keeps
+	running until the event loop has exited and the ring is empty, see
+	kact_stop
+	Param: k = A valid pointer to a keyact structure
+	Return: (void *) 0 */
+static void *ring_loop(void *k){
+	struct keyact *env = (struct keyact *) k;
+	struct kact_event batch[BATCH_LEN];
+	int n, done;
+
+	for(;;){
+		/* read the flag first, the last events are visible then */
+		done = __atomic_load_n(&env->ring_done, __ATOMIC_SEQ_CST);
+		n = kring_pop(env->ring, batch, BATCH_LEN);
+		if(n > 0){
+			dispatch_batch(env, batch, n);
+			continue;
+		}
+		if(done)
+			break;
+		/* an active prefix limits the time to wait for the next stroke */
+		kring_wait(env->ring, seq_timeout(env));
+	}
+	pthread_exit((void *) 0);
+}
+
+/* Looks up the hotkeys of a batch of events and calls the functions of
+	all matching hotkeys. The snapshot of the table is acquired only once
+	for the whole batch
+	Param: k = A valid pointer to a keyact structure
+		batch = An array of decoded events
+		n = The number of events in batch. At most BATCH_LEN
+	Return: nothing */
+static void dispatch_batch(struct keyact *k, struct kact_event *batch, 
+		int n){
+	struct keycomb *hits[BATCH_LEN], *temp;
+	unsigned int counts[BATCH_LEN], cnt;
+	long stamps[BATCH_LEN], now = now_us();
+	unsigned long matches = 0, misses = 0;
+	struct hk_table *table, *seqs;
+	struct seq_state *state;
+	struct krec *rec;
+	struct hotkey h;
+	int i, m = 0;
+
+	/* Read the published snapshots without any lock, so kact_reg_hk and
+	 	the loop never wait for each other */
+	table = table_acquire(k);
+	seqs = __atomic_load_n(&k->seqs, __ATOMIC_SEQ_CST);
+	/* kact_record_stop waits for the read side before it unmaps */
+	rec = __atomic_load_n(&k->rec, __ATOMIC_SEQ_CST);
+	if(rec != NULL)
+		krec_append(rec, batch, n, now);
+	for(i=0; i<n; i++){
+		switch(batch[i].type){
+			case KeyPress:
+				h.keycode = batch[i].keycode;
+				h.mod_mask = batch[i].state;
+				/* a stroke continuing the active prefix wins. Any other
+				 	key cancels the prefix */
+				state = NULL;
+				if(k->seq_cur != NULL){
+					state = (struct seq_state *) 
+								hk_table_get(seqs, seq_key(k->seq_cur, &h));
+					if(state == NULL)
+						seq_move(k, NULL, table, seqs);
+				}
+				if(state == NULL)
+					state = (struct seq_state *) 
+								hk_table_get(seqs, seq_key(NULL, &h));
+				if(state != NULL){
+					if(state->comb != NULL){
+						cnt = repeat_filter(k, state->comb, &batch[i]);
+						if(cnt > 0){
+							hits[m] = state->comb;
+							stamps[m] = event_stamp(k, batch[i].time, now);
+							counts[m++] = cnt;
+						}
+						state = NULL;
+					}
+					seq_move(k, state, table, seqs);
+					matches++;
+					break;
+				}
+
+				temp = (struct keycomb *) hk_table_get(table, 
+						hk_pack(batch[i].keycode, batch[i].state));
+				if(temp == NULL){
+					misses++;
+					break;
+				}
+				matches++;
+				cnt = repeat_filter(k, temp, &batch[i]);
+				if(cnt > 0){
+					hits[m] = temp;
+					stamps[m] = event_stamp(k, batch[i].time, now);
+					counts[m++] = cnt;
+				}
+				break;
+			case KeyRelease:
+				/* the modifiers might already be released, so the hotkey
+				 	is found by its keycode only */
+				if(batch[i].keycode >= HELD_LEN)
+					break;
+				temp = k->held[batch[i].keycode];
+				if(temp == NULL)
+					break;
+				cnt = repeat_filter(k, temp, &batch[i]);
+				if(cnt > 0){
+					hits[m] = temp;
+					stamps[m] = event_stamp(k, batch[i].time, now);
+					counts[m++] = cnt;
+				}
+				break;
+			case MappingNotify:
+				/* the rest of the batch is matched against the new
+				 	tables. The read side is left meanwhile, because the
+				 	writer must never wait for its own reader */
+				table_release(k);
+				remap(k);
+				table = table_acquire(k);
+				seqs = __atomic_load_n(&k->seqs, __ATOMIC_SEQ_CST);
+				break;
+			default:
+				break;
+		}
+	}
+	table_release(k);
+	stat_add(&k->stats.matches, matches);
+	stat_add(&k->stats.misses, misses);
+
+	for(i=0; i<m; i++){
+		temp = hits[i];
+		/* the loop only queues the call if there are workers. Routing by
+		 	keycomb keeps the calls of one hotkey in order */
+		if(k->pool != NULL){
+			now = now_us();
+			kpool_push(k->pool, (unsigned long) temp >> 4, 
+					call_hk, (void *) temp, counts[i], stamps[i]);
+			hist_add(&k->stats.push_wait, now_us() - now);
+		} else
+			call_hk((void *) temp, counts[i], stamps[i]);
+	}
+}
+
+/* Resolves every binding of k again after the keyboard mapping has
+	changed. Each keycomb keeps its keysym and modifier string, so it is
+	resolved from scratch by lookups in the mapping of the backend. Only
+	the keys whose binding has moved are touched afterwards: a copy of
+	the table gets their new bindings, the keys which lost every binding
+	are ungrabbed and the new ones grabbed, one batch each and without
+	waiting for the backend. Sequences are recompiled from their strings
+	only if one of them has moved, see seq_rebuild, and their first
+	strokes are diffed the same way. The loop keeps
+	matching the old tables until the new ones are published. Only called
+	by the event loop
+	Param: k = A valid pointer to a keyact structure
+	Return: The number of moved bindings or -1 on failure */
+static int remap(struct keyact *k){
+	struct keycomb **moved = NULL, *c, *old;
+	struct hotkey *keys = NULL, *drop = NULL, *add = NULL, h;
+	struct hotkey strokes[SEQ_LEN];
+	struct hk_table *next = NULL, *seqs = NULL;
+	struct hk_table *touched = NULL;
+	struct seq_state *state;
+	struct kact_sym *s;
+	struct snode *node;
+	size_t i, j, n, nmoved = 0, nseq = 0, ndrop = 0, nadd = 0;
+	unsigned int code;
+	uint64_t key;
+	int m, was, now, all, rc = -1;
+
+	/* begin synchronisation with other writers */
+	pthread_mutex_lock(k->mutex);
+	n = k->mapping->len;
+	for(node = k->profiles->start; node != NULL; node = node->next)
+		n += ((struct kact_profile *) node->content)->binds->len;
+	moved = (struct keycomb **) malloc(sizeof(struct keycomb *) * (n + 1));
+	keys = (struct hotkey *) malloc(sizeof(struct hotkey) * (n + 1));
+	if(moved == NULL || keys == NULL)
+		goto out;
+
+	/* every keysym is looked up once. Only the bindings of the keysyms
+	 	whose keycode has changed are resolved again, unless a modifier
+	 	has changed, which can move any binding. A keysym which isn't on
+	 	the keyboard anymore gets keycode 0, so it stays unbound until a
+	 	later change brings it back */
+	all = remap_mods(k);
+	for(i=0; i<k->syms->cap; i++){
+		s = (struct kact_sym *) k->syms->slots[i].val;
+		if(s == NULL)
+			continue;
+		if(resolve_key(k, (unsigned long) k->syms->slots[i].key, &code))
+			code = 0;
+		if(code == s->keycode && !all)
+			continue;
+		s->keycode = code;
+		KVEC_EACH(s->combs, j)
+			remap_check(k, (struct keycomb *) s->combs->items[j], moved, 
+					keys, &nmoved);
+	}
+	/* the final states hold the sequences. As long as their strokes
+	 	still lead to them, the automaton is left alone */
+	for(i=0; i<k->seqs->cap; i++){
+		state = (struct seq_state *) k->seqs->slots[i].val;
+		if(state == NULL || state->comb == NULL)
+			continue;
+		m = parse_seq(k, state->comb->user_mod, strokes);
+		nseq += m <= 0 || seq_walk(k->seqs, strokes, m) != state;
+	}
+	if(nseq > 0){
+		seqs = seq_rebuild(k);
+		if(seqs == NULL)
+			goto out;
+	}
+	if(nmoved == 0 && nseq == 0){
+		rc = 0;
+		goto out;
+	}
+
+	/* the strokes of an active prefix might have moved as well */
+	if(k->seq_cur != NULL)
+		seq_move(k, NULL, k->table, k->seqs);
+	touched = hk_table_init(nmoved * 2);
+	next = hk_table_copy(k->table, nmoved * 2);
+	if(touched == NULL || next == NULL)
+		goto out;
+	for(i=0; i<nmoved; i++){
+		c = moved[i];
+		key = hk_pack(c->internal.keycode, c->internal.mod_mask);
+		hk_table_put(touched, key, (void *) c);
+		if(c->profile != NULL && 
+				hk_table_get(c->profile->binds, key) == (void *) c)
+			hk_table_del(c->profile->binds, key);
+		else if(mapping_has(k, c))
+			chain_unlink(k, c);
+		c->internal = keys[i];
+	}
+	for(i=0; i<nmoved; i++){
+		c = moved[i];
+		/* the latest registration of a hotkey is the head of its chain.
+		 	Without memory the binding stays unbound like a lost keysym */
+		if(mapping_has(k, c) && chain_link(k, c)){
+			c->internal.keycode = 0;
+			c->internal.mod_mask = 0;
+		}
+		if(c->internal.keycode == 0)
+			continue;
+		key = hk_pack(c->internal.keycode, c->internal.mod_mask);
+		hk_table_put(touched, key, (void *) c);
+		if(c->profile == NULL)
+			continue;
+		/* like kact_profile_add, the binding replaces another one */
+		old = (struct keycomb *) hk_table_get(c->profile->binds, key);
+		if(old != NULL && old != c){
+			old->profile = NULL;
+			sym_rm(k, old);
+		}
+		hk_table_put(c->profile->binds, key, (void *) c);
+	}
+	/* first strokes are transitions of the start state, whose key is the
+	 	packed hotkey itself */
+	for(i=0; nseq > 0 && i<k->seqs->cap; i++)
+		if(k->seqs->slots[i].val != NULL && k->seqs->slots[i].key >> 48 == 0)
+			hk_table_put(touched, k->seqs->slots[i].key, (void *) k);
+	for(i=0; nseq > 0 && i<seqs->cap; i++)
+		if(seqs->slots[i].val != NULL && seqs->slots[i].key >> 48 == 0)
+			hk_table_put(touched, seqs->slots[i].key, (void *) k);
+
+	drop = (struct hotkey *) malloc(sizeof(struct hotkey) * touched->len);
+	add = (struct hotkey *) malloc(sizeof(struct hotkey) * touched->len);
+	if(drop == NULL || add == NULL)
+		goto out;
+	for(i=0; i<touched->cap; i++){
+		if(touched->slots[i].val == NULL)
+			continue;
+		key = touched->slots[i].key;
+		c = k->profile != NULL ? 
+				(struct keycomb *) hk_table_get(k->profile->binds, key) : NULL;
+		if(c == NULL)
+			c = (struct keycomb *) hk_table_get(k->globals, key);
+		if(c != NULL)
+			hk_table_put(next, key, (void *) c);
+		else
+			hk_table_del(next, key);
+		was = hk_table_get(k->table, key) != NULL || 
+				hk_table_get(k->seqs, key) != NULL;
+		now = hk_table_get(next, key) != NULL || 
+				hk_table_get(nseq > 0 ? seqs : k->seqs, key) != NULL;
+		h.keycode = (unsigned int) key;
+		h.mod_mask = (unsigned int) (key >> 32);
+		if(was && !now)
+			drop[ndrop++] = h;
+		else if(!was && now)
+			add[nadd++] = h;
+	}
+
+	if(ndrop > 0)
+		k->be->grab(k, drop, ndrop, 0, NULL);
+	if(nadd > 0)
+		k->be->grab(k, add, nadd, 1, NULL);
+	table_publish(k, &k->table, next);
+	next = NULL;
+	if(nseq > 0){
+		table_publish(k, &k->seqs, seqs);
+		seqs = NULL;
+	}
+	rc = (int) (nmoved + nseq);
+out:
+	pthread_mutex_unlock(k->mutex);
+	hk_table_free(next);
+	hk_table_free(seqs);
+	hk_table_free(touched);
+	free(moved);
+	free(keys);
+	free(drop);
+	free(add);
+	return rc;
+}
+
+/* Resolves a binding again and remembers it if its hotkey has changed.
+	Has to be called with k->mutex held
+	Param: k = A valid pointer to a keyact structure
+		c = A valid pointer to a registered keycomb structure
+		moved = The moved keycombs
+		keys = The new hotkeys of the moved keycombs
+		n = A valid pointer to the number of moved keycombs
+	Return: nothing */
+static void remap_check(struct keyact *k, struct keycomb *c,
+		struct keycomb **moved, struct hotkey *keys, size_t *n){
+	struct hotkey h = { 0, 0 };
+	if(transform(k, &h, c)){
+		h.keycode = 0;
+		h.mod_mask = 0;
+	}
+	if(h.keycode == c->internal.keycode && h.mod_mask == c->internal.mod_mask)
+		return;
+	moved[*n] = c;
+	keys[(*n)++] = h;
+}
+
+/* Applies the repeat policy of a hotkey to one of its key events. The
+	event loop remembers which hotkey is held down per keycode. Thanks to
+	the detectable autorepeat of XKB a held key produces KeyPress events
+	only, so a KeyRelease really means that the key has been released
+	Param: k = A valid pointer to a keyact structure
+		c = The hotkey the event belongs to
+		e = A KeyPress or KeyRelease event
+	Return: The count which has to be passed to the hotkey or 0 if the
+		function of the hotkey must not be called */
+static unsigned int repeat_filter(struct keyact *k, struct keycomb *c, 
+		struct kact_event *e){
+	int held = 0;
+	if(e->keycode < HELD_LEN){
+		held = k->held[e->keycode] == c;
+		k->held[e->keycode] = e->type == KeyPress ? c : NULL;
+	}
 
-	return 0;
+	if(e->type != KeyPress)
+		return c->repeat == REPEAT_COUNT && held ? c->count : 0;
+
+	switch(c->repeat){
+		case REPEAT_ONCE:
+			return held ? 0 : 1;
+		case REPEAT_RATE:
+			/* count tells whether the hotkey has ever been called */
+			if(c->count > 0 && e->time - c->last < c->interval)
+				return 0;
+			c->count = 1;
+			c->last = e->time;
+			return 1;
+		case REPEAT_COUNT:
+			/* the presses are reported on release */
+			c->count = held ? c->count + 1 : 1;
+			return 0;
+		default:
+			return 1;
+	}
 }
 
-/* Stops the main event loop and closes the connection to the x-server
-  	 leaving everything else untouched 
- 	Param: k = A Valid pointer to an keyact structure containing the 
- 		display pointer 
- 	Return: 0 on success -1 if an invalid value has been given as arguemnt */
-int kact_stop(struct keyact *k){
-	if(k == NULL)
-		return -1;
+/* Calls the function of a hotkey and records how long it took. Used by
+	the event loop and the workers
+	Param: c = A valid pointer to a keycomb structure
+		n = The number of coalesced presses
+		stamp = The time of the event as returned by event_stamp
+	Return: The return value of the function */
+static int call_hk(void *c, unsigned int n, long stamp){
+	struct keycomb *comb = (struct keycomb *) c;
+	unsigned long max, d;
+	long start;
+	int rc;
+
+	start = now_us();
+	if(comb->stats != NULL)
+		hist_add(&comb->stats->latency, start - stamp);
+	if(comb->count_func != NULL)
+		rc = comb->count_func(comb->mod_param, n);
+	else
+		rc = comb->func(comb->mod_param);
+	d = (unsigned long) (now_us() - start);
+
+	if(comb->stats != NULL)
+		hist_add(&comb->stats->callback, (long) d);
+	stat_add(&comb->calls, 1);
+	stat_add(&comb->call_sum, d);
+	max = __atomic_load_n(&comb->call_max, __ATOMIC_RELAXED);
+	while(d > max && !__atomic_compare_exchange_n(&comb->call_max, &max, d,
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	return rc;
+}
 
-	k->cancel = 1;
-	send_devent(k);
-	usleep(SLEEP_TIME);
-	XCloseDisplay(k->display);
-	
+/* Sets the repeat policy of a hotkey. It has to be set before the hotkey
+	is registered
+	Param: c = A valid pointer to a keycomb structure
+		policy = One of 
+			- REPEAT_ALL: every press calls the function (default)
+			- REPEAT_ONCE: a held key calls it only once
+			- REPEAT_RATE: at most once every interval milliseconds
+			- REPEAT_COUNT: once on release. The number of presses is
+				passed to count_func
+		interval = The interval of REPEAT_RATE, otherwise ignored
+		count_func = A function which gets the number of presses or NULL.
+			If set, it is called instead of func for every policy
+	Return: 0 on success, -1 on failure */
+int kact_set_repeat(struct keycomb *c, int policy, unsigned int interval, 
+		int (*count_func)(void *mp, unsigned int count)){
+	if(c == NULL || policy < REPEAT_ALL || policy > REPEAT_COUNT)
+		return -1;
+	c->repeat = policy;
+	c->interval = interval;
+	c->count_func = count_func;
+	c->count = 0;
+	c->last = 0;
 	return 0;
 }
 
-/* Sends an dummy event to a xserver. The event is of type XKeyEvent, which
-	furthermore is of type KeyPress.
-	Param: k = A valid pointer to an keyact structure
-	Return: nothing */
-static void send_devent(struct keyact *k){
-	if(k == NULL)
-		return;
-
-	XEvent ev;
-	XKeyEvent dummy;
-	memset(&ev, 0, sizeof(XEvent));
-	memset(&dummy, 0, sizeof(XKeyEvent));
+/* Blocks until an event can be read from the backend without blocking
+	or until the loop has been cancelled. Polls the descriptor of the
+	backend and the wakeup pipe of k, so kact_stop never has to fake any
+	input
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 if an event is pending, 1 if the loop has been cancelled */
+static int wait_event(struct keyact *k){
+	struct pollfd fds[2];
+	char buf[16];
+	int timeout;
+
+	fds[0].fd = k->be->fd(k);
+	fds[0].events = POLLIN;
+	fds[1].fd = k->wakeup[0];
+	fds[1].events = POLLIN;
 
-	dummy.display = k->display;
-	dummy.subwindow = None;
-	dummy.root = None;
-	dummy.time = CurrentTime;
-	dummy.x = 1;
-	dummy.y = 1;
-	dummy.x_root = 1;
-	dummy.y_root = 1;
-	dummy.same_screen = True;
-	dummy.window = XRootWindow(k->display, 0);
-	dummy.state = None;
-	dummy.keycode = None;	
-	dummy.type = KeyPress;
+	for(;;){
+		if(__atomic_load_n(&k->cancel, __ATOMIC_SEQ_CST))
+			return 1;
+		if(k->be->pending(k) > 0)
+			return 0;
+		/* an active prefix limits the time to wait for the next stroke.
+		 	With a ring the prefix belongs to the dispatcher */
+		timeout = k->ring != NULL ? -1 : seq_timeout(k);
+		if(poll(fds, 2, timeout) < 0 && errno != EINTR)
+			return 1;
+		if(fds[1].revents & POLLIN)
+			while(read(k->wakeup[0], buf, sizeof(buf)) > 0)
+				;
+	}
+}
 
-	ev.type = KeyPress;	
-	ev.xkey = dummy;
+/* Returns to the start state of the sequence automaton if the active
+	prefix has expired
+	Param: k = A valid pointer to a keyact structure
+	Return: Milliseconds until the active prefix expires or -1 if there
+		is none */
+static int seq_timeout(struct keyact *k){
+	long timeout;
+	if(k->seq_cur == NULL)
+		return -1;
 
-	XSendEvent(k->display, XRootWindow(k->display, 0), 0, 
-			KeyPressMask, &ev);
-	XFlush(k->display);
+	timeout = k->seq_deadline - now_ms();
+	if(timeout > 0)
+		return (int) timeout;
+	seq_move(k, NULL, table_acquire(k), 
+			__atomic_load_n(&k->seqs, __ATOMIC_SEQ_CST));
+	table_release(k);
+	return -1;
 }
 
-/* Stops the main even loop and frees all resources occupied by a 
-	keyact structure including it's member mapping 
- 	Param: k = A valid Pointer to a keyact structure */
-int kact_clear(struct keyact *k){
-	int rc = 0;
+/* Returns a descriptor which becomes readable when kact_dispatch_pending
+	has something to do. It lets an application run the library in its
+	own poll or epoll loop instead of kact_start. It is an epoll
+	descriptor over the backend and the wakeup pipe, so the events which
+	the backend buffered behind the back of the application are covered
+	as well
+	Param: k = A valid pointer to a keyact structure
+	Return: The descriptor or -1 on failure */
+int kact_fd(struct keyact *k){
 	if(k == NULL)
 		return -1;
+	return k->epfd;
+}
 
-	/* We have to send an event to unblock the call to XNextEvent in
-		the event_loop. TODO: propably it's better to outsource the 
-		following code for better readability */
-	k->cancel = 1;
-
-	send_devent(k);
-	/* wait for the thread to cancel itself */
-	usleep(SLEEP_TIME);
-
-	XCloseDisplay(k->display);
-
-	if(k->mutex != NULL)
-		rc += pthread_mutex_destroy(k->mutex);
+/* Watches a descriptor for input by an epoll descriptor
+	Param: epfd = An epoll descriptor
+		fd = The descriptor
+	Return: 0 on success, -1 on failure */
+static int epoll_add(int epfd, int fd){
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
 
-	rc += slist_free(k->mapping);
-	free(k);
-	return rc;
+/* Tells how long the poll of an application may wait at most. After that
+	kact_dispatch_pending has to be called even if kact_fd isn't readable,
+	because the active prefix of a sequence expires
+	Param: k = A valid pointer to a keyact structure
+	Return: Milliseconds, 0 if the prefix has already expired, or -1 if 
+		there is no time limit */
+int kact_timeout(struct keyact *k){
+	long timeout;
+	if(k == NULL || k->seq_cur == NULL)
+		return -1;
+	timeout = k->seq_deadline - now_ms();
+	return timeout > 0 ? (int) timeout : 0;
 }
 
+/* Dispatches the events which can be read without blocking on the
+	calling thread. Without workers the functions of the hotkeys are
+	called directly by this function and no lock is taken. It must not be
+	called while the loop of kact_start is running
+	Param: k = A valid pointer to a keyact structure
+		max = The maximal number of events to dispatch
+	Return: The number of dispatched events or -1 on failure */
+int kact_dispatch_pending(struct keyact *k, int max){
+	struct kact_event batch[BATCH_LEN];
+	char buf[16];
+	int n, done = 0;
+	if(k == NULL || max < 0 || k->event_loop != NULL)
+		return -1;
 
-/* The main event loop which queries the environment for keystrokes and
- 	hotkeys. If a hotkey occures, the corresponding function will be 
- 	called.
- 	Param: k = A valid pointer to a keyact structure.
- 	Return: (void *) -1 on failure or (void*) 0 on success */
-static void *event_loop(void *k){
-	struct keyact *env = (struct keyact *) k;
-	struct keycomb *temp;
-	Display *display = env->display;
-	XEvent event;
-	char *disp_name;
-	int i, *rc = (int *) malloc(sizeof(int));
-
-
-	/* XAllowEvents is described in chapter 12 
-		of the official Xlib documentation. 
-	 	http://www.x.org/releases/X11R7.7/doc/libX11/libX11/libX11.html*/
-	XAllowEvents(display, AsyncBoth, CurrentTime);
-
-	/* Select press, release and motion events from the root windows
-	 	of all screens */
-	for(i=0; i<XScreenCount(display); i++)
-		XSelectInput(display, XRootWindow(display, i), 
-			KeyPressMask | KeyReleaseMask | ExposureMask);
-
-	XSetErrorHandler((XErrorHandler) on_error);
-
-	/* Traverses the slist mapping in k until it finds a fitting hotkey 
-	description. 
-	Param: e = A pointer to an XEvent object
-		k = A pointer to an instance of struct keyact where the singly 
-		list resides that has to be traversed */
-	for(;;){
-		XNextEvent(display, &event);
-		/* jump out of the loop if the cancel flag is set*/
-		if(env->cancel)
-			break;
+	/* the wakeups are covered by the pending events checked below */
+	while(read(k->wakeup[0], buf, sizeof(buf)) > 0)
+		;
 
-		/* Synchronize while operating on the list */
-		pthread_mutex_lock(env->mutex);
-		switch(event.type){
-			case KeyPress:
-				for(i=0; i<env->mapping->len; i++){
-					temp = (struct keycomb *) slist_get_at(i, env->mapping, rc);
-					if(*rc == -1) 
-						break;
-
-					if(temp->internal.keycode == event.xkey.keycode &&
-							temp->internal.mod_mask == event.xkey.state) {
-						temp->func(temp->mod_param);
-						break;
-					}
-				}
-				break;
-			case KeyRelease:
+	if(!k->ready){
+		if(k->be->setup(k))
+			return -1;
+		memset(k->held, 0, sizeof(k->held));
+		k->ready = 1;
+	}
+	seq_timeout(k);
+	while(done < max && k->be->pending(k) > 0){
+		n = k->be->read(k, batch, 
+				max - done < BATCH_LEN ? max - done : BATCH_LEN);
+		stat_add(&k->stats.wakeups, 1);
+		stat_add(&k->stats.events, n);
+		dispatch_batch(k, batch, n);
+		done += n;
+	}
+	return done;
+}
 
+/* Dispatches the events of a recording on the calling thread, in the
+	batches in which they have been recorded. The hotkeys of k are
+	matched and called as if the events came from its backend. Like
+	kact_dispatch_pending it must not be called while the loop of k is
+	running
+	Param: k = A valid pointer to a keyact structure
+		path = The path of a file written by kact_record_start
+		mode = KACT_REPLAY_FAST dispatches the batches back to back,
+			KACT_REPLAY_TIMED keeps the intervals of the recording
+		st = A valid pointer where the results are stored or NULL
+	Return: The number of dispatched events or -1 on failure */
+int kact_replay(struct keyact *k, const char *path, int mode,
+		struct kact_replay_stats *st){
+	struct kact_event batch[BATCH_LEN];
+	const struct krec_event *e;
+	struct kact_replay_stats res;
+	struct timespec ts;
+	unsigned long *lat;
+	struct krec *r;
+	uint64_t stamp, first = 0;
+	size_t i, j, n;
+	long start, due, end;
+	int m;
+	if(k == NULL || k->event_loop != NULL || k->loop != NULL ||
+			(mode != KACT_REPLAY_FAST && mode != KACT_REPLAY_TIMED))
+		return -1;
+	r = krec_open(path);
+	if(r == NULL)
+		return -1;
+	n = krec_len(r);
+	lat = (unsigned long *) malloc(sizeof(unsigned long) * (n + 1));
+	if(lat == NULL || (!k->ready && k->be->setup(k))){
+		free(lat);
+		krec_close(r);
+		return -1;
+	}
+	if(!k->ready){
+		memset(k->held, 0, sizeof(k->held));
+		k->ready = 1;
+	}
+	memset(&res, 0, sizeof(res));
+
+	start = now_ns();
+	for(i=0; i<n; i+=m){
+		/* a batch consists of the events with the same stamp */
+		stamp = krec_get(r, i)->stamp;
+		for(m=0; m<BATCH_LEN && i + m < n; m++){
+			e = krec_get(r, i + m);
+			if(e->stamp != stamp)
 				break;
-			case ButtonPress:
-				//currently not implemented
-				break;
-			case ButtonRelease:
-				//same as above
-				break;
-			default:
-				break;
+			batch[m].type = (int) e->type;
+			batch[m].keycode = e->keycode;
+			batch[m].state = e->state;
+			batch[m].time = (unsigned long) e->time;
+		}
+		if(i == 0)
+			first = stamp;
+		due = now_ns();
+		if(mode == KACT_REPLAY_TIMED){
+			due = start + (long) (stamp - first) * 1000L;
+			ts.tv_sec = due / 1000000000L;
+			ts.tv_nsec = due % 1000000000L;
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 
+					NULL) == EINTR)
+				;
 		}
-		pthread_mutex_unlock(env->mutex);
+		stat_add(&k->stats.wakeups, 1);
+		stat_add(&k->stats.events, m);
+		dispatch_batch(k, batch, m);
+		end = now_ns();
+		for(j=0; j<(size_t) m; j++)
+			lat[i + j] = (unsigned long) (end - due);
+		res.batches++;
 	}
-
-	pthread_exit((void *) 0);
+	end = now_ns();
+	krec_close(r);
+
+	res.events = n;
+	res.ns = (unsigned long) (end - start);
+	res.events_per_s = res.ns > 0 ? n * 1e9 / res.ns : 0;
+	if(n > 0){
+		qsort(lat, n, sizeof(unsigned long), cmp_ulong);
+		res.p50_ns = lat[n / 2];
+		res.p99_ns = lat[n * 99 / 100];
+		res.max_ns = lat[n - 1];
+	}
+	free(lat);
+	if(st != NULL)
+		*st = res;
+	return (int) n;
 }
 
-/* Little Errorhandler for the X11-System. It currently does nothing */
-static int *on_error(Display *d, XErrorEvent *e){
-	static int already = 0;
-	if(already != 0)
-		return NULL;
-	already = 1;
-
-	//TODO: Error handling...
-	return NULL;
+/* Compares two unsigned longs for qsort
+	Param: a = A valid pointer to an unsigned long
+		b = Another one
+	Return: <0, 0 or >0 like strcmp */
+static int cmp_ulong(const void *a, const void *b){
+	unsigned long x = *(const unsigned long *) a;
+	unsigned long y = *(const unsigned long *) b;
+	return x < y ? -1 : x > y;
 }
 
 #ifdef TEST
@@ -370,9 +2399,18 @@ void test_init(void){
 	CU_ASSERT(env != NULL);
 	CU_ASSERT(env->mapping != NULL);
 	CU_ASSERT(env->mapping->len == 0);
+	CU_ASSERT(env->table != NULL);
+	CU_ASSERT(env->table->len == 0);
+	CU_ASSERT(env->retired != NULL);
+	CU_ASSERT(env->readers == 0);
 	CU_ASSERT(env->event_loop == NULL);
 	CU_ASSERT(env->cancel == 0);
+	CU_ASSERT(env->stats.wakeups == 0);
+	CU_ASSERT(env->stats.events == 0);
+	CU_ASSERT(env->stats.latency.count == 0);
 	CU_ASSERT(env->mutex != NULL);
+	CU_ASSERT(env->pool == NULL);
+	CU_ASSERT(env->arena != NULL);
 	CU_ASSERT(kact_clear(env) == 0);
 }
 
@@ -469,10 +2507,45 @@ void test_usage(void){
 	CU_ASSERT(hk->internal.mod_mask == (unsigned int) 5);
 	CU_ASSERT(hk->internal.mod_mask == 5);
 	CU_ASSERT(hk->mod_param == (void *) hk);
+	CU_ASSERT(hk->repeat == REPEAT_ALL);
+	CU_ASSERT(kact_set_repeat(hk, 4711, 0, NULL) == -1);
+
+	/* the cached mapping has to agree with the x-server */
+	CU_ASSERT(hk2->internal.keycode == 
+			XKeysymToKeycode(kact_x11_display(env), XStringToKeysym("f")));
+	CU_ASSERT(kact_get_hk(test_func, "nomod", (int) 'f', NULL) == NULL);
 	
 	CU_ASSERT(kact_reg_hk(hk, env) == 0);
 	CU_ASSERT(kact_reg_hk(hk2, env) == 0);
 
+	/* invalid entries of a batch are reported one by one */
+	struct keycomb *batch[2] = { 
+		kact_get_hk(test_func, "ctrl,shift", (int) 'g', NULL), NULL };
+	int brc[2];
+	CU_ASSERT(kact_reg_hk_batch(batch, 2, env, brc) == 1);
+	CU_ASSERT(brc[0] == 0);
+	CU_ASSERT(brc[1] == -1);
+	CU_ASSERT(env->table->len == 3);
+
+	/* keycombs of the arena are freed by kact_clear */
+	struct arena_stats st;
+	struct keycomb *hk3 = kact_new_hk(env, test_func, "ctrl,shift", 
+							(int) 'h', NULL);
+	CU_ASSERT(hk3 != NULL);
+	CU_ASSERT(kact_arena_stats(env, &st) == 0);
+	CU_ASSERT(st.used >= sizeof(struct keycomb) + strlen("ctrl,shift"));
+	CU_ASSERT(st.chunks == 1);
+	CU_ASSERT(kact_reg_hk(hk3, env) == 0);
+
+	/* sequences share their prefixes and must not extend each other */
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s", test_func, NULL, 0) != NULL);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s", test_func, NULL, 0) == NULL);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x", test_func, NULL, 0) == NULL);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s q", test_func, NULL, 0) == NULL);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x k", test_func, NULL, 500) != NULL);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+nomod", test_func, NULL, 0) == NULL);
+	CU_ASSERT(env->seqs->len == 3);
+
 	/* Tests for Thread starting and stopping */
 	CU_ASSERT(kact_start(env) == 0);
 	sleep(10);
@@ -484,7 +2557,7 @@ void test_usage(void){
 	memset(&ev, 0, sizeof(XEvent));
 	memset(&dummy, 0, sizeof(XKeyEvent));
 
-	dummy.display = env->display;
+	dummy.display = kact_x11_display(env);
 	dummy.subwindow = None;
 	dummy.root = None;
 	dummy.time = CurrentTime;
@@ -493,7 +2566,7 @@ void test_usage(void){
 	dummy.x_root = 1;
 	dummy.y_root = 1;
 	dummy.same_screen = True;
-	dummy.window = XRootWindow(env->display, 0);
+	dummy.window = XRootWindow(kact_x11_display(env), 0);
 	dummy.state = hk->internal.mod_mask;
 	dummy.keycode = hk->internal.keycode;	
 	dummy.type = KeyPress;
@@ -501,9 +2574,9 @@ void test_usage(void){
 	ev.type = KeyPress;	
 	ev.xkey = dummy;
 
-	XSendEvent(env->display, XRootWindow(env->display, 0), 0, 
-			KeyPressMask, &ev);
-	XFlush(env->display);
+	XSendEvent(kact_x11_display(env), XRootWindow(kact_x11_display(env), 0), 
+			0, KeyPressMask, &ev);
+	XFlush(kact_x11_display(env));
 	/* Sleep necessary because a deadlock would occure if else */
 	sleep(3);
 
@@ -512,6 +2585,1034 @@ void test_usage(void){
 	//Fin	
 }
 
+#ifdef KACT_XCB
+/* Needs an x-server, e.g. Xvfb. A hotkey which is already grabbed by
+	another client must fail on its own */
+void test_xcb(void){
+	struct kact_config cfg = { 0, 0, &kact_xcb };
+	struct keyact *x11 = kact_init();
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct keycomb *own, *c[2];
+	int rc[2];
+
+	CU_ASSERT(x11 != NULL && env != NULL);
+	if(x11 == NULL || env == NULL)
+		return;
+	own = kact_new_hk(x11, test_func, "ctrl,shift", (int) 'j', NULL);
+	c[0] = kact_new_hk(env, test_func, "ctrl,shift", (int) 'j', NULL);
+	c[1] = kact_new_hk(env, test_func, "ctrl,shift", (int) 'k', NULL);
+	CU_ASSERT(own != NULL && c[0] != NULL && c[1] != NULL);
+	CU_ASSERT(c[0]->internal.keycode == own->internal.keycode);
+	CU_ASSERT(c[0]->internal.mod_mask == own->internal.mod_mask);
+	CU_ASSERT(kact_reg_hk_batch(&own, 1, x11, NULL) == 0);
+
+	CU_ASSERT(kact_reg_hk_batch(c, 2, env, rc) == 1);
+	CU_ASSERT(rc[0] == -1);
+	CU_ASSERT(rc[1] == 0);
+	CU_ASSERT(env->table->len == 1);
+
+	/* held keys behave like with Xlib, see REPEAT_ONCE */
+	CU_ASSERT(kact_xcb_autorepeat(env) == 0);
+	CU_ASSERT(kact_start(env) == 0);
+	CU_ASSERT(kact_stop(env) == 0);
+	CU_ASSERT(kact_xcb_autorepeat(env) == 1);
+	CU_ASSERT(kact_xcb_autorepeat(x11) == 0);
+	CU_ASSERT(kact_xcb_errors(env) == 0);
+	CU_ASSERT(kact_clear(env) == 0);
+	CU_ASSERT(kact_clear(x11) == 0);
+}
+#endif
+
+#ifdef KACT_XI2
+/* Needs an x-server with XInput2, e.g. Xvfb. Nothing is grabbed, so a
+	hotkey grabbed by another client can still be registered */
+void test_xi2(void){
+	struct kact_config cfg = { 0, 0, &kact_xi2 };
+	struct keyact *x11 = kact_init();
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct keycomb *own, *c;
+	int rc;
+
+	CU_ASSERT(x11 != NULL && env != NULL);
+	if(x11 == NULL || env == NULL)
+		return;
+	own = kact_new_hk(x11, test_func, "ctrl,shift", (int) 'j', NULL);
+	c = kact_new_hk(env, test_func, "ctrl,shift", (int) 'j', NULL);
+	CU_ASSERT(own != NULL && c != NULL);
+	CU_ASSERT(kact_reg_hk_batch(&own, 1, x11, NULL) == 0);
+	CU_ASSERT(kact_reg_hk_batch(&c, 1, env, &rc) == 0);
+	CU_ASSERT(rc == 0);
+
+	CU_ASSERT(kact_start(env) == 0);
+	CU_ASSERT(kact_stop(env) == 0);
+	CU_ASSERT(kact_clear(env) == 0);
+	CU_ASSERT(kact_clear(x11) == 0);
+}
+#endif
+
+static int mem_calls;
+static unsigned int mem_count;
+
+int mem_func(void *p){
+	__atomic_add_fetch(&mem_calls, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+int mem_count_func(void *p, unsigned int count){
+	mem_count = count;
+	return 0;
+}
+
+/* Drives the whole library by the in memory backend, no x-server needed */
+void test_mem(void){
+	struct kact_config cfg = { 0, 0, &kact_mem };
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct arena_stats ast;
+	struct kact_stats st;
+	size_t allocs;
+	struct keycomb *a, *b;
+	unsigned int ctrl = ControlMask;
+	int i;
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	CU_ASSERT(kact_x11_display(env) == NULL);
+
+	a = kact_new_hk(env, mem_func, "ctrl", (int) 'a', NULL);
+	b = kact_new_hk(env, mem_func, "ctrl,alt", (int) 'b', NULL);
+	CU_ASSERT(a != NULL && b != NULL);
+	if(a == NULL || b == NULL)
+		return;
+	CU_ASSERT(a->internal.keycode == 'a');
+	CU_ASSERT(b->internal.mod_mask == (ControlMask | Mod1Mask));
+	CU_ASSERT(kact_new_hk(env, mem_func, "ctrl", 0, NULL) == NULL);
+	kact_set_repeat(b, REPEAT_COUNT, 0, mem_count_func);
+	CU_ASSERT(kact_reg_hk(a, env) == 0);
+	CU_ASSERT(kact_reg_hk(b, env) == 0);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s", mem_func, NULL, 0) != NULL);
+	CU_ASSERT(kact_mem_grabs(env) == 3);
+	/* the keycomb and one state per stroke, only a published state is
+	 	copied */
+	CU_ASSERT(kact_arena_stats(env, &ast) == 0);
+	allocs = ast.allocs;
+	CU_ASSERT(kact_reg_seq(env, "ctrl+q ctrl+w ctrl+e", mem_func, NULL, 0)
+			!= NULL);
+	CU_ASSERT(kact_arena_stats(env, &ast) == 0);
+	CU_ASSERT(ast.allocs == allocs + 4);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+q ctrl+w ctrl+r", mem_func, NULL, 0)
+			!= NULL);
+	CU_ASSERT(kact_arena_stats(env, &ast) == 0);
+	CU_ASSERT(ast.allocs == allocs + 7);
+	CU_ASSERT(kact_mem_grabs(env) == 4);
+
+	CU_ASSERT(kact_start(env) == 0);
+	for(i=0; i<3; i++)
+		kact_mem_inject(env, KeyPress, 'a', ctrl, 10 + i);
+	kact_mem_inject(env, KeyRelease, 'a', ctrl, 13);
+	/* no hotkey */
+	kact_mem_inject(env, KeyPress, 'a', 0, 14);
+	/* a held key is reported on release */
+	for(i=0; i<4; i++)
+		kact_mem_inject(env, KeyPress, 'b', ctrl | Mod1Mask, 20 + i);
+	kact_mem_inject(env, KeyRelease, 'b', 0, 24);
+	CU_ASSERT(kact_mem_wait(env) == 0);
+	CU_ASSERT(mem_calls == 3);
+	CU_ASSERT(mem_count == 4);
+
+	/* the second stroke is only grabbed while the prefix is active */
+	kact_mem_inject(env, KeyPress, 'x', ctrl, 30);
+	kact_mem_wait(env);
+	CU_ASSERT(kact_mem_grabs(env) == 5);
+	kact_mem_inject(env, KeyPress, 's', ctrl, 31);
+	kact_mem_wait(env);
+	CU_ASSERT(kact_mem_grabs(env) == 4);
+	CU_ASSERT(mem_calls == 4);
+
+	CU_ASSERT(kact_stats(env, &st) == 0);
+	CU_ASSERT(st.events == 12);
+	CU_ASSERT(st.misses == 1);
+	CU_ASSERT(st.latency.count == 5);
+
+	/* the loop can be restarted */
+	CU_ASSERT(kact_stop(env) == 0);
+	kact_mem_inject(env, KeyPress, 'a', ctrl, 40);
+	CU_ASSERT(kact_start(env) == 0);
+	kact_mem_wait(env);
+	CU_ASSERT(mem_calls == 5);
+	CU_ASSERT(kact_clear(env) == 0);
+}
+
+/* Waits up to two seconds for the hotkeys of the tests
+	Param: n = The expected number of calls of mem_func
+	Return: nothing */
+static void wait_calls(int n){
+	int i;
+	for(i=0; i<2000 && __atomic_load_n(&mem_calls, __ATOMIC_SEQ_CST) < n; 
+			i++)
+		usleep(1000);
+}
+
+/* Feeds evdev records through a pipe and a regular file */
+void test_evdev(void){
+	struct kact_config cfg = { 0, 0, &kact_evdev, "" };
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct input_event rec[8], seq[8];
+	unsigned short codes[8] = { KEY_LEFTCTRL, KEY_A, KEY_A, KEY_A, KEY_A, 
+			KEY_LEFTCTRL, KEY_A, KEY_A };
+	int values[8] = { 1, 1, 0, 2, 0, 0, 1, 0 };
+	/* ctrl is released, pressed again and held between the strokes */
+	unsigned short seq_codes[8] = { KEY_LEFTCTRL, KEY_X, KEY_X, 
+			KEY_LEFTCTRL, KEY_LEFTCTRL, KEY_LEFTCTRL, KEY_S, KEY_S };
+	int seq_values[8] = { 1, 1, 0, 0, 1, 2, 1, 0 };
+	struct kact_stats st;
+	struct keycomb *c;
+	FILE *file;
+	int p[2], q[2], i;
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	c = kact_new_hk(env, mem_func, "ctrl", (int) 'a', NULL);
+	CU_ASSERT(c != NULL);
+	if(c == NULL)
+		return;
+	CU_ASSERT(c->internal.keycode == KEY_A + 8);
+	CU_ASSERT(c->internal.mod_mask == ControlMask);
+	CU_ASSERT(kact_new_hk(env, mem_func, "ctrl", 0x20ac, NULL) == NULL);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+
+	memset(rec, 0, sizeof(rec));
+	for(i=0; i<8; i++){
+		rec[i].type = EV_KEY;
+		rec[i].code = codes[i];
+		rec[i].value = values[i];
+	}
+	mem_calls = 0;
+	CU_ASSERT(pipe(p) == 0);
+	CU_ASSERT(kact_evdev_add_fd(env, p[0]) == 0);
+	CU_ASSERT(kact_start(env) == 0);
+	/* a record may be split by the pipe */
+	CU_ASSERT(write(p[1], rec, sizeof(rec) / 2 + 3) > 0);
+	usleep(10000);
+	CU_ASSERT(write(p[1], (char *) rec + sizeof(rec) / 2 + 3, 
+			sizeof(rec) / 2 - 3) > 0);
+	wait_calls(2);
+	CU_ASSERT(mem_calls == 2);
+	close(p[1]);
+
+	file = tmpfile();
+	CU_ASSERT(file != NULL);
+	if(file == NULL)
+		return;
+	fwrite(rec, sizeof(rec), 1, file);
+	fflush(file);
+	lseek(fileno(file), 0, SEEK_SET);
+	CU_ASSERT(kact_evdev_add_fd(env, fileno(file)) == 0);
+	wait_calls(4);
+	CU_ASSERT(mem_calls == 4);
+
+	/* modifier keys only change the state, so they neither miss nor end
+	 	an active prefix */
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s", mem_func, NULL, 0) != NULL);
+	memset(seq, 0, sizeof(seq));
+	for(i=0; i<8; i++){
+		seq[i].type = EV_KEY;
+		seq[i].code = seq_codes[i];
+		seq[i].value = seq_values[i];
+	}
+	CU_ASSERT(pipe(q) == 0);
+	CU_ASSERT(kact_evdev_add_fd(env, q[0]) == 0);
+	CU_ASSERT(write(q[1], seq, sizeof(seq)) == sizeof(seq));
+	wait_calls(5);
+	CU_ASSERT(mem_calls == 5);
+
+	CU_ASSERT(kact_stats(env, &st) == 0);
+	CU_ASSERT(st.matches == 6);
+	CU_ASSERT(st.misses == 2);
+	CU_ASSERT(kact_clear(env) == 0);
+	fclose(file);
+	close(p[0]);
+	close(q[0]);
+	close(q[1]);
+}
+
+/* Runs the library inside of the loop of the application */
+void test_embed(void){
+	struct kact_config cfg = { 0, 0, &kact_mem };
+	struct kact_config ecfg = { 0, 0, &kact_evdev, "" };
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct input_event rec[2];
+	struct pollfd fd;
+	struct keycomb *c;
+	FILE *file;
+	long grabs;
+	int i;
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	c = kact_new_hk(env, mem_func, "ctrl", (int) 'a', NULL);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s", mem_func, NULL, 50) != NULL);
+	grabs = kact_mem_grabs(env);
+
+	mem_calls = 0;
+	fd.fd = kact_fd(env);
+	fd.events = POLLIN;
+	CU_ASSERT(fd.fd >= 0);
+	CU_ASSERT(poll(&fd, 1, 0) == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 0);
+	for(i=0; i<3; i++)
+		kact_mem_inject(env, KeyPress, 'a', ControlMask, i);
+	CU_ASSERT(poll(&fd, 1, 1000) == 1);
+	/* the callbacks run on this thread */
+	CU_ASSERT(kact_dispatch_pending(env, 2) == 2);
+	CU_ASSERT(mem_calls == 2);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	CU_ASSERT(mem_calls == 3);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 0);
+
+	/* the prefix expires without any input */
+	CU_ASSERT(kact_timeout(env) == -1);
+	kact_mem_inject(env, KeyPress, 'x', ControlMask, 10);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	CU_ASSERT(kact_timeout(env) > 0 && kact_timeout(env) <= 50);
+	CU_ASSERT(kact_mem_grabs(env) == grabs + 1);
+	usleep(60000);
+	CU_ASSERT(kact_timeout(env) == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 0);
+	CU_ASSERT(kact_timeout(env) == -1);
+	CU_ASSERT(kact_mem_grabs(env) == grabs);
+
+	/* both modes exclude each other */
+	CU_ASSERT(kact_start(env) == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == -1);
+	CU_ASSERT(kact_stop(env) == 0);
+	CU_ASSERT(kact_clear(env) == 0);
+
+	/* epoll doesn't signal a regular file, the wakeup of the library
+	 	makes the descriptor readable instead */
+	env = kact_init_cfg(&ecfg);
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	c = kact_new_hk(env, mem_func, "ctrl", (int) 'a', NULL);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	memset(rec, 0, sizeof(rec));
+	rec[0].type = EV_KEY;
+	rec[0].code = KEY_LEFTCTRL;
+	rec[0].value = 1;
+	rec[1].type = EV_KEY;
+	rec[1].code = KEY_A;
+	rec[1].value = 1;
+	file = tmpfile();
+	CU_ASSERT(file != NULL);
+	if(file == NULL)
+		return;
+	fwrite(rec, sizeof(rec), 1, file);
+	fflush(file);
+	lseek(fileno(file), 0, SEEK_SET);
+	mem_calls = 0;
+	fd.fd = kact_fd(env);
+	CU_ASSERT(poll(&fd, 1, 0) == 0);
+	CU_ASSERT(kact_evdev_add_fd(env, fileno(file)) == 0);
+	CU_ASSERT(poll(&fd, 1, 0) == 1);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	CU_ASSERT(mem_calls == 1);
+	/* the wakeup has been consumed */
+	CU_ASSERT(poll(&fd, 1, 0) == 0);
+	CU_ASSERT(kact_clear(env) == 0);
+	fclose(file);
+}
+
+/* Two keyact structures share one thread, a third one reads another
+	backend */
+void test_loop(void){
+	struct kact_config cfg = { 0, 0, &kact_mem };
+	struct kact_config ecfg = { 0, 0, &kact_evdev, "" };
+	struct kact_loop *loop = kact_loop_init();
+	struct keyact *env[2], *ev;
+	struct input_event rec[3];
+	struct keycomb *c;
+	unsigned int code;
+	long grabs;
+	int i, p[2];
+
+	CU_ASSERT(loop != NULL);
+	if(loop == NULL)
+		return;
+	mem_calls = 0;
+	for(i=0; i<2; i++){
+		env[i] = kact_init_cfg(&cfg);
+		CU_ASSERT(env[i] != NULL);
+		if(env[i] == NULL)
+			return;
+		c = kact_new_hk(env[i], mem_func, "ctrl", (int) 'a' + i, NULL);
+		CU_ASSERT(kact_reg_hk(c, env[i]) == 0);
+		CU_ASSERT(kact_loop_add(loop, env[i]) == 0);
+	}
+	CU_ASSERT(kact_loop_add(loop, env[0]) == -1);
+	CU_ASSERT(kact_start(env[0]) == -1);
+	CU_ASSERT(kact_reg_seq(env[1], "ctrl+x ctrl+s", mem_func, NULL, 30) 
+			!= NULL);
+	grabs = kact_mem_grabs(env[1]);
+	CU_ASSERT(kact_loop_start(loop) == 0);
+
+	kact_mem_inject(env[0], KeyPress, 'a', ControlMask, 1);
+	kact_mem_inject(env[1], KeyPress, 'b', ControlMask, 1);
+	/* the hotkey of the other instance doesn't match */
+	kact_mem_inject(env[1], KeyPress, 'a', ControlMask, 2);
+	kact_mem_wait(env[0]);
+	kact_mem_wait(env[1]);
+	CU_ASSERT(mem_calls == 2);
+
+	/* the loop wakes up for the expiring prefix */
+	kact_mem_inject(env[1], KeyPress, 'x', ControlMask, 3);
+	kact_mem_wait(env[1]);
+	CU_ASSERT(kact_mem_grabs(env[1]) == grabs + 1);
+	usleep(100000);
+	CU_ASSERT(kact_mem_grabs(env[1]) == grabs);
+
+	/* a removed member is left alone */
+	CU_ASSERT(kact_loop_remove(loop, env[0]) == 0);
+	kact_mem_inject(env[0], KeyPress, 'a', ControlMask, 4);
+	usleep(20000);
+	CU_ASSERT(mem_calls == 2);
+	CU_ASSERT(kact_dispatch_pending(env[0], 10) == 1);
+	CU_ASSERT(mem_calls == 3);
+
+	/* a member on another backend resolves and reads on its own */
+	ev = kact_init_cfg(&ecfg);
+	CU_ASSERT(ev != NULL);
+	if(ev == NULL)
+		return;
+	c = kact_new_hk(ev, mem_func, "ctrl", (int) 'a', NULL);
+	CU_ASSERT(c != NULL && c->internal.keycode == KEY_A + 8);
+	CU_ASSERT(kact_reg_hk(c, ev) == 0);
+	CU_ASSERT(pipe(p) == 0);
+	CU_ASSERT(kact_evdev_add_fd(ev, p[0]) == 0);
+	CU_ASSERT(kact_loop_add(loop, ev) == 0);
+	memset(rec, 0, sizeof(rec));
+	for(i=0; i<3; i++){
+		rec[i].type = EV_KEY;
+		rec[i].code = i == 0 ? KEY_LEFTCTRL : KEY_A;
+		rec[i].value = i < 2;
+	}
+	CU_ASSERT(write(p[1], rec, sizeof(rec)) == sizeof(rec));
+	kact_mem_inject(env[1], KeyPress, 'b', ControlMask, 5);
+	wait_calls(5);
+	CU_ASSERT(mem_calls == 5);
+	CU_ASSERT(kact_clear(ev) == 0);
+	close(p[0]);
+	close(p[1]);
+
+	/* every member opens the display of its configuration */
+	ecfg.backend = &kact_x11;
+	ecfg.display = ":4711";
+	CU_ASSERT(kact_init_cfg(&ecfg) == NULL);
+#ifdef KACT_XCB
+	ecfg.backend = &kact_xcb;
+	CU_ASSERT(kact_init_cfg(&ecfg) == NULL);
+#endif
+	CU_ASSERT(kmap_keycode(":4711", 'a', &code) == -1);
+
+	CU_ASSERT(kact_clear(env[0]) == 0);
+	/* kact_clear removes a member itself */
+	CU_ASSERT(kact_clear(env[1]) == 0);
+	CU_ASSERT(loop->members->len == 0);
+	CU_ASSERT(kact_loop_free(loop) == 0);
+}
+
+static long mark;
+
+int mark_func(void *p){
+	mark = (long) p;
+	return 0;
+}
+
+/* Presses a hotkey on the memory backend and dispatches it
+	Param: k = A valid pointer to a keyact structure
+		key = The keysym
+	Return: The mp of the called hotkey or 0 */
+static long press(struct keyact *k, int key){
+	mark = 0;
+	kact_mem_inject(k, KeyPress, key, ControlMask, 0);
+	kact_mem_inject(k, KeyRelease, key, ControlMask, 0);
+	kact_dispatch_pending(k, 10);
+	return mark;
+}
+
+/* Profiles and unregistering */
+void test_profile(void){
+	struct kact_config cfg = { 0, 0, &kact_mem };
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct arena_stats before, after;
+	struct keycomb *g, *g2, *g3, *c;
+	int i, rc;
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	g = kact_new_hk(env, mark_func, "ctrl", (int) 'g', (void *) 1);
+	CU_ASSERT(kact_reg_hk(g, env) == 0);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s", mark_func, (void *) 2, 0)
+			!= NULL);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'a', (void *) 10);
+	CU_ASSERT(kact_profile_add(env, "edit", c) == 0);
+	CU_ASSERT(kact_reg_hk(c, env) == -1);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'b', (void *) 11);
+	CU_ASSERT(kact_profile_add(env, "edit", c) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'b', (void *) 20);
+	CU_ASSERT(kact_profile_add(env, "nav", c) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'c', (void *) 21);
+	CU_ASSERT(kact_profile_add(env, "nav", c) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'g', (void *) 22);
+	CU_ASSERT(kact_profile_add(env, "nav", c) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'x', (void *) 23);
+	CU_ASSERT(kact_profile_add(env, "nav", c) == 0);
+	/* nothing is grabbed before a profile is active */
+	CU_ASSERT(kact_mem_grabs(env) == 2);
+	CU_ASSERT(press(env, 'a') == 0);
+
+	CU_ASSERT(kact_switch_profile(env, "nope") == -1);
+	CU_ASSERT(kact_switch_profile(env, "edit") == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 4);
+	CU_ASSERT(press(env, 'a') == 10);
+	CU_ASSERT(press(env, 'b') == 11);
+
+	/* ctrl+a is dropped, ctrl+b changes its function, ctrl+c is new and
+	 	ctrl+g and ctrl+x are grabbed already */
+	CU_ASSERT(kact_switch_profile(env, "nav") == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 4);
+	CU_ASSERT(press(env, 'a') == 0);
+	CU_ASSERT(press(env, 'b') == 20);
+	CU_ASSERT(press(env, 'c') == 21);
+	CU_ASSERT(press(env, 'g') == 22);
+	CU_ASSERT(kact_switch_profile(env, "nav") == 0);
+
+	/* a binding added to the active profile is live at once */
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'd', (void *) 24);
+	CU_ASSERT(kact_profile_add(env, "nav", c) == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 5);
+	CU_ASSERT(press(env, 'd') == 24);
+	CU_ASSERT(kact_unreg_hk(c, env) == 0);
+	CU_ASSERT(kact_unreg_hk(c, env) == -1);
+	CU_ASSERT(kact_mem_grabs(env) == 4);
+	CU_ASSERT(press(env, 'd') == 0);
+
+	/* the global hotkey and the sequence come back */
+	CU_ASSERT(kact_switch_profile(env, NULL) == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 2);
+	CU_ASSERT(press(env, 'g') == 1);
+	CU_ASSERT(press(env, 'b') == 0);
+
+	/* an older registration takes over again, no matter in which order
+	 	the newer ones go */
+	g2 = kact_new_hk(env, mark_func, "ctrl", (int) 'g', (void *) 3);
+	CU_ASSERT(kact_reg_hk(g2, env) == 0);
+	CU_ASSERT(press(env, 'g') == 3);
+	g3 = kact_new_hk(env, mark_func, "ctrl", (int) 'g', (void *) 4);
+	CU_ASSERT(kact_reg_hk(g3, env) == 0);
+	CU_ASSERT(kact_reg_hk(g3, env) == -1);
+	CU_ASSERT(kact_unreg_hk(g2, env) == 0);
+	CU_ASSERT(press(env, 'g') == 4);
+	/* the last keycomb of the mapping has taken the slot of g2 */
+	CU_ASSERT(env->mapping->len == 2);
+	CU_ASSERT(env->mapping->items[g3->slot] == (void *) g3);
+	CU_ASSERT(kact_unreg_hk(g3, env) == 0);
+	CU_ASSERT(press(env, 'g') == 1);
+	CU_ASSERT(kact_unreg_hk(g, env) == 0);
+	CU_ASSERT(kact_unreg_hk(g, env) == -1);
+	CU_ASSERT(press(env, 'g') == 0);
+	/* only the first stroke of the sequence is left */
+	CU_ASSERT(kact_mem_grabs(env) == 1);
+	CU_ASSERT(env->mapping->len == 0);
+
+	/* switching bindings on and off doesn't grow the arena */
+	CU_ASSERT(kact_reg_hk(g, env) == 0);
+	CU_ASSERT(kact_unreg_hk(g, env) == 0);
+	CU_ASSERT(kact_profile_add(env, "nav", g) == 0);
+	CU_ASSERT(kact_unreg_hk(g, env) == 0);
+	CU_ASSERT(kact_arena_stats(env, &before) == 0);
+	for(i=0, rc=0; i<5000; i++){
+		rc += kact_reg_hk(g, env);
+		rc += kact_unreg_hk(g, env);
+		rc += kact_profile_add(env, "nav", g);
+		rc += kact_unreg_hk(g, env);
+	}
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(kact_arena_stats(env, &after) == 0);
+	CU_ASSERT(after.allocs == before.allocs);
+	CU_ASSERT(after.used == before.used);
+	CU_ASSERT(env->mapping->len == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 1);
+	CU_ASSERT(kact_clear(env) == 0);
+}
+
+/* Resolved hotkeys are taken from a cache file */
+void test_cache(void){
+	struct kact_config cfg = { 0, 0, &kact_mem };
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct kcache_head head;
+	struct kcache_rec rec;
+	struct keycomb *c;
+	char path[64];
+	int fd;
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	sprintf(path, "/tmp/kacttest-%d.cache", (int) getpid());
+	unlink(path);
+	CU_ASSERT(kact_cache_load(env, path) == -1);
+	c = kact_new_hk(env, mem_func, "ctrl,alt", (int) 'a', NULL);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	c = kact_new_hk(env, mem_func, "shift", (int) 'b', NULL);
+	CU_ASSERT(kact_profile_add(env, "edit", c) == 0);
+	CU_ASSERT(kact_cache_save(env, path) == 0);
+	CU_ASSERT(kact_clear(env) == 0);
+
+	/* a changed keycode in the file proves that nothing is resolved */
+	fd = open(path, O_RDWR);
+	CU_ASSERT(fd >= 0);
+	CU_ASSERT(read(fd, &head, sizeof(head)) == sizeof(head));
+	CU_ASSERT(head.count == 2);
+	CU_ASSERT(read(fd, &rec, sizeof(rec)) == sizeof(rec));
+	rec.keycode = 4711;
+	CU_ASSERT(pwrite(fd, &rec, sizeof(rec), sizeof(head)) == sizeof(rec));
+
+	env = kact_init_cfg(&cfg);
+	CU_ASSERT(kact_cache_load(env, path) == 0);
+	c = kact_new_hk(env, mem_func, rec.key == 'a' ? "ctrl,alt" : "shift",
+			(int) rec.key, NULL);
+	CU_ASSERT(c != NULL && c->internal.keycode == 4711);
+	c = kact_new_hk(env, mem_func, "ctrl", (int) 'c', NULL);
+	CU_ASSERT(c != NULL && c->internal.keycode == 'c');
+	c = kact_new_hk(env, mem_func, "ctrl,alt", (int) 'a', NULL);
+	CU_ASSERT(c != NULL && c->internal.mod_mask == (ControlMask | Mod1Mask));
+	CU_ASSERT(kact_clear(env) == 0);
+
+	/* a file of another mapping is ignored */
+	head.fingerprint ^= 1;
+	CU_ASSERT(pwrite(fd, &head, sizeof(head), 0) == sizeof(head));
+	close(fd);
+	env = kact_init_cfg(&cfg);
+	CU_ASSERT(kact_cache_load(env, path) == -1);
+	CU_ASSERT(env->cache == NULL);
+	CU_ASSERT(kact_clear(env) == 0);
+	unlink(path);
+}
+
+/* Writes a keymap file
+	Param: path = The path of the file
+		text = The content
+	Return: nothing */
+static void write_keymap(const char *path, const char *text){
+	FILE *f = fopen(path, "w");
+	CU_ASSERT(f != NULL);
+	if(f == NULL)
+		return;
+	fputs(text, f);
+	fclose(f);
+}
+
+/* Bindings are loaded from a keymap file */
+void test_keymap(void){
+	struct kact_config cfg = { 0, 0, &kact_mem };
+	struct keyact *env = kact_init_cfg(&cfg);
+	const struct kact_action actions[] = {
+		{ "one", mark_func, (void *) 1 },
+		{ "two", mark_func, (void *) 2 },
+		{ "one", mark_func, (void *) 3 }
+	};
+	struct kact_keymap_err err;
+	char path[64];
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	sprintf(path, "/tmp/kacttest-%d.keymap", (int) getpid());
+	unlink(path);
+	CU_ASSERT(kact_load_keymap(env, path, actions, 3, &err) == -1);
+	CU_ASSERT(err.line == 0);
+
+	/* the last line needs no newline */
+	write_keymap(path, "# modifiers key action\n\n"
+			"ctrl a one\n"
+			"  ctrl,shift\tb   two # comment\r\n"
+			"ctrl c two#comment\n"
+			"ctrl,alt F5 one");
+	CU_ASSERT(kact_load_keymap(env, path, actions, 3, &err) == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 4);
+	CU_ASSERT(press(env, 'a') == 3);
+	CU_ASSERT(press(env, 'c') == 2);
+	mark = 0;
+	kact_mem_inject(env, KeyPress, 'b', ControlMask | ShiftMask, 0);
+	kact_dispatch_pending(env, 10);
+	CU_ASSERT(mark == 2);
+
+	/* an invalid line rejects the whole file */
+	write_keymap(path, "ctrl d one\nctrl e\n");
+	CU_ASSERT(kact_load_keymap(env, path, actions, 3, &err) == -1);
+	CU_ASSERT(err.line == 2);
+	write_keymap(path, "ctrl d one\n\nctrl e one two\n");
+	CU_ASSERT(kact_load_keymap(env, path, actions, 3, &err) == -1);
+	CU_ASSERT(err.line == 3);
+	write_keymap(path, "ctrl d three\n");
+	CU_ASSERT(kact_load_keymap(env, path, actions, 3, &err) == -1);
+	CU_ASSERT(err.line == 1);
+	CU_ASSERT(!strcmp(err.msg, "unknown action"));
+	write_keymap(path, "# nothing\nctrl NoSuchKey one\n");
+	CU_ASSERT(kact_load_keymap(env, path, actions, 3, &err) == -1);
+	CU_ASSERT(err.line == 2);
+	write_keymap(path, "hyper d one\n");
+	CU_ASSERT(kact_load_keymap(env, path, actions, 3, &err) == -1);
+	CU_ASSERT(err.line == 1);
+	CU_ASSERT(kact_mem_grabs(env) == 4);
+	CU_ASSERT(press(env, 'd') == 0);
+
+	/* an empty file registers nothing */
+	write_keymap(path, "");
+	CU_ASSERT(kact_load_keymap(env, path, actions, 3, &err) == 0);
+	unlink(path);
+	CU_ASSERT(kact_clear(env) == 0);
+}
+
+static int calls;
+
+int count_func(void *p){
+	calls++;
+	return 0;
+}
+
+/* Dispatched events are recorded and replayed */
+void test_record(void){
+	struct kact_config cfg = { 0, 0, &kact_mem };
+	struct keyact *env = kact_init_cfg(&cfg), *env2;
+	struct kact_replay_stats st;
+	struct kact_loop *loop;
+	const struct krec_event *e;
+	struct krec *r;
+	struct keycomb *c;
+	char path[64];
+	long start;
+	int i;
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	sprintf(path, "/tmp/kacttest-%d.rec", (int) getpid());
+	c = kact_new_hk(env, count_func, "ctrl", (int) 'a', NULL);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	CU_ASSERT(kact_record_stop(env) == -1);
+	CU_ASSERT(kact_record_start(env, path, 0) == -1);
+	CU_ASSERT(kact_record_start(env, path, 8) == 0);
+	CU_ASSERT(kact_record_start(env, path, 8) == -1);
+	/* two batches, 30 ms apart */
+	for(i=0; i<2; i++){
+		kact_mem_inject(env, KeyPress, 'a', ControlMask, 100 + i);
+		kact_mem_inject(env, KeyRelease, 'a', ControlMask, 100 + i);
+		kact_mem_inject(env, KeyPress, 'b', ControlMask, 100 + i);
+		CU_ASSERT(kact_dispatch_pending(env, 10) == 3);
+		if(i == 0)
+			usleep(30000);
+	}
+	CU_ASSERT(kact_record_stop(env) == 0);
+
+	r = krec_open(path);
+	CU_ASSERT(r != NULL);
+	if(r != NULL){
+		CU_ASSERT(krec_len(r) == 6);
+		e = krec_get(r, 2);
+		CU_ASSERT(e != NULL && e->type == KeyPress && e->keycode == 'b' &&
+				e->state == ControlMask && e->time == 100);
+		CU_ASSERT(krec_get(r, 0)->stamp == e->stamp);
+		CU_ASSERT(krec_get(r, 3)->stamp >= e->stamp + 30000);
+		CU_ASSERT(krec_get(r, 6) == NULL);
+		krec_close(r);
+	}
+
+	/* another keyact with the same binding calls it as often */
+	env2 = kact_init_cfg(&cfg);
+	c = kact_new_hk(env2, count_func, "ctrl", (int) 'a', NULL);
+	CU_ASSERT(kact_reg_hk(c, env2) == 0);
+	calls = 0;
+	CU_ASSERT(kact_replay(env2, path, KACT_REPLAY_FAST, &st) == 6);
+	CU_ASSERT(calls == 2);
+	CU_ASSERT(st.events == 6);
+	CU_ASSERT(st.batches == 2);
+	CU_ASSERT(st.p50_ns <= st.p99_ns && st.p99_ns <= st.max_ns);
+	CU_ASSERT(st.ns < 30000000UL);
+	CU_ASSERT(env2->stats.matches == 2);
+	CU_ASSERT(env2->stats.misses == 2);
+	start = now_ms();
+	CU_ASSERT(kact_replay(env2, path, KACT_REPLAY_TIMED, &st) == 6);
+	CU_ASSERT(now_ms() - start >= 30);
+	CU_ASSERT(st.ns >= 30000000UL);
+	CU_ASSERT(calls == 4);
+	CU_ASSERT(kact_replay(env2, path, 2, NULL) == -1);
+	/* nor while a shared loop reads the backend */
+	loop = kact_loop_init();
+	CU_ASSERT(kact_loop_add(loop, env2) == 0);
+	CU_ASSERT(kact_replay(env2, path, KACT_REPLAY_FAST, NULL) == -1);
+	CU_ASSERT(calls == 4);
+	CU_ASSERT(kact_loop_remove(loop, env2) == 0);
+	CU_ASSERT(kact_loop_free(loop) == 0);
+	CU_ASSERT(kact_clear(env2) == 0);
+
+	/* a full ring keeps the latest events */
+	CU_ASSERT(kact_record_start(env, path, 4) == 0);
+	for(i=0; i<6; i++)
+		kact_mem_inject(env, KeyPress, 'c', 0, i);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 6);
+	r = krec_open(path);
+	CU_ASSERT(r != NULL);
+	if(r != NULL){
+		CU_ASSERT(krec_len(r) == 4);
+		CU_ASSERT(krec_get(r, 0)->time == 2);
+		CU_ASSERT(krec_get(r, 3)->time == 5);
+		krec_close(r);
+	}
+	/* kact_clear stops the recording */
+	CU_ASSERT(kact_clear(env) == 0);
+	CU_ASSERT(kact_replay(NULL, path, KACT_REPLAY_FAST, NULL) == -1);
+	unlink(path);
+}
+
+static int ring_calls;
+
+int slow_func(void *p){
+	usleep(1000);
+	__atomic_add_fetch(&ring_calls, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+static int ring_blocked;
+
+/* Keeps the dispatcher busy until kact_stop has been called on p */
+int stop_func(void *p){
+	int i;
+	__atomic_store_n(&ring_blocked, 1, __ATOMIC_SEQ_CST);
+	for(i=0; i<2000 && !__atomic_load_n(&((struct keyact *) p)->cancel, 
+			__ATOMIC_SEQ_CST); i++)
+		usleep(1000);
+	__atomic_add_fetch(&ring_calls, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+/* Waits up to two seconds until n presses have been called or dropped
+	Param: k = A valid pointer to a keyact structure
+		n = The number of presses
+	Return: nothing */
+static void wait_ring(struct keyact *k, int n){
+	int i;
+	for(i=0; i<2000 && __atomic_load_n(&ring_calls, __ATOMIC_SEQ_CST) + 
+			(int) __atomic_load_n(&k->stats.ring_dropped, 
+			__ATOMIC_SEQ_CST) < n; i++)
+		usleep(1000);
+}
+
+/* The loop hands the events to a dispatcher by a ring */
+void test_ring(void){
+	struct kact_config cfg = { 0, 0, &kact_mem, NULL, NULL, 4,
+			KACT_RING_BLOCK };
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct kact_stats st;
+	struct keycomb *c;
+	int i;
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	CU_ASSERT(env->ring != NULL && env->ring->mask == 3);
+	c = kact_new_hk(env, slow_func, "ctrl", (int) 'a', NULL);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s", slow_func, NULL, 0) 
+			!= NULL);
+
+	/* the reader waits for the slow dispatcher, nothing is lost */
+	ring_calls = 0;
+	CU_ASSERT(kact_start(env) == 0);
+	for(i=0; i<32; i++)
+		kact_mem_inject(env, KeyPress, 'a', ControlMask, i);
+	kact_mem_inject(env, KeyRelease, 'a', ControlMask, 32);
+	wait_ring(env, 32);
+	CU_ASSERT(ring_calls == 32);
+	/* the dispatcher owns the prefix of a sequence */
+	kact_mem_inject(env, KeyPress, 'x', ControlMask, 40);
+	kact_mem_inject(env, KeyPress, 's', ControlMask, 41);
+	wait_ring(env, 33);
+	CU_ASSERT(ring_calls == 33);
+	CU_ASSERT(kact_mem_grabs(env) == 2);
+	CU_ASSERT(kact_stats(env, &st) == 0);
+	CU_ASSERT(st.ring_dropped == 0);
+	CU_ASSERT(st.ring_waits > 0);
+	CU_ASSERT(st.ring_max > 0 && st.ring_max <= 4);
+	CU_ASSERT(st.matches == 34);
+	/* kact_stop dispatches the events which are still in the ring. The
+	 	dispatcher is held up until the ring is full and stop is called */
+	c = kact_new_hk(env, stop_func, "ctrl", (int) 'b', (void *) env);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	ring_blocked = 0;
+	kact_mem_inject(env, KeyPress, 'b', ControlMask, 42);
+	for(i=0; i<2000 && !__atomic_load_n(&ring_blocked, __ATOMIC_SEQ_CST); 
+			i++)
+		usleep(1000);
+	for(i=0; i<4; i++)
+		kact_mem_inject(env, KeyPress, 'a', ControlMask, 43 + i);
+	for(i=0; i<2000 && kring_len(env->ring) < 4; i++)
+		usleep(1000);
+	CU_ASSERT(kring_len(env->ring) == 4);
+	CU_ASSERT(kact_stop(env) == 0);
+	CU_ASSERT(ring_calls == 38);
+	CU_ASSERT(kring_len(env->ring) == 0);
+	/* the loop and the dispatcher can be restarted */
+	CU_ASSERT(kact_start(env) == 0);
+	kact_mem_inject(env, KeyPress, 'a', ControlMask, 50);
+	wait_ring(env, 39);
+	CU_ASSERT(ring_calls == 39);
+	CU_ASSERT(kact_clear(env) == 0);
+
+	/* presses are dropped instead, the rest still arrives */
+	cfg.ring_len = 2;
+	cfg.ring_policy = KACT_RING_DROP;
+	env = kact_init_cfg(&cfg);
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	c = kact_new_hk(env, slow_func, "ctrl", (int) 'a', NULL);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	ring_calls = 0;
+	CU_ASSERT(kact_start(env) == 0);
+	for(i=0; i<32; i++)
+		kact_mem_inject(env, KeyPress, 'a', ControlMask, i);
+	kact_mem_inject(env, KeyRelease, 'a', ControlMask, 32);
+	wait_ring(env, 32);
+	CU_ASSERT(kact_stats(env, &st) == 0);
+	CU_ASSERT(st.ring_dropped > 0);
+	CU_ASSERT(ring_calls + st.ring_dropped == 32);
+	CU_ASSERT(st.ring_max <= 2);
+	CU_ASSERT(kact_clear(env) == 0);
+
+	cfg.ring_len = 0;
+	env = kact_init_cfg(&cfg);
+	CU_ASSERT(env != NULL && env->ring == NULL);
+	CU_ASSERT(kact_clear(env) == 0);
+}
+
+/* The bindings follow a change of the keyboard mapping */
+void test_remap(void){
+	struct kact_config cfg = { 0, 0, &kact_mem };
+	struct keyact *env = kact_init_cfg(&cfg);
+	struct keycomb *c, *old;
+	struct arena_stats before, after;
+
+	CU_ASSERT(env != NULL);
+	if(env == NULL)
+		return;
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'a', (void *) 1);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'b', (void *) 2);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'c', (void *) 10);
+	CU_ASSERT(kact_profile_add(env, "edit", c) == 0);
+	CU_ASSERT(kact_switch_profile(env, "edit") == 0);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+x ctrl+s", mark_func, (void *) 3, 0)
+			!= NULL);
+	CU_ASSERT(kact_reg_seq(env, "ctrl+e ctrl+f", mark_func, (void *) 4, 0)
+			!= NULL);
+	CU_ASSERT(kact_mem_grabs(env) == 5);
+
+	/* the key of ctrl+a produces 'q' now, the sequences stay untouched */
+	kact_arena_stats(env, &before);
+	CU_ASSERT(kact_mem_swap(env, 'a', 'q') == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	kact_arena_stats(env, &after);
+	CU_ASSERT(after.allocs == before.allocs);
+	CU_ASSERT(kact_mem_grabs(env) == 5);
+	CU_ASSERT(press(env, 'a') == 0);
+	CU_ASSERT(press(env, 'q') == 1);
+
+	/* a global hotkey and a binding of the profile trade their keys */
+	CU_ASSERT(kact_mem_swap(env, 'b', 'c') == 0);
+	CU_ASSERT(press(env, 'b') == 10);
+	CU_ASSERT(press(env, 'c') == 2);
+	CU_ASSERT(kact_mem_grabs(env) == 5);
+
+	/* the sequence is recompiled, an active prefix is dropped. Only its
+	 	two states are new, the other sequence keeps its states */
+	kact_arena_stats(env, &before);
+	CU_ASSERT(kact_mem_swap(env, 'x', 'y') == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	kact_arena_stats(env, &after);
+	CU_ASSERT(after.allocs == before.allocs + 2);
+	CU_ASSERT(press(env, 'x') == 0);
+	CU_ASSERT(press(env, 'y') == 0);
+	CU_ASSERT(press(env, 's') == 3);
+	CU_ASSERT(press(env, 'y') == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 6);
+	CU_ASSERT(kact_mem_swap(env, 'a', 'q') == 0);
+	CU_ASSERT(press(env, 's') == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 5);
+	CU_ASSERT(press(env, 'a') == 1);
+	CU_ASSERT(press(env, 'e') == 0);
+	CU_ASSERT(press(env, 'f') == 4);
+
+	/* nothing moves without a change, the arena doesn't grow either */
+	kact_arena_stats(env, &before);
+	CU_ASSERT(kact_mem_inject(env, MappingNotify, 0, 0, 0) == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	kact_arena_stats(env, &after);
+	CU_ASSERT(after.allocs == before.allocs);
+	CU_ASSERT(after.used == before.used);
+	CU_ASSERT(kact_mem_grabs(env) == 5);
+	CU_ASSERT(press(env, 'a') == 1);
+
+	/* the profile is diffed against the moved keys */
+	CU_ASSERT(kact_switch_profile(env, NULL) == 0);
+	CU_ASSERT(kact_mem_grabs(env) == 4);
+	CU_ASSERT(press(env, 'b') == 0);
+	CU_ASSERT(press(env, 'c') == 2);
+
+	/* the registrations of a hotkey keep their order when they move,
+	 	even though the mapping holds the latest one first */
+	old = kact_new_hk(env, mark_func, "ctrl", (int) 'o', (void *) 8);
+	CU_ASSERT(kact_reg_hk(old, env) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'm', (void *) 5);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'n', (void *) 6);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'm', (void *) 7);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	CU_ASSERT(kact_unreg_hk(old, env) == 0);
+	CU_ASSERT(c->slot == env->mapping->len - 3);
+	CU_ASSERT(kact_mem_swap(env, 'm', 'n') == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	CU_ASSERT(press(env, 'n') == 7);
+	CU_ASSERT(press(env, 'm') == 6);
+	CU_ASSERT(kact_unreg_hk(c, env) == 0);
+	CU_ASSERT(press(env, 'n') == 5);
+
+	/* only the bindings of moved keysyms are resolved again: the new
+	 	modifier of c counts once its key has moved */
+	c = kact_new_hk(env, mark_func, "ctrl", (int) 'u', (void *) 9);
+	CU_ASSERT(kact_reg_hk(c, env) == 0);
+	strcpy(c->user_mod, "alt");
+	CU_ASSERT(kact_mem_swap(env, 'v', 'w') == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	CU_ASSERT(press(env, 'u') == 9);
+	CU_ASSERT(kact_mem_swap(env, 'u', 'v') == 0);
+	CU_ASSERT(kact_dispatch_pending(env, 10) == 1);
+	CU_ASSERT(((struct kact_sym *) hk_table_get(env->syms, 'u'))->keycode
+			== 'v');
+	CU_ASSERT(press(env, 'v') == 0);
+	CU_ASSERT(c->internal.keycode == 'v' && c->internal.mod_mask == Mod1Mask);
+	CU_ASSERT(kact_unreg_hk(c, env) == 0);
+	CU_ASSERT(hk_table_get(env->syms, 'u') == NULL);
+	CU_ASSERT(kact_clear(env) == 0);
+}
+
 /* Required calls to CUnit. Test will be registered  */
 int main(int argc, char **argv){
 	/* Initialize and build a Testsuite */
@@ -530,7 +3631,23 @@ int main(int argc, char **argv){
 	/* Adds tests */
 	if((NULL == CU_add_test(pSuite, "Initialisierungstest", test_init)) || 
 		(NULL == CU_add_test(pSuite, "Usagetest2", test_mod)) || 
-		(NULL == CU_add_test(pSuite, "Usagetest", test_usage))
+		(NULL == CU_add_test(pSuite, "Usagetest", test_usage)) ||
+#ifdef KACT_XCB
+		(NULL == CU_add_test(pSuite, "XCB-Backend", test_xcb)) ||
+#endif
+#ifdef KACT_XI2
+		(NULL == CU_add_test(pSuite, "XI2-Backend", test_xi2)) ||
+#endif
+		(NULL == CU_add_test(pSuite, "Speicherbackend", test_mem)) ||
+		(NULL == CU_add_test(pSuite, "Evdev-Backend", test_evdev)) ||
+		(NULL == CU_add_test(pSuite, "Eingebettet", test_embed)) ||
+		(NULL == CU_add_test(pSuite, "Gemeinsame Schleife", test_loop)) ||
+		(NULL == CU_add_test(pSuite, "Profile", test_profile)) ||
+		(NULL == CU_add_test(pSuite, "Keymap-Cache", test_cache)) ||
+		(NULL == CU_add_test(pSuite, "Tastaturbelegung", test_remap)) ||
+		(NULL == CU_add_test(pSuite, "Keymap-Datei", test_keymap)) ||
+		(NULL == CU_add_test(pSuite, "Aufzeichnung", test_record)) ||
+		(NULL == CU_add_test(pSuite, "Ringpuffer", test_ring))
 	)
 
 	{
@@ -1,5 +1,17 @@
 #define DELIM ", "
-#define SLEEP_TIME 100
+#define QUEUE_LEN 64
+#define BATCH_LEN 64
+#define ARENA_CHUNK 4096
+#define SEQ_LEN 8
+#define SEQ_TIMEOUT 1000
+#define HELD_LEN 256
+#define HIST_LEN 24
+
+/* repeat policies of a keycomb */
+#define REPEAT_ALL 0
+#define REPEAT_ONCE 1
+#define REPEAT_RATE 2
+#define REPEAT_COUNT 3
 
 
 /* Library usage explained.
@@ -11,27 +23,234 @@
 
    If you've done that, you should add some hotkeys. This can be done by 
    using the Function kact_get_hk(...) which returns an instanciated 
-   keycomb structure. The member internal represents the hotkey in an
+   keycomb structure. It belongs to you, so you have to free it after
+   kact_clear. kact_new_hk(...) does the same, but places the keycomb in
+   the arena of the keyact structure, which is freed by kact_clear as a
+   whole. kact_arena_stats(...) tells you how much memory the arena
+   occupies. The member internal represents the hotkey in an
    platformindependent manner. The resulting structure pointer has to be
    passed to kact_reg_hk(...) which inserts it into the singly linked
-   list. While it does this you could have startet the eventloop already
-   because kact_reg_hk uses a mutex to synchronize it's access with
-   the loop.
+   list and publishes a new snapshot of the hash table which is used for
+   the lookup of the hotkeys in the event loop. While it does this you
+   could have startet the eventloop already, because the loop never
+   locks. It just keeps reading the old snapshot until the new one has
+   been published. If you have many hotkeys, pass them all at once to
+   kact_reg_hk_batch(...). It needs only one round trip to the x-server
+   and tells you which of the hotkeys could not be grabbed.
+
+   kact_unreg_hk(...) removes a single hotkey again. If it shadowed an
+   older registration of the same hotkey, that one becomes active again.
+
+   Bindings which belong to a mode of your application are collected in
+   named profiles by kact_profile_add(...). Only the bindings of the
+   active profile are grabbed, they shadow the global hotkeys of the same
+   keys. kact_switch_profile(...) activates another profile. It grabs
+   and ungrabs only the keys which differ between both profiles, in a
+   single batch, and publishes the new table at once, so the loop sees
+   either the old or the new profile.
+
+   If the keyboard mapping changes, e.g. by a switch of the layout, the
+   loop resolves all bindings again from their keysyms and modifiers.
+   Only the keys whose bindings have moved are ungrabbed and grabbed, and
+   the new table is published at once like any other change.
+
+   Bindings which come from a configuration don't have to be created one
+   by one. kact_load_keymap(...) reads a text file of modifiers, keys and
+   action names, looks the actions up in a table you pass and registers
+   all bindings in one batch. If a line is invalid, nothing is registered
+   and you get the number of that line, see kbind.h.
+
+   Resolving the hotkeys can be skipped on the next start. Write them
+   into a file by kact_cache_save(...) once they are registered. If
+   kact_cache_load(...) maps that file before the hotkeys are created,
+   kact_new_hk(...) takes them from the file as long as the keyboard
+   mapping is still the one the file was written for, see kcache.h.
+
+   kact_record_start(...) appends every dispatched event to a ring in a
+   file until kact_record_stop(...). kact_replay(...) dispatches such a
+   recording again, at its original pace or as fast as possible, and
+   reports the throughput and the latency of the dispatch, see krec.h.
+
+   Holding a hotkey down calls its function for every repeated press. 
+   kact_set_repeat(...) lets you call it only once per press, at most 
+   every few milliseconds or once on release with the number of presses.
+
+   kact_stats(...) returns a snapshot of the counters and latency
+   histograms of the library at any time without disturbing the loop.
+   kact_hk_stats(...) tells you how long the function of a single hotkey
+   takes.
+
+   Sequences of keystrokes like "ctrl+x ctrl+s" are registered by
+   kact_reg_seq(...). After a prefix has been typed the loop waits for
+   the next stroke until the timeout of the prefix expires.
+
+   If your callbacks might take a while, initialize the library with
+   kact_init_cfg(...) instead and request some worker threads. The event
+   loop then only queues the matching hotkeys and the workers call the
+   functions. Invocations of the same hotkey are always executed in the
+   order in which they occured.
+
+   Even then a burst of events waits while the loop looks its hotkeys
+   up. Set ring_len of kact_config and kact_start(...) runs two threads:
+   one only reads the events and hands them over by a lock free ring,
+   the other one matches and dispatches them. ring_policy decides whether
+   the reader waits or drops presses if the ring is full, kact_stats(...)
+   counts both.
+
+   The key events are read from the x-server by default. Another input
+   backend can be selected by the member backend of kact_config. 
+   kact_xcb talks to the x-server by XCB instead of Xlib and never
+   blocks on it except for a single round trip per batch of grabs, it is
+   only built with make XCB=1. 
+   kact_xi2 doesn't grab anything, it watches the raw key events and
+   leaves the keys to the focused client. kact_evdev reads the keyboards
+   in /dev/input directly and works without any x-server. The
+   backend kact_mem reads the events injected by kact_mem_inject(...) 
+   and needs neither a display nor a keyboard, see kbackend.h.
 
    Now it's the time you should start the event loop by calling 
    kact_start(...). It will run as long as you don't call kact_clear
    or kact_stop. While kact_stop just stops the event loop, kact_clear
    stops it too, but also removes all ressources it occupied including
-   the list containing your hotkey <-> function mappings.
+   the list containing your hotkey <-> function mappings. Both functions
+   return after the thread of the loop has terminated. After kact_stop
+   the loop can be started again.
+
+   If your application has an event loop of its own, don't start the
+   loop at all. Poll the descriptor of kact_fd(...) instead, with the
+   timeout of kact_timeout(...), and call kact_dispatch_pending(...)
+   whenever it is readable or the timeout has expired. The hotkeys are
+   then called by your thread. The descriptor also becomes readable if
+   the library itself has something to do, e.g. events which Xlib
+   buffered during a registration.
+
+   Many keyact structures, e.g. one per seat or display, can share a
+   single thread. Add them to a kact_loop by kact_loop_add(...) instead
+   of starting their own loops, see kloop.h. The member display of
+   kact_config selects the x-server of each of them.
  */
 
+/* Options for kact_init_cfg. A zeroed structure results in the
+   behaviour of kact_init */
+struct kact_config {
+	/* number of threads executing the callbacks. 0 means that the
+	   callbacks are called by the event loop itself */
+	unsigned int workers;
+	/* number of pending calls per worker, 0 means QUEUE_LEN */
+	unsigned int queue_len;
+	/* source of the key events, see kbackend.h. NULL means kact_x11 */
+	const struct kact_backend *backend;
+	/* input device of kact_evdev. NULL means all keyboards, "" none */
+	const char *device;
+	/* display of kact_x11, kact_xcb and kact_xi2, e.g. ":1". NULL means
+	   $DISPLAY. The keysyms are resolved by the mapping of that display */
+	const char *display;
+	/* events between the thread reading the backend and a second thread
+	   dispatching them, see kring.h. 0 means that kact_start runs a
+	   single thread which does both */
+	unsigned int ring_len;
+	/* KACT_RING_BLOCK or KACT_RING_DROP, what happens if it is full */
+	int ring_policy;
+};
+
+/* Histogram of durations in microseconds. buckets[i] counts the values
+   between 2^i - 1 and 2^(i+1) - 2, the last bucket everything above */
+struct kact_hist {
+	unsigned long count;
+	unsigned long sum;
+	unsigned long max;
+	unsigned long buckets[HIST_LEN];
+};
+
+/* Counters of a keyact structure. Only consists of unsigned longs, 
+   see kact_stats */
+struct kact_stats {
+	/* number of times the event loop woke up and number of key events
+	   it handled. events / wakeups is the average batch size */
+	unsigned long wakeups;
+	unsigned long events;
+	/* KeyPress events which did and did not belong to a hotkey */
+	unsigned long matches;
+	unsigned long misses;
+	/* KeyPress events dropped because the ring was full, how often the
+	   reader waited for room in it and the most events it ever held */
+	unsigned long ring_dropped;
+	unsigned long ring_waits;
+	unsigned long ring_max;
+	/* from the time stamp of the event to the entry of the function.
+	   The clock of the x-server is mapped to the local one by the
+	   smallest offset seen so far */
+	struct kact_hist latency;
+	/* how long the loop waited for room in the queue of a worker */
+	struct kact_hist push_wait;
+	/* how long the functions of the hotkeys took */
+	struct kact_hist callback;
+};
+
 /* depends on platform and/or api */
 struct keyact {
 	pthread_t *event_loop;
+	/* the thread dispatching the events of ring or NULL */
+	pthread_t *dispatcher;
 	pthread_mutex_t *mutex;
-	Display *display;
+	/* the input backend and its private data, e.g. the display */
+	const struct kact_backend *be;
+	void *be_data;
 	int cancel;
-	struct slist *mapping;
+	/* written by kact_stop to wake the event loop up */
+	int wakeup[2];
+	/* watches the descriptor of the backend and wakeup[0], see kact_fd */
+	int epfd;
+	/* the registered keycombs in no particular order, see kvec.h */
+	struct kvec *mapping;
+	/* latest global registration per hotkey, only touched by writers.
+	   The older ones are chained behind it */
+	struct hk_table *globals;
+	/* counts the registrations, it orders the chains of globals */
+	unsigned long regs;
+	/* keysym -> struct kact_sym of every binding and the modifier names
+	   they use, so a new keyboard mapping resolves only what has moved */
+	struct hk_table *syms;
+	struct kvec *mods;
+	/* all profiles and the active one or NULL */
+	struct slist *profiles;
+	struct kact_profile *profile;
+	/* immutable snapshot which is read by the event loop. Writers
+	   publish a modified copy and retire the old one */
+	struct hk_table *table;
+	/* transitions of the sequence automaton, published like table */
+	struct hk_table *seqs;
+	unsigned int seq_ids;
+	/* active prefix and when it expires. Owned by the event loop */
+	struct seq_state *seq_cur;
+	long seq_deadline;
+	/* hotkey currently held down per keycode. Owned by the event loop */
+	struct keycomb *held[HELD_LEN];
+	/* the backend has been set up for dispatching */
+	int ready;
+	/* the shared loop which dispatches k or NULL, see kloop.h */
+	struct kact_loop *loop;
+	struct slist *retired;
+	int readers;
+	struct kpool *pool;
+	/* owns all keycombs created by kact_new_hk */
+	struct arena *arena;
+	/* resolved hotkeys of a previous run or NULL, see kcache.h */
+	struct kcache *cache;
+	/* the recording the dispatched events are appended to or NULL, see
+	   krec.h */
+	struct krec *rec;
+	/* hands the events from the loop to the dispatcher or NULL, see
+	   kact_config.ring_len */
+	struct kring *ring;
+	int ring_policy;
+	/* set by kact_stop once the event loop has stopped pushing, the
+	   dispatcher drains the ring before it exits */
+	int ring_done;
+	/* updated by the event loop and the workers, read by kact_stats */
+	struct kact_stats stats;
+	/* maps the x-server time of events to now_us. Owned by the loop */
+	long time_offset;
 };
 
 struct hotkey {
@@ -39,6 +258,15 @@ struct hotkey {
 	unsigned int mod_mask;
 };
 
+/* a key event as it has been read by the event loop. MappingNotify
+   tells that the keyboard mapping has changed, see kbackend.h */
+struct kact_event {
+	int type;
+	unsigned int keycode;
+	unsigned int state;
+	unsigned long time;
+};
+
 struct x11_mask {
 	char modstr[30];
 	int mask;
@@ -51,18 +279,118 @@ struct keycomb {
 	int key;
 	struct hotkey internal;
 	void *mod_param;
+	/* repeat policy, see kact_set_repeat */
+	int repeat;
+	unsigned int interval;
+	int (*count_func)(void *mod_param, unsigned int count);
+	/* time of the last call and the number of presses. Only touched by 
+	   the event loop */
+	unsigned long last;
+	unsigned int count;
+	/* the profile the keycomb belongs to or NULL */
+	struct kact_profile *profile;
+	/* set by the registration. The index in mapping and the newer and
+	   older registrations of the same hotkey */
+	size_t slot;
+	unsigned long order;
+	struct keycomb *newer;
+	struct keycomb *older;
+	/* set by the registration. The calls of the function and their 
+	   total and maximal duration in microseconds */
+	struct kact_stats *stats;
+	unsigned long calls;
+	unsigned long call_sum;
+	unsigned long call_max;
+};
+
+/* The bindings of a keysym, registered or part of a profile, and the
+   keycode of the keysym when it has been resolved last */
+struct kact_sym {
+	unsigned int keycode;
+	struct kvec *combs;
+};
+
+/* A modifier name used by a binding and its resolved mask */
+struct kact_mod {
+	unsigned int mask;
+	char name[];
+};
+
+/* A named set of bindings, see kact_switch_profile */
+struct kact_profile {
+	char *name;
+	/* packed hotkey -> keycomb, one binding per hotkey */
+	struct hk_table *binds;
+};
+
+/* A state of the sequence automaton. The state is entered by a prefix
+   of a sequence and left by one of the strokes in next. If it is the
+   end of a sequence, comb holds the sequence instead */
+struct seq_state {
+	unsigned int id;
+	unsigned int timeout;
+	struct keycomb *comb;
+	size_t nnext;
+	struct hotkey next[];
 };
 
+/* see arena.h */
+struct arena_stats;
+
+/* see kbackend.h */
+struct kact_backend;
+
+/* see kcache.h */
+struct kcache;
+
+/* see krec.h */
+struct krec;
+
+/* see kring.h */
+struct kring;
+
 int kact_reg_hk(struct keycomb *c, struct keyact *k);
 
+struct keycomb *kact_reg_seq(struct keyact *k, const char *seq, 
+		int (*func)(void *mp), void *mp, unsigned int timeout);
+
+int kact_reg_hk_batch(struct keycomb **c, size_t n, struct keyact *k, 
+		int *rc);
+
+int kact_unreg_hk(struct keycomb *c, struct keyact *k);
+
+int kact_profile_add(struct keyact *k, const char *name, struct keycomb *c);
+
+int kact_switch_profile(struct keyact *k, const char *name);
+
 struct keycomb *kact_get_hk(int (*func)(void *mp), const char *mod, int key, 
 									void *mp);
 
+struct keycomb *kact_new_hk(struct keyact *k, int (*func)(void *mp), 
+		const char *mod, int key, void *mp);
+
+int kact_set_repeat(struct keycomb *c, int policy, unsigned int interval, 
+		int (*count_func)(void *mp, unsigned int count));
+
+int kact_arena_stats(struct keyact *k, struct arena_stats *st);
+
+int kact_stats(struct keyact *k, struct kact_stats *st);
+
+int kact_hk_stats(struct keycomb *c, struct kact_hist *h);
+
 struct keyact *kact_init();
 
+struct keyact *kact_init_cfg(const struct kact_config *cfg);
+
 int kact_start(struct keyact *k);
 
 int kact_stop(struct keyact *k);
 
 int kact_clear(struct keyact *k);
 
+int kact_fd(struct keyact *k);
+
+int kact_timeout(struct keyact *k);
+
+int kact_dispatch_pending(struct keyact *k, int max);
+
@@ -0,0 +1,276 @@
+/*
+ 0-Software. Dispatches the events of many keyact structures by a single
+ thread. The descriptors of all members are watched by one epoll
+ descriptor and a member which became readable is served by
+ kact_dispatch_pending, so the thread count doesn't grow with the number
+ of seats or displays.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include "keyact.h"
+#include "hktable.h"
+#include "kvec.h"
+#include "kloop.h"
+
+static void *loop_run(void *l);
+static int loop_timeout(struct kact_loop *l);
+static void loop_timed(struct kact_loop *l, struct keyact *k);
+static void loop_wakeup(int fd);
+static void loop_drain(int fd);
+
+/* Initializes a loop without members. The thread is started by
+	kact_loop_start
+	Param: void
+	Return: A valid pointer to a kact_loop structure or NULL on failure */
+struct kact_loop *kact_loop_init(void){
+	struct kact_loop *res = (struct kact_loop *)
+			malloc(sizeof(struct kact_loop));
+	struct epoll_event ev;
+	if(res == NULL)
+		return NULL;
+
+	res->thread = NULL;
+	res->cancel = 0;
+	res->timed = kvec_init(0);
+	res->members = hk_table_init(0);
+	if(res->members == NULL || res->timed == NULL)
+		return NULL;
+	res->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(res->epfd < 0)
+		return NULL;
+	if(pipe(res->wakeup))
+		return NULL;
+	fcntl(res->wakeup[0], F_SETFL, O_NONBLOCK);
+	fcntl(res->wakeup[1], F_SETFL, O_NONBLOCK);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = 0;
+	if(epoll_ctl(res->epfd, EPOLL_CTL_ADD, res->wakeup[0], &ev))
+		return NULL;
+	pthread_mutex_init(&res->mutex, NULL);
+	return res;
+}
+
+/* Adds a keyact structure to the loop. Its descriptor, which covers
+	its wakeup pipe as well, is watched by the loop from now on
+	Param: l = A valid pointer to a kact_loop structure
+		k = A valid pointer to a keyact structure which is neither running
+			its own loop nor a member of another one
+	Return: 0 on success, -1 on failure */
+int kact_loop_add(struct kact_loop *l, struct keyact *k){
+	struct epoll_event ev;
+	uint64_t key = (uint64_t) (uintptr_t) k;
+	if(l == NULL || k == NULL || k->event_loop != NULL || k->loop != NULL)
+		return -1;
+
+	pthread_mutex_lock(&l->mutex);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = key;
+	if(epoll_ctl(l->epfd, EPOLL_CTL_ADD, kact_fd(k), &ev)){
+		pthread_mutex_unlock(&l->mutex);
+		return -1;
+	}
+	if(hk_table_put(l->members, key, (void *) k)){
+		epoll_ctl(l->epfd, EPOLL_CTL_DEL, kact_fd(k), NULL);
+		pthread_mutex_unlock(&l->mutex);
+		return -1;
+	}
+	k->loop = l;
+	pthread_mutex_unlock(&l->mutex);
+
+	/* events might already be buffered by the backend */
+	loop_wakeup(k->wakeup[1]);
+	return 0;
+}
+
+/* Removes a keyact structure from the loop. After this call the loop
+	doesn't touch k anymore. Must not be called by the function of a
+	hotkey
+	Param: l = A valid pointer to a kact_loop structure
+		k = A valid pointer to a member of l
+	Return: 0 on success, -1 on failure */
+int kact_loop_remove(struct kact_loop *l, struct keyact *k){
+	if(l == NULL || k == NULL || k->loop != l)
+		return -1;
+
+	/* the loop holds the mutex while it dispatches */
+	pthread_mutex_lock(&l->mutex);
+	epoll_ctl(l->epfd, EPOLL_CTL_DEL, kact_fd(k), NULL);
+	hk_table_del(l->members, (uint64_t) (uintptr_t) k);
+	kvec_rm_content(l->timed, (void *) k);
+	k->loop = NULL;
+	pthread_mutex_unlock(&l->mutex);
+	return 0;
+}
+
+/* Starts the thread of the loop
+	Param: l = A valid pointer to a kact_loop structure
+	Return: 0 on success, -1 if it is already running or the thread could
+		not be created */
+int kact_loop_start(struct kact_loop *l){
+	pthread_t *thread;
+	if(l == NULL || l->thread != NULL)
+		return -1;
+	thread = (pthread_t *) malloc(sizeof(pthread_t));
+	if(thread == NULL)
+		return -1;
+
+	loop_drain(l->wakeup[0]);
+	l->cancel = 0;
+	if(pthread_create(thread, NULL, loop_run, (void *) l)){
+		free(thread);
+		return -1;
+	}
+	l->thread = thread;
+	return 0;
+}
+
+/* Stops the thread of the loop and waits for it. The members stay
+	Param: l = A valid pointer to a kact_loop structure
+	Return: 0 on success, -1 on failure */
+int kact_loop_stop(struct kact_loop *l){
+	if(l == NULL)
+		return -1;
+	if(l->thread == NULL)
+		return 0;
+
+	__atomic_store_n(&l->cancel, 1, __ATOMIC_SEQ_CST);
+	loop_wakeup(l->wakeup[1]);
+	pthread_join(*l->thread, NULL);
+	free(l->thread);
+	l->thread = NULL;
+	return 0;
+}
+
+/* Stops the loop, removes all members and frees the loop. The members
+	are not freed
+	Param: l = A valid pointer to a kact_loop structure
+	Return: 0 on success, -1 on failure */
+int kact_loop_free(struct kact_loop *l){
+	size_t i;
+	if(l == NULL)
+		return -1;
+
+	kact_loop_stop(l);
+	for(i=0; i<l->members->cap; i++)
+		if(l->members->slots[i].val != NULL)
+			((struct keyact *) l->members->slots[i].val)->loop = NULL;
+	hk_table_free(l->members);
+	close(l->epfd);
+	close(l->wakeup[0]);
+	close(l->wakeup[1]);
+	pthread_mutex_destroy(&l->mutex);
+	kvec_free(l->timed);
+	free(l);
+	return 0;
+}
+
+/* The thread of the loop. Only the members whose descriptors are ready
+	and the members with an expired prefix are dispatched
+	Param: l = A valid pointer to a kact_loop structure
+	Return: (void *) 0 */
+static void *loop_run(void *l){
+	struct kact_loop *loop = (struct kact_loop *) l;
+	struct epoll_event ready[LOOP_EVENTS];
+	struct keyact *k;
+	uint64_t key;
+	int i, n, timeout;
+	size_t j;
+
+	for(;;){
+		pthread_mutex_lock(&loop->mutex);
+		timeout = loop_timeout(loop);
+		pthread_mutex_unlock(&loop->mutex);
+
+		n = epoll_wait(loop->epfd, ready, LOOP_EVENTS, timeout);
+		if(__atomic_load_n(&loop->cancel, __ATOMIC_SEQ_CST))
+			break;
+		if(n < 0 && errno != EINTR)
+			break;
+
+		pthread_mutex_lock(&loop->mutex);
+		for(i=0; i<n; i++){
+			key = ready[i].data.u64;
+			if(key == 0){
+				loop_drain(loop->wakeup[0]);
+				continue;
+			}
+			/* the member might have been removed in the meantime */
+			k = (struct keyact *) hk_table_get(loop->members, key);
+			if(k == NULL)
+				continue;
+			kact_dispatch_pending(k, INT_MAX);
+			loop_timed(loop, k);
+		}
+		/* expired prefixes are reset by kact_dispatch_pending */
+		KVEC_EACH(loop->timed, j)
+			if(kact_timeout((struct keyact *) loop->timed->items[j]) == 0)
+				kact_dispatch_pending((struct keyact *) loop->timed->items[j],
+						INT_MAX);
+		pthread_mutex_unlock(&loop->mutex);
+	}
+	return (void *) 0;
+}
+
+/* Computes how long the loop may wait. Members whose prefix has gone
+	are forgotten. Has to be called with the mutex held
+	Param: l = A valid pointer to a kact_loop structure
+	Return: Milliseconds or -1 for no limit */
+static int loop_timeout(struct kact_loop *l){
+	int t, res = -1;
+	size_t i;
+
+	KVEC_EACH(l->timed, i){
+		t = kact_timeout((struct keyact *) l->timed->items[i]);
+		if(t < 0){
+			kvec_rm_at(l->timed, i--);
+			continue;
+		}
+		if(res < 0 || t < res)
+			res = t;
+	}
+	return res;
+}
+
+/* Remembers a member if it has an active prefix. Has to be called with
+	the mutex held
+	Param: l = A valid pointer to a kact_loop structure
+		k = A member of l
+	Return: nothing */
+static void loop_timed(struct kact_loop *l, struct keyact *k){
+	size_t i;
+	if(kact_timeout(k) < 0)
+		return;
+
+	KVEC_EACH(l->timed, i)
+		if(l->timed->items[i] == (void *) k)
+			return;
+	/* without memory the prefix expires with the next event */
+	kvec_add(l->timed, (void *) k);
+}
+
+/* Param: fd = The write end of a wakeup pipe
+	Return: nothing */
+static void loop_wakeup(int fd){
+	/* a full pipe already wakes the loop up */
+	if(write(fd, "", 1) < 0)
+		return;
+}
+
+/* Param: fd = The read end of a wakeup pipe
+	Return: nothing */
+static void loop_drain(int fd){
+	char buf[16];
+	while(read(fd, buf, sizeof(buf)) > 0)
+		;
+}
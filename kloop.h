@@ -0,0 +1,38 @@
+/*
+ ---one event loop for many keyact structures---
+ ---begin---
+ */
+
+#define LOOP_EVENTS 64
+
+/* A thread which dispatches the events of all of its members. Every
+   member keeps its own hotkeys, sequences and backend, e.g. one keyact
+   per seat or display. Members without input cost nothing */
+struct kact_loop {
+	pthread_t *thread;
+	pthread_mutex_t mutex;
+	int epfd;
+	int wakeup[2];
+	int cancel;
+	/* keyact -> keyact of all members */
+	struct hk_table *members;
+	/* members with an active prefix, they limit the time to wait */
+	struct kvec *timed;
+};
+
+/* build a loop without members */
+struct kact_loop *kact_loop_init(void);
+
+/* let the loop dispatch the events of k */
+int kact_loop_add(struct kact_loop *l, struct keyact *k);
+
+/* take k out of the loop, afterwards the loop never touches it again */
+int kact_loop_remove(struct kact_loop *l, struct keyact *k);
+
+/* start and stop the thread of the loop */
+int kact_loop_start(struct kact_loop *l);
+
+int kact_loop_stop(struct kact_loop *l);
+
+/* stop the loop, remove all members and free it */
+int kact_loop_free(struct kact_loop *l);
@@ -0,0 +1,339 @@
+/*
+ 0-Software. Caches the keyboard and the modifier mapping of every
+ x-server once per process, so resolving a hotkey needs no round trip.
+ keyact structures on the same display share its mapping. The tables
+ are built by kmap_fill, which the XCB backend uses for its own mapping
+ as well.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include "keyact.h"
+#include "hktable.h"
+#include "kmap.h"
+
+struct kmap_disp;
+
+static struct kmap_disp *kmap_get(const char *display);
+static int kmap_build(struct kmap_disp *d);
+static void kmap_free(void);
+static int kmap_mod_index(const struct kmap *m, const uint8_t *mods,
+		int per_mod, unsigned long sym);
+
+/* The mapping of one display. Its connection is opened once and kept
+	until the process exits */
+struct kmap_disp {
+	struct kmap_disp *next;
+	/* the name as returned by XDisplayName */
+	char *name;
+	Display *display;
+	struct kmap map;
+};
+
+/* All members and displays are protected by mutex */
+static struct {
+	pthread_mutex_t mutex;
+	struct kmap_disp *head;
+} cache = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+/* Resolves a keysym to a keycode of the current keyboard mapping. Like 
+	XKeysymToKeycode the keycode with the lowest column wins
+	Param: display = The name of the display or NULL for $DISPLAY
+		keysym = A X11 keysym. Latin-1 characters are their own keysyms
+		keycode = A valid pointer where the keycode is stored
+	Return: 0 on success, -1 if the keysym can't be produced */
+int kmap_keycode(const char *display, unsigned long keysym,
+		unsigned int *keycode){
+	struct kmap_disp *d;
+	int rc;
+	if(keycode == NULL)
+		return -1;
+
+	pthread_mutex_lock(&cache.mutex);
+	d = kmap_get(display);
+	rc = kmap_build(d) ? -1 : kmap_find_key(&d->map, keysym, keycode);
+	pthread_mutex_unlock(&cache.mutex);
+	return rc;
+}
+
+/* Resolves the name of a modifier to its mask. Besides the fixed names 
+	of the core protocol "alt" and "super" are understood. They map to 
+	the modifier which the Alt and Super keys are currently bound to
+	Param: display = The name of the display or NULL for $DISPLAY
+		name = A modifier name, e.g. "ctrl", "mod4" or "alt"
+		mask = A valid pointer where the mask is stored
+	Return: 0 on success, -1 if the name is unknown */
+int kmap_modifier(const char *display, const char *name,
+		unsigned int *mask){
+	struct kmap_disp *d;
+	int rc;
+	if(name == NULL || mask == NULL)
+		return -1;
+
+	pthread_mutex_lock(&cache.mutex);
+	d = kmap_get(display);
+	rc = kmap_build(d) ? -1 : kmap_find_mod(&d->map, name, mask);
+	pthread_mutex_unlock(&cache.mutex);
+	return rc;
+}
+
+/* Returns a hash of the keyboard and the modifier mapping. Resolved
+	hotkeys stay valid as long as it doesn't change
+	Param: display = The name of the display or NULL for $DISPLAY
+		fp = A valid pointer where the hash is stored
+	Return: 0 on success, -1 on failure */
+int kmap_fingerprint(const char *display, uint64_t *fp){
+	struct kmap_disp *d;
+	int rc;
+	if(fp == NULL)
+		return -1;
+
+	pthread_mutex_lock(&cache.mutex);
+	d = kmap_get(display);
+	rc = kmap_build(d);
+	if(rc == 0)
+		*fp = d->map.fingerprint;
+	pthread_mutex_unlock(&cache.mutex);
+	return rc;
+}
+
+/* Continues a FNV-1a hash. Not meant to resist attacks, only to tell
+	mappings apart
+	Param: h = KMAP_SEED or the result of a previous call
+		p = The bytes to hash
+		n = The number of bytes
+	Return: The new hash */
+uint64_t kmap_hash(uint64_t h, const void *p, size_t n){
+	const unsigned char *b = (const unsigned char *) p;
+	size_t i;
+	for(i=0; i<n; i++){
+		h ^= b[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* Marks the mapping of a display as outdated. It has to be called if
+	the x-server reports a changed keyboard or modifier mapping
+	Param: display = The name of the display or NULL for $DISPLAY
+	Return: nothing */
+void kmap_invalidate(const char *display){
+	struct kmap_disp *d;
+	pthread_mutex_lock(&cache.mutex);
+	d = kmap_get(display);
+	if(d != NULL)
+		kmap_clear(&d->map);
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+/* Builds the tables of a mapping from the replies of the x-server. The
+	keysyms and the fingerprint are the same for every backend talking to
+	the same x-server
+	Param: m = A valid pointer to an empty or cleared kmap structure
+		syms = per keysyms for each of the n keycodes starting at min
+		min = The lowest keycode
+		n = The number of keycodes
+		per = The number of keysyms per keycode
+		mods = per_mod keycodes for each of the 8 modifiers, 0 is unused
+		per_mod = The number of keycodes per modifier
+	Return: 0 on success, -1 on failure */
+int kmap_fill(struct kmap *m, const uint32_t *syms, unsigned int min,
+		int n, int per, const uint8_t *mods, int per_mod){
+	static const struct x11_mask fixed[] = {
+		{"shift", 1<<0},
+		{"lock", 1<<1},
+		{"ctrl", 1<<2},
+		{"mod1", 1<<3},
+		{"mod2", 1<<4},
+		{"mod3", 1<<5},
+		{"mod4", 1<<6},
+		{"mod5", 1<<7}
+	};
+	int i, j;
+
+	m->codes = hk_table_init((size_t) n * per);
+	if(m->codes == NULL)
+		return -1;
+	/* column by column, so that unshifted symbols win */
+	for(j=0; j<per; j++)
+		for(i=0; i<n; i++){
+			if(syms[i * per + j] == NoSymbol)
+				continue;
+			if(hk_table_get(m->codes, (uint64_t) syms[i * per + j]))
+				continue;
+			hk_table_put(m->codes, (uint64_t) syms[i * per + j],
+					(void *) (uintptr_t) (i + min));
+		}
+
+	memcpy(m->masks, fixed, sizeof(fixed));
+	m->nmasks = sizeof(fixed) / sizeof(struct x11_mask);
+	i = kmap_mod_index(m, mods, per_mod, XK_Alt_L);
+	if(i < 0)
+		i = kmap_mod_index(m, mods, per_mod, XK_Alt_R);
+	strcpy(m->masks[m->nmasks].modstr, "alt");
+	m->masks[m->nmasks++].mask = i < 0 ? 1<<3 : 1<<i;
+	i = kmap_mod_index(m, mods, per_mod, XK_Super_L);
+	if(i < 0)
+		i = kmap_mod_index(m, mods, per_mod, XK_Super_R);
+	strcpy(m->masks[m->nmasks].modstr, "super");
+	m->masks[m->nmasks++].mask = i < 0 ? 1<<6 : 1<<i;
+
+	m->fingerprint = kmap_hash(KMAP_SEED, &min, sizeof(min));
+	m->fingerprint = kmap_hash(m->fingerprint, syms, 
+			sizeof(uint32_t) * n * per);
+	m->fingerprint = kmap_hash(m->fingerprint, mods, 8 * per_mod);
+	m->valid = 1;
+	return 0;
+}
+
+/* Param: m = A valid pointer to a filled kmap structure
+		keysym = A X11 keysym
+		keycode = A valid pointer where the keycode is stored
+	Return: 0 on success, -1 if the keysym can't be produced */
+int kmap_find_key(const struct kmap *m, unsigned long keysym,
+		unsigned int *keycode){
+	void *res = hk_table_get(m->codes, (uint64_t) keysym);
+	if(res == NULL)
+		return -1;
+	*keycode = (unsigned int) (uintptr_t) res;
+	return 0;
+}
+
+/* Param: m = A valid pointer to a filled kmap structure
+		name = A modifier name, see kmap_modifier
+		mask = A valid pointer where the mask is stored
+	Return: 0 on success, -1 if the name is unknown */
+int kmap_find_mod(const struct kmap *m, const char *name,
+		unsigned int *mask){
+	int i;
+	for(i=0; i<m->nmasks; i++)
+		if(!strcmp(m->masks[i].modstr, name)){
+			*mask = (unsigned int) m->masks[i].mask;
+			return 0;
+		}
+	return -1;
+}
+
+/* Drops the tables of a mapping, it has to be filled again
+	Param: m = A valid pointer to a kmap structure
+	Return: nothing */
+void kmap_clear(struct kmap *m){
+	if(m->codes != NULL)
+		hk_table_free(m->codes);
+	m->codes = NULL;
+	m->valid = 0;
+}
+
+/* Looks the entry of a display up and adds it if there is none. Has to
+	be called with the mutex held
+	Param: display = The name of the display or NULL for $DISPLAY
+	Return: The entry or NULL on failure */
+static struct kmap_disp *kmap_get(const char *display){
+	const char *name = XDisplayName(display);
+	struct kmap_disp *d;
+
+	for(d = cache.head; d != NULL; d = d->next)
+		if(!strcmp(d->name, name))
+			return d;
+	d = (struct kmap_disp *) calloc(1, sizeof(struct kmap_disp));
+	if(d == NULL)
+		return NULL;
+	d->name = strdup(name);
+	if(d->name == NULL){
+		free(d);
+		return NULL;
+	}
+	if(cache.head == NULL)
+		atexit(kmap_free);
+	d->next = cache.head;
+	cache.head = d;
+	return d;
+}
+
+/* Builds the mapping of a display if it is not valid. Has to be called
+	with the mutex held
+	Param: d = The entry of the display or NULL
+	Return: 0 on success, -1 on failure */
+static int kmap_build(struct kmap_disp *d){
+	XModifierKeymap *mods;
+	KeySym *syms;
+	uint32_t *narrow;
+	int min, max, per, i, n, rc;
+
+	if(d == NULL)
+		return -1;
+	if(d->map.valid)
+		return 0;
+	if(d->display == NULL){
+		d->display = XOpenDisplay(d->name);
+		if(d->display == NULL)
+			return -1;
+	}
+
+	XDisplayKeycodes(d->display, &min, &max);
+	n = max - min + 1;
+	syms = XGetKeyboardMapping(d->display, (KeyCode) min, n, &per);
+	if(syms == NULL)
+		return -1;
+	mods = XGetModifierMapping(d->display);
+	narrow = (uint32_t *) malloc(sizeof(uint32_t) * n * per);
+	if(mods == NULL || narrow == NULL){
+		if(mods != NULL)
+			XFreeModifiermap(mods);
+		free(narrow);
+		XFree(syms);
+		return -1;
+	}
+	/* keysyms have 29 bits, the protocol sends them as 32 bit values */
+	for(i=0; i<n * per; i++)
+		narrow[i] = (uint32_t) syms[i];
+	rc = kmap_fill(&d->map, narrow, (unsigned int) min, n, per,
+			(const uint8_t *) mods->modifiermap, mods->max_keypermod);
+
+	XFreeModifiermap(mods);
+	XFree(syms);
+	free(narrow);
+	return rc;
+}
+
+/* Looks for the modifier a keysym is bound to
+	Param: m = A kmap structure whose codes have been filled
+		mods = The keycodes of the modifiers, see kmap_fill
+		per_mod = The number of keycodes per modifier
+		sym = The keysym of a modifier key, e.g. XK_Alt_L
+	Return: The index of the modifier (0 = shift, ... 7 = mod5) or -1 if
+		the keysym is not bound to any modifier */
+static int kmap_mod_index(const struct kmap *m, const uint8_t *mods,
+		int per_mod, unsigned long sym){
+	void *code = hk_table_get(m->codes, (uint64_t) sym);
+	int i;
+	if(code == NULL)
+		return -1;
+	for(i=0; i<8 * per_mod; i++)
+		if(mods[i] == (uint8_t) (uintptr_t) code)
+			return i / per_mod;
+	return -1;
+}
+
+/* Frees the cache and closes its connections. Registered by atexit
+	Param: void
+	Return: nothing */
+static void kmap_free(void){
+	struct kmap_disp *d;
+	pthread_mutex_lock(&cache.mutex);
+	while(cache.head != NULL){
+		d = cache.head;
+		cache.head = d->next;
+		kmap_clear(&d->map);
+		if(d->display != NULL)
+			XCloseDisplay(d->display);
+		free(d->name);
+		free(d);
+	}
+	pthread_mutex_unlock(&cache.mutex);
+}
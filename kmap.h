@@ -0,0 +1,52 @@
+/*
+ ---process wide keyboard mapping cache, one mapping per display---
+ ---begin---
+ */
+
+#include <stdint.h>
+
+/* start value of kmap_hash */
+#define KMAP_SEED 0xcbf29ce484222325ULL
+
+/* A resolved keyboard and modifier mapping, filled by kmap_fill */
+struct kmap {
+	int valid;
+	/* keysym -> keycode */
+	struct hk_table *codes;
+	/* the fixed modifiers, "alt" and "super" */
+	struct x11_mask masks[10];
+	int nmasks;
+	/* hash of both mappings, see kmap_fingerprint */
+	uint64_t fingerprint;
+};
+
+/* resolve a keysym to the keycode which produces it on display. NULL
+   is $DISPLAY */
+int kmap_keycode(const char *display, unsigned long keysym,
+		unsigned int *keycode);
+
+/* resolve a modifier name like "ctrl" or "alt" to its mask */
+int kmap_modifier(const char *display, const char *name,
+		unsigned int *mask);
+
+/* drop the mapping of display, it is rebuilt by the next lookup */
+void kmap_invalidate(const char *display);
+
+/* get a hash of the keyboard and the modifier mapping of display */
+int kmap_fingerprint(const char *display, uint64_t *fp);
+
+/* build the tables of m from a keyboard and a modifier mapping */
+int kmap_fill(struct kmap *m, const uint32_t *syms, unsigned int min,
+		int n, int per, const uint8_t *mods, int per_mod);
+
+/* resolve a keysym or a modifier name by a filled mapping */
+int kmap_find_key(const struct kmap *m, unsigned long keysym,
+		unsigned int *keycode);
+int kmap_find_mod(const struct kmap *m, const char *name,
+		unsigned int *mask);
+
+/* drop the tables of m */
+void kmap_clear(struct kmap *m);
+
+/* continue the FNV-1a hash h over n bytes */
+uint64_t kmap_hash(uint64_t h, const void *p, size_t n);
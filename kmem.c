@@ -0,0 +1,366 @@
+/*
+ 0-Software. The in memory backend. Key events are injected by the
+ application instead of being read from a device, so the library can be
+ driven without a display, e.g. by tests and benchmarks.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <X11/Xlib.h>
+#include "keyact.h"
+#include "kbackend.h"
+#include "kmap.h"
+
+static int mem_open(struct keyact *k, const struct kact_config *cfg);
+static int mem_close(struct keyact *k);
+static int mem_setup(struct keyact *k);
+static int mem_fd(struct keyact *k);
+static int mem_pending(struct keyact *k);
+static int mem_read(struct keyact *k, struct kact_event *batch, int max);
+static int mem_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc);
+static int mem_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode);
+static int mem_modifier(struct keyact *k, const char *name,
+		unsigned int *mask);
+static int mem_fingerprint(struct keyact *k, uint64_t *fp);
+
+const struct kact_backend kact_mem = {
+	"mem",
+	mem_open,
+	mem_close,
+	mem_setup,
+	mem_fd,
+	mem_pending,
+	mem_read,
+	mem_grab,
+	mem_keycode,
+	mem_modifier,
+	mem_fingerprint
+};
+
+/* The private data of the backend. The pipe only signals the event loop
+   that the queue is not empty */
+struct kmem {
+	pthread_mutex_t mutex;
+	pthread_cond_t room;
+	pthread_cond_t done;
+	struct kact_event queue[MEM_QUEUE_LEN];
+	unsigned int head;
+	unsigned int len;
+	/* number of events which have been injected, taken by the loop and
+	   completely dispatched */
+	unsigned long injected;
+	unsigned long taken;
+	unsigned long dispatched;
+	long grabs;
+	int fds[2];
+	/* pairs of keysyms whose keycodes are exchanged, see kact_mem_swap */
+	unsigned long swaps[MEM_SWAPS][2];
+	unsigned int nswaps;
+	/* hash of the fixed table and the swaps, see mem_fingerprint */
+	uint64_t fingerprint;
+};
+
+static const struct x11_mask mem_mods[] = {
+	{ "shift", ShiftMask },
+	{ "lock", LockMask },
+	{ "ctrl", ControlMask },
+	{ "mod1", Mod1Mask },
+	{ "mod2", Mod2Mask },
+	{ "mod3", Mod3Mask },
+	{ "mod4", Mod4Mask },
+	{ "mod5", Mod5Mask },
+	/* the usual bindings of a pc keyboard */
+	{ "alt", Mod1Mask },
+	{ "super", Mod4Mask }
+};
+
+/* Param: k = A valid pointer to a keyact structure using kact_mem
+	Return: The private data of the backend */
+static struct kmem *mem_of(struct keyact *k){
+	if(k == NULL || k->be != &kact_mem)
+		return NULL;
+	return (struct kmem *) k->be_data;
+}
+
+/* Creates the empty queue
+	Param: k = A valid pointer to a keyact structure
+		cfg = The configuration or NULL
+	Return: 0 on success, -1 on failure */
+static int mem_open(struct keyact *k, const struct kact_config *cfg){
+	struct kmem *m = (struct kmem *) malloc(sizeof(struct kmem));
+	(void) cfg;
+	if(m == NULL)
+		return -1;
+	if(pipe(m->fds)){
+		free(m);
+		return -1;
+	}
+	fcntl(m->fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(m->fds[1], F_SETFL, O_NONBLOCK);
+	pthread_mutex_init(&m->mutex, NULL);
+	pthread_cond_init(&m->room, NULL);
+	pthread_cond_init(&m->done, NULL);
+	m->head = 0;
+	m->len = 0;
+	m->injected = 0;
+	m->taken = 0;
+	m->dispatched = 0;
+	m->grabs = 0;
+	m->nswaps = 0;
+	m->fingerprint = kmap_hash(KMAP_SEED, mem_mods, sizeof(mem_mods));
+	k->be_data = (void *) m;
+	return 0;
+}
+
+/* Frees the queue. Events which have not been read are dropped
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success */
+static int mem_close(struct keyact *k){
+	struct kmem *m = (struct kmem *) k->be_data;
+	close(m->fds[0]);
+	close(m->fds[1]);
+	pthread_cond_destroy(&m->done);
+	pthread_cond_destroy(&m->room);
+	pthread_mutex_destroy(&m->mutex);
+	free(m);
+	k->be_data = NULL;
+	return 0;
+}
+
+/* Nothing has to be prepared
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 */
+static int mem_setup(struct keyact *k){
+	(void) k;
+	return 0;
+}
+
+/* Param: k = A valid pointer to a keyact structure
+	Return: The read end of the pipe */
+static int mem_fd(struct keyact *k){
+	return ((struct kmem *) k->be_data)->fds[0];
+}
+
+/* The event loop calls this after every dispatched batch, so all events
+	taken so far have been dispatched
+	Param: k = A valid pointer to a keyact structure
+	Return: The number of queued events */
+static int mem_pending(struct keyact *k){
+	struct kmem *m = (struct kmem *) k->be_data;
+	char buf[64];
+	int n;
+
+	pthread_mutex_lock(&m->mutex);
+	if(m->dispatched != m->taken){
+		m->dispatched = m->taken;
+		pthread_cond_broadcast(&m->done);
+	}
+	/* an injection after this point writes a new byte */
+	if(m->len == 0)
+		while(read(m->fds[0], buf, sizeof(buf)) > 0)
+			;
+	n = (int) m->len;
+	pthread_mutex_unlock(&m->mutex);
+	return n;
+}
+
+/* Takes up to max events from the queue
+	Param: k = A valid pointer to a keyact structure
+		batch = An array of at least max kact_event structures
+		max = The size of batch
+	Return: The number of events */
+static int mem_read(struct keyact *k, struct kact_event *batch, int max){
+	struct kmem *m = (struct kmem *) k->be_data;
+	int n = 0;
+
+	pthread_mutex_lock(&m->mutex);
+	while(m->len > 0 && n < max){
+		batch[n++] = m->queue[m->head];
+		m->head = (m->head + 1) % MEM_QUEUE_LEN;
+		m->len--;
+	}
+	m->taken += n;
+	if(n > 0)
+		pthread_cond_broadcast(&m->room);
+	pthread_mutex_unlock(&m->mutex);
+	return n;
+}
+
+/* Every grab succeeds. Only the number of grabbed hotkeys is counted
+	Param: k = A valid pointer to a keyact structure
+		keys = An array of n hotkeys
+		n = The number of hotkeys
+		grab = 1 to grab the hotkeys, 0 to ungrab them
+		rc = An array of n integers or NULL. Entries whose rc is already
+			set are skipped
+	Return: 0 */
+static int mem_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc){
+	struct kmem *m = (struct kmem *) k->be_data;
+	long cnt = 0;
+	size_t i;
+
+	(void) keys;
+	for(i=0; i<n; i++)
+		cnt += rc == NULL || rc[i] == 0;
+	__atomic_add_fetch(&m->grabs, grab ? cnt : -cnt, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* The keycodes of this backend are the keysyms themselves unless they
+	have been swapped. They are not limited to the range of X11 keycodes,
+	so any number of distinct hotkeys can be registered
+	Param: k = A valid pointer to a keyact structure
+		keysym = A X11 keysym
+		keycode = A valid pointer where the keycode is stored
+	Return: 0 on success, -1 if the keysym has no keycode */
+static int mem_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode){
+	struct kmem *m = (struct kmem *) k->be_data;
+	unsigned int i;
+	if(keysym < 8 || keysym > 0xffffffffUL)
+		return -1;
+
+	pthread_mutex_lock(&m->mutex);
+	for(i=0; i<m->nswaps; i++)
+		if(m->swaps[i][0] == keysym || m->swaps[i][1] == keysym){
+			keysym = m->swaps[i][m->swaps[i][0] == keysym];
+			break;
+		}
+	pthread_mutex_unlock(&m->mutex);
+	*keycode = (unsigned int) keysym;
+	return 0;
+}
+
+/* Resolves a modifier by a fixed table
+	Param: k = A valid pointer to a keyact structure
+		name = The name of the modifier
+		mask = A valid pointer where the mask is stored
+	Return: 0 on success, -1 if the name is unknown */
+static int mem_modifier(struct keyact *k, const char *name,
+		unsigned int *mask){
+	size_t i;
+	(void) k;
+	for(i=0; i<sizeof(mem_mods) / sizeof(mem_mods[0]); i++)
+		if(!strcmp(mem_mods[i].modstr, name)){
+			*mask = (unsigned int) mem_mods[i].mask;
+			return 0;
+		}
+	return -1;
+}
+
+/* Keycodes are keysyms, so only the table of the modifiers and the
+	swapped keysyms matter
+	Param: k = A valid pointer to a keyact structure
+		fp = A valid pointer where the hash is stored
+	Return: 0 */
+static int mem_fingerprint(struct keyact *k, uint64_t *fp){
+	struct kmem *m = (struct kmem *) k->be_data;
+	pthread_mutex_lock(&m->mutex);
+	*fp = m->fingerprint;
+	pthread_mutex_unlock(&m->mutex);
+	return 0;
+}
+
+/* Appends a key event to the input of k. Blocks while the queue is full,
+	so the event loop has to be running if more than MEM_QUEUE_LEN events
+	are injected
+	Param: k = A valid pointer to a keyact structure using kact_mem
+		type = KeyPress or KeyRelease
+		keycode = The keycode, see mem_keycode
+		state = The modifier mask
+		time = The time of the event in milliseconds
+	Return: 0 on success, -1 on failure */
+int kact_mem_inject(struct keyact *k, int type, unsigned int keycode,
+		unsigned int state, unsigned long time){
+	struct kmem *m = mem_of(k);
+	struct kact_event *e;
+	if(m == NULL)
+		return -1;
+
+	pthread_mutex_lock(&m->mutex);
+	while(m->len == MEM_QUEUE_LEN)
+		pthread_cond_wait(&m->room, &m->mutex);
+	e = &m->queue[(m->head + m->len) % MEM_QUEUE_LEN];
+	e->type = type;
+	e->keycode = keycode;
+	e->state = state;
+	e->time = time;
+	m->len++;
+	m->injected++;
+	pthread_mutex_unlock(&m->mutex);
+
+	/* a full pipe already wakes the loop up */
+	if(write(m->fds[1], "", 1) < 0)
+		return 0;
+	return 0;
+}
+
+/* Exchanges the keycodes of two keysyms, like a layout switch of a real
+	keyboard, and injects the MappingNotify which tells the event loop
+	about it. Swapping the same pair again restores both keycodes
+	Param: k = A valid pointer to a keyact structure using kact_mem
+		a = A X11 keysym
+		b = Another X11 keysym
+	Return: 0 on success, -1 on failure or if there are MEM_SWAPS swaps
+		already */
+int kact_mem_swap(struct keyact *k, unsigned long a, unsigned long b){
+	struct kmem *m = mem_of(k);
+	unsigned int i;
+	if(m == NULL || a == b)
+		return -1;
+
+	pthread_mutex_lock(&m->mutex);
+	for(i=0; i<m->nswaps; i++)
+		if((m->swaps[i][0] == a && m->swaps[i][1] == b) ||
+				(m->swaps[i][0] == b && m->swaps[i][1] == a))
+			break;
+	if(i < m->nswaps)
+		memcpy(m->swaps[i], m->swaps[--m->nswaps], sizeof(m->swaps[i]));
+	else if(m->nswaps == MEM_SWAPS){
+		pthread_mutex_unlock(&m->mutex);
+		return -1;
+	} else {
+		m->swaps[m->nswaps][0] = a;
+		m->swaps[m->nswaps++][1] = b;
+	}
+	m->fingerprint = kmap_hash(kmap_hash(KMAP_SEED, mem_mods, 
+			sizeof(mem_mods)), m->swaps, sizeof(m->swaps[0]) * m->nswaps);
+	pthread_mutex_unlock(&m->mutex);
+	return kact_mem_inject(k, MappingNotify, 0, 0, 0);
+}
+
+/* Blocks until the event loop has dispatched every event injected so
+	far. If there are workers, the calls of the hotkeys are queued, but
+	might not have finished yet. With a ring the events have only been
+	handed to the dispatcher
+	Param: k = A valid pointer to a keyact structure using kact_mem with
+			a running event loop
+	Return: 0 on success, -1 on failure */
+int kact_mem_wait(struct keyact *k){
+	struct kmem *m = mem_of(k);
+	if(m == NULL)
+		return -1;
+
+	pthread_mutex_lock(&m->mutex);
+	while(m->dispatched != m->injected)
+		pthread_cond_wait(&m->done, &m->mutex);
+	pthread_mutex_unlock(&m->mutex);
+	return 0;
+}
+
+/* Param: k = A valid pointer to a keyact structure using kact_mem
+	Return: The number of currently grabbed hotkeys or -1 on failure */
+long kact_mem_grabs(struct keyact *k){
+	struct kmem *m = mem_of(k);
+	if(m == NULL)
+		return -1;
+	return __atomic_load_n(&m->grabs, __ATOMIC_RELAXED);
+}
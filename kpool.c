@@ -0,0 +1,230 @@
+/*
+ 0-Software. Implements a pool of worker threads. Each worker serves a
+ bounded ring buffer of jobs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "kpool.h"
+
+#ifdef TESTX
+#include <CUnit/Cunit.h>
+#include <CUnit/Basic.h>
+#include <unistd.h>
+#endif
+
+static void *kpool_work(void *q);
+
+/* Initializes a pool of worker threads
+	Param: workers = The number of threads. Must be at least 1
+		depth = The number of jobs a single queue can hold. If a queue
+			is full, kpool_push blocks until a slot becomes free
+	Return: A valid pointer to a kpool structure or NULL on failure */
+struct kpool *kpool_init(unsigned int workers, unsigned int depth){
+	struct kpool *p;
+	struct kpool_queue *q;
+	unsigned int i;
+
+	if(workers == 0 || depth == 0)
+		return NULL;
+	p = (struct kpool *) malloc(sizeof(struct kpool));
+	if(p == NULL)
+		return NULL;
+	p->queues = (struct kpool_queue *)
+						calloc(workers, sizeof(struct kpool_queue));
+	if(p->queues == NULL){
+		free(p);
+		return NULL;
+	}
+	p->n = 0;
+
+	for(i=0; i<workers; i++){
+		q = &p->queues[i];
+		q->jobs = (struct kpool_job *)
+						malloc(sizeof(struct kpool_job) * depth);
+		if(q->jobs == NULL)
+			break;
+		q->cap = depth;
+		q->head = 0;
+		q->len = 0;
+		q->stop = 0;
+		pthread_mutex_init(&q->mutex, NULL);
+		pthread_cond_init(&q->fill, NULL);
+		pthread_cond_init(&q->room, NULL);
+		if(pthread_create(&q->thread, NULL, kpool_work, (void *) q)){
+			pthread_cond_destroy(&q->room);
+			pthread_cond_destroy(&q->fill);
+			pthread_mutex_destroy(&q->mutex);
+			free(q->jobs);
+			break;
+		}
+		p->n++;
+	}
+
+	if(p->n != workers){
+		kpool_free(p);
+		return NULL;
+	}
+	return p;
+}
+
+/* Appends a job to the queue of the worker selected by route
+	Param: p = A valid pointer to a kpool structure
+		route = An arbitrary number. Jobs with the same route are
+			executed in the order they were pushed
+		func = A valid function pointer
+		arg = An arbitrary pointer which is passed to func
+		n = An arbitrary number which is passed to func
+		stamp = An arbitrary number which is passed to func, e.g. the
+			time the job has been created
+	Return: 0 on success, -1 on failure */
+int kpool_push(struct kpool *p, unsigned long route,
+		int (*func)(void *arg, unsigned int n, long stamp), void *arg, 
+		unsigned int n, long stamp){
+	struct kpool_queue *q;
+	struct kpool_job *j;
+	if(p == NULL || func == NULL)
+		return -1;
+
+	q = &p->queues[route % p->n];
+	pthread_mutex_lock(&q->mutex);
+	while(q->len == q->cap && !q->stop)
+		pthread_cond_wait(&q->room, &q->mutex);
+	if(q->stop){
+		pthread_mutex_unlock(&q->mutex);
+		return -1;
+	}
+	j = &q->jobs[(q->head + q->len) % q->cap];
+	j->func = func;
+	j->arg = arg;
+	j->n = n;
+	j->stamp = stamp;
+	q->len++;
+	pthread_cond_signal(&q->fill);
+	pthread_mutex_unlock(&q->mutex);
+	return 0;
+}
+
+/* The body of a single worker. It runs jobs until the queue is stopped
+	and empty
+	Param: q = A valid pointer to a kpool_queue structure
+	Return: (void *) 0 */
+static void *kpool_work(void *q){
+	struct kpool_queue *queue = (struct kpool_queue *) q;
+	struct kpool_job job;
+
+	for(;;){
+		pthread_mutex_lock(&queue->mutex);
+		while(queue->len == 0 && !queue->stop)
+			pthread_cond_wait(&queue->fill, &queue->mutex);
+		if(queue->len == 0){
+			pthread_mutex_unlock(&queue->mutex);
+			break;
+		}
+		job = queue->jobs[queue->head];
+		queue->head = (queue->head + 1) % queue->cap;
+		queue->len--;
+		pthread_cond_signal(&queue->room);
+		pthread_mutex_unlock(&queue->mutex);
+
+		job.func(job.arg, job.n, job.stamp);
+	}
+	return (void *) 0;
+}
+
+/* Stops all workers after they have finished their pending jobs and
+	frees the pool
+	Param: p = A valid pointer to a kpool structure
+	Return: 0 on success, -1 on failure */
+int kpool_free(struct kpool *p){
+	struct kpool_queue *q;
+	unsigned int i;
+	if(p == NULL)
+		return -1;
+
+	for(i=0; i<p->n; i++){
+		q = &p->queues[i];
+		pthread_mutex_lock(&q->mutex);
+		q->stop = 1;
+		pthread_cond_broadcast(&q->fill);
+		pthread_cond_broadcast(&q->room);
+		pthread_mutex_unlock(&q->mutex);
+	}
+	for(i=0; i<p->n; i++){
+		q = &p->queues[i];
+		pthread_join(q->thread, NULL);
+		pthread_cond_destroy(&q->room);
+		pthread_cond_destroy(&q->fill);
+		pthread_mutex_destroy(&q->mutex);
+		free(q->jobs);
+	}
+	free(p->queues);
+	free(p);
+	return 0;
+}
+
+#ifdef TESTX
+
+int init_test(void){return 0;}
+
+static int seen[2][500];
+static int cnt[2];
+
+int record(void *p, unsigned int n, long stamp){
+	int route = (int) ((long) p >> 16);
+	seen[route][cnt[route]++] = (int) ((long) p & 0xffff) + (int) n;
+	/* a slow job must not disturb the order */
+	if(cnt[route] % 50 == 0)
+		usleep(100);
+	return 0;
+}
+
+void test_usage(void){
+	struct kpool *p = kpool_init(3, 4);
+	long i;
+	int ordered = 1;
+
+	CU_ASSERT(p != NULL);
+	CU_ASSERT(kpool_init(0, 4) == NULL);
+
+	for(i=0; i<500; i++){
+		CU_ASSERT(kpool_push(p, 0, record, (void *) i, 0, 0) == 0);
+		/* the number is passed through as well */
+		CU_ASSERT(kpool_push(p, 1, record, (void *) (1L << 16), i, 0) == 0);
+	}
+	/* kpool_free runs every pending job */
+	CU_ASSERT(kpool_free(p) == 0);
+
+	CU_ASSERT(cnt[0] == 500 && cnt[1] == 500);
+	for(i=0; i<500; i++)
+		if(seen[0][i] != i || seen[1][i] != i)
+			ordered = 0;
+	CU_ASSERT(ordered);
+}
+
+int main(int argc, char **argv){
+	CU_pSuite suite = NULL;
+
+	if(CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	suite = CU_add_suite("Test worker pool impl", init_test, init_test);
+	if(NULL == suite){
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if(NULL == CU_add_test(suite, "Reihenfolge der Jobs", test_usage)){
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* run tests */
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+	return CU_get_error();
+}
+#endif
@@ -0,0 +1,43 @@
+/*
+ ---worker pool with bounded queues---
+ ---begin---
+ */
+
+#include <pthread.h>
+
+struct kpool_job {
+	int (*func)(void *arg, unsigned int n, long stamp);
+	void *arg;
+	unsigned int n;
+	long stamp;
+};
+
+/* Every worker owns one queue. All jobs with the same route end up in
+   the same queue and are therefore executed in order */
+struct kpool_queue {
+	pthread_mutex_t mutex;
+	pthread_cond_t fill;
+	pthread_cond_t room;
+	struct kpool_job *jobs;
+	unsigned int cap;
+	unsigned int head;
+	unsigned int len;
+	int stop;
+	pthread_t thread;
+};
+
+struct kpool {
+	unsigned int n;
+	struct kpool_queue *queues;
+};
+
+/* build a pool of workers threads with depth queue slots each */
+struct kpool *kpool_init(unsigned int workers, unsigned int depth);
+
+/* queue func(arg, n, stamp) on the worker selected by route */
+int kpool_push(struct kpool *p, unsigned long route,
+		int (*func)(void *arg, unsigned int n, long stamp), void *arg, 
+		unsigned int n, long stamp);
+
+/* runs all pending jobs, stops the workers and frees the pool */
+int kpool_free(struct kpool *p);
@@ -0,0 +1,188 @@
+/*
+ 0-Software. Records the key events dispatched by a keyact structure into
+ a file and reads them back for kact_replay. The file is a ring of fixed
+ size which is mapped shared, so recording an event costs a few stores
+ into the page cache and no system call.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "keyact.h"
+#include "krec.h"
+
+static struct krec *krec_map(int fd, size_t size, int prot, int flags);
+
+/* Starts recording the events which are dispatched by k, either by its
+	loop or by kact_dispatch_pending. The file is created or truncated
+	and holds the latest nevents events
+	Param: k = A valid pointer to a keyact structure
+		path = The path of the file
+		nevents = The capacity of the ring, at least 1
+	Return: 0 on success, -1 if k is recording already or on failure */
+int kact_record_start(struct keyact *k, const char *path, size_t nevents){
+	struct krec *r, *none = NULL;
+	size_t size;
+	int fd;
+	if(k == NULL || path == NULL || nevents == 0 ||
+			__atomic_load_n(&k->rec, __ATOMIC_SEQ_CST) != NULL)
+		return -1;
+
+	size = sizeof(struct krec_head) + sizeof(struct krec_event) * nevents;
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+		return -1;
+	if(ftruncate(fd, (off_t) size)){
+		close(fd);
+		return -1;
+	}
+	r = krec_map(fd, size, PROT_READ | PROT_WRITE, MAP_SHARED);
+	close(fd);
+	if(r == NULL)
+		return -1;
+	r->head->magic = KREC_MAGIC;
+	r->head->version = KREC_VERSION;
+	r->head->cap = nevents;
+	r->head->total = 0;
+
+	/* the loop picks the recording up with its next batch */
+	if(!__atomic_compare_exchange_n(&k->rec, &none, r, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)){
+		krec_close(r);
+		return -1;
+	}
+	return 0;
+}
+
+/* Stops recording. The file keeps the recorded events
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success, -1 if k isn't recording */
+int kact_record_stop(struct keyact *k){
+	struct krec *r;
+	if(k == NULL)
+		return -1;
+	r = __atomic_exchange_n(&k->rec, NULL, __ATOMIC_SEQ_CST);
+	if(r == NULL)
+		return -1;
+
+	/* the loop only appends inside its read side section, so it is done
+	 	with the recording once there is no reader left */
+	while(__atomic_load_n(&k->readers, __ATOMIC_SEQ_CST) != 0)
+		sched_yield();
+	krec_close(r);
+	return 0;
+}
+
+/* Appends a batch of events to a recording. Only called by the thread
+	which dispatches the events
+	Param: r = A valid pointer to a writable krec structure
+		batch = An array of n events
+		n = The number of events
+		stamp = The time of the dispatch in monotonic microseconds
+	Return: nothing */
+void krec_append(struct krec *r, const struct kact_event *batch, int n,
+		long stamp){
+	uint64_t total = r->head->total, cap = r->head->cap;
+	struct krec_event *e;
+	int i;
+
+	for(i=0; i<n; i++, total++){
+		e = &r->events[total % cap];
+		e->stamp = (uint64_t) stamp;
+		e->time = batch[i].time;
+		e->type = (uint32_t) batch[i].type;
+		e->keycode = batch[i].keycode;
+		e->state = batch[i].state;
+		e->pad = 0;
+	}
+	/* a reader of the file never sees a count ahead of its events */
+	__atomic_store_n(&r->head->total, total, __ATOMIC_RELEASE);
+}
+
+/* Maps a recording for reading. The file may still be recorded into,
+	the events which have been recorded so far are visible
+	Param: path = The path of a file written by kact_record_start
+	Return: A valid pointer to a krec structure or NULL if the file is
+		missing or broken */
+struct krec *krec_open(const char *path){
+	struct krec *r;
+	struct stat st;
+	int fd;
+	if(path == NULL)
+		return NULL;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return NULL;
+	if(fstat(fd, &st) || (size_t) st.st_size < sizeof(struct krec_head)){
+		close(fd);
+		return NULL;
+	}
+	r = krec_map(fd, (size_t) st.st_size, PROT_READ, MAP_SHARED);
+	close(fd);
+	if(r == NULL)
+		return NULL;
+	if(r->head->magic != KREC_MAGIC || r->head->version != KREC_VERSION ||
+			r->head->cap == 0 || r->head->cap > (r->size -
+			sizeof(struct krec_head)) / sizeof(struct krec_event)){
+		krec_close(r);
+		return NULL;
+	}
+	return r;
+}
+
+/* Param: r = A valid pointer to a krec structure
+	Return: The number of events which are stored in the ring */
+size_t krec_len(const struct krec *r){
+	uint64_t total = __atomic_load_n(&r->head->total, __ATOMIC_ACQUIRE);
+	return (size_t) (total < r->head->cap ? total : r->head->cap);
+}
+
+/* Returns the i-th oldest event of a recording
+	Param: r = A valid pointer to a krec structure
+		i = The index, 0 is the oldest event
+	Return: The event or NULL if i is out of range */
+const struct krec_event *krec_get(const struct krec *r, size_t i){
+	uint64_t total = __atomic_load_n(&r->head->total, __ATOMIC_ACQUIRE);
+	uint64_t cap = r->head->cap;
+	if(i >= krec_len(r))
+		return NULL;
+	/* a full ring starts behind the latest event */
+	return &r->events[total > cap ? (total + i) % cap : i];
+}
+
+/* Unmaps a recording
+	Param: r = A valid pointer to a krec structure
+	Return: nothing */
+void krec_close(struct krec *r){
+	munmap(r->map, r->size);
+	free(r);
+}
+
+/* Maps a recording
+	Param: fd = The descriptor of the file
+		size = The size of the file
+		prot = The protection of the mapping
+		flags = The flags of the mapping
+	Return: A krec structure or NULL on failure */
+static struct krec *krec_map(int fd, size_t size, int prot, int flags){
+	struct krec *r = (struct krec *) malloc(sizeof(struct krec));
+	if(r == NULL)
+		return NULL;
+	r->map = mmap(NULL, size, prot, flags, fd, 0);
+	if(r->map == MAP_FAILED){
+		free(r);
+		return NULL;
+	}
+	r->size = size;
+	r->head = (struct krec_head *) r->map;
+	r->events = (struct krec_event *) (r->head + 1);
+	return r;
+}
@@ -0,0 +1,83 @@
+/*
+ ---recording and replay of key events---
+ ---begin---
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* "KREC" in the byte order of the machine which wrote the file */
+#define KREC_MAGIC 0x4345524bU
+#define KREC_VERSION 1
+
+/* modes of kact_replay */
+#define KACT_REPLAY_FAST 0
+#define KACT_REPLAY_TIMED 1
+
+/* The file starts with the head, followed by cap events. The events form
+   a ring, the oldest one is overwritten when it is full */
+struct krec_head {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t cap;
+	/* number of events ever recorded. Event i is stored at i % cap */
+	uint64_t total;
+};
+
+/* An event as it has been read by the loop. All events of a batch share
+   the same stamp */
+struct krec_event {
+	/* monotonic microseconds when the batch has been dispatched */
+	uint64_t stamp;
+	/* the time of the event, see kact_event */
+	uint64_t time;
+	uint32_t type;
+	uint32_t keycode;
+	uint32_t state;
+	uint32_t pad;
+};
+
+/* A mapped recording */
+struct krec {
+	void *map;
+	size_t size;
+	struct krec_head *head;
+	struct krec_event *events;
+};
+
+/* The result of kact_replay. The latency of an event is the time from
+   when its batch was due until the batch had been dispatched */
+struct kact_replay_stats {
+	unsigned long events;
+	unsigned long batches;
+	/* duration of the whole replay */
+	unsigned long ns;
+	double events_per_s;
+	unsigned long p50_ns;
+	unsigned long p99_ns;
+	unsigned long max_ns;
+};
+
+/* record the events dispatched by k into a ring of nevents at path */
+int kact_record_start(struct keyact *k, const char *path, size_t nevents);
+
+/* stop recording, the file keeps the events */
+int kact_record_stop(struct keyact *k);
+
+/* dispatch the events of a recording by the calling thread */
+int kact_replay(struct keyact *k, const char *path, int mode,
+		struct kact_replay_stats *st);
+
+/* append a dispatched batch to a recording, see dispatch_batch */
+void krec_append(struct krec *r, const struct kact_event *batch, int n,
+		long stamp);
+
+/* map a recording for reading */
+struct krec *krec_open(const char *path);
+
+/* number of events in a recording and the i-th oldest of them */
+size_t krec_len(const struct krec *r);
+const struct krec_event *krec_get(const struct krec *r, size_t i);
+
+/* unmap a recording */
+void krec_close(struct krec *r);
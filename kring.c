@@ -0,0 +1,206 @@
+/*
+ 0-Software. A ring of key events between exactly one producer, the
+ thread reading the backend, and one consumer, the thread dispatching
+ the events. Neither side takes a lock. The positions only grow and are
+ published by atomic stores, a side only sleeps if the ring is empty or
+ full respectively.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <X11/Xlib.h>
+#include "keyact.h"
+#include "kring.h"
+
+static void kring_signal(int fd);
+static void kring_drain(int fd);
+
+/* Builds an empty ring. The capacity is rounded up to a power of two
+	Param: len = The minimal number of events, at least 1
+	Return: A valid pointer to a kring structure or NULL on failure */
+struct kring *kring_init(size_t len){
+	struct kring *r;
+	size_t cap = 1;
+	if(len == 0)
+		return NULL;
+	while(cap < len)
+		cap <<= 1;
+
+	/* the positions must not share a line with anything else either */
+	if(posix_memalign((void **) &r, KRING_LINE, sizeof(struct kring)))
+		return NULL;
+	memset(r, 0, sizeof(struct kring));
+	r->mask = cap - 1;
+	r->events = (struct kact_event *) malloc(sizeof(struct kact_event) * cap);
+	if(r->events == NULL){
+		free(r);
+		return NULL;
+	}
+	if(pipe(r->data)){
+		free(r->events);
+		free(r);
+		return NULL;
+	}
+	if(pipe(r->room)){
+		close(r->data[0]);
+		close(r->data[1]);
+		free(r->events);
+		free(r);
+		return NULL;
+	}
+	fcntl(r->data[0], F_SETFL, O_NONBLOCK);
+	fcntl(r->data[1], F_SETFL, O_NONBLOCK);
+	fcntl(r->room[0], F_SETFL, O_NONBLOCK);
+	fcntl(r->room[1], F_SETFL, O_NONBLOCK);
+	return r;
+}
+
+/* Appends events. If the ring is full, KACT_RING_BLOCK waits for room.
+	KACT_RING_DROP drops a KeyPress instead, but still waits for room for
+	every other event, so no release of a held hotkey and no change of
+	the mapping gets lost
+	Param: r = A valid pointer to a kring structure
+		batch = An array of n events
+		n = The number of events
+		policy = KACT_RING_BLOCK or KACT_RING_DROP
+		cancel = Waiting for room ends as soon as it is not 0
+		dropped = A valid pointer to the counter of dropped events
+		waits = A valid pointer to the counter of waits for room
+	Return: The number of appended events */
+int kring_push(struct kring *r, const struct kact_event *batch, int n,
+		int policy, const int *cancel, unsigned long *dropped,
+		unsigned long *waits){
+	unsigned long head = r->head, tail;
+	struct pollfd fd;
+	int i, res = 0;
+
+	fd.fd = r->room[0];
+	fd.events = POLLIN;
+	for(i=0; i<n; i++){
+		tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		if(head - tail > r->mask && policy == KACT_RING_DROP &&
+				batch[i].type == KeyPress){
+			__atomic_add_fetch(dropped, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		if(head - tail > r->mask){
+			/* the events so far have to be visible before the consumer
+			 	can make room */
+			__atomic_store_n(&r->head, head, __ATOMIC_SEQ_CST);
+			if(__atomic_load_n(&r->cons_sleep, __ATOMIC_SEQ_CST))
+				kring_signal(r->data[1]);
+			__atomic_add_fetch(waits, 1, __ATOMIC_RELAXED);
+			while(head - __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) >
+					r->mask){
+				if(__atomic_load_n(cancel, __ATOMIC_SEQ_CST))
+					return res;
+				__atomic_store_n(&r->prod_sleep, 1, __ATOMIC_SEQ_CST);
+				if(head - __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) >
+						r->mask)
+					poll(&fd, 1, -1);
+				__atomic_store_n(&r->prod_sleep, 0, __ATOMIC_SEQ_CST);
+				kring_drain(r->room[0]);
+			}
+		}
+		r->events[head & r->mask] = batch[i];
+		head++;
+		res++;
+	}
+	/* publish the events before looking whether the consumer sleeps */
+	__atomic_store_n(&r->head, head, __ATOMIC_SEQ_CST);
+	if(res > 0 && __atomic_load_n(&r->cons_sleep, __ATOMIC_SEQ_CST))
+		kring_signal(r->data[1]);
+	return res;
+}
+
+/* Takes events out of the ring
+	Param: r = A valid pointer to a kring structure
+		batch = An array of at least max events
+		max = The maximal number of events
+	Return: The number of events */
+int kring_pop(struct kring *r, struct kact_event *batch, int max){
+	unsigned long tail = r->tail, head;
+	int n = 0;
+
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	while(tail != head && n < max)
+		batch[n++] = r->events[tail++ & r->mask];
+	if(n == 0)
+		return 0;
+	/* the slots are free once tail has been published */
+	__atomic_store_n(&r->tail, tail, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&r->prod_sleep, __ATOMIC_SEQ_CST))
+		kring_signal(r->room[1]);
+	return n;
+}
+
+/* Sleeps until the ring isn't empty, the timeout has expired or
+	kring_wake has been called
+	Param: r = A valid pointer to a kring structure
+		timeout = Milliseconds or -1 for no limit
+	Return: nothing */
+void kring_wait(struct kring *r, int timeout){
+	struct pollfd fd;
+
+	fd.fd = r->data[0];
+	fd.events = POLLIN;
+	/* the producer looks at the flag after it has published head */
+	__atomic_store_n(&r->cons_sleep, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == r->tail)
+		poll(&fd, 1, timeout);
+	__atomic_store_n(&r->cons_sleep, 0, __ATOMIC_SEQ_CST);
+	kring_drain(r->data[0]);
+}
+
+/* Param: r = A valid pointer to a kring structure
+	Return: The number of events which have been pushed but not popped */
+unsigned long kring_len(struct kring *r){
+	return __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) -
+			__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+}
+
+/* Wakes the producer and the consumer up if they sleep
+	Param: r = A valid pointer to a kring structure
+	Return: nothing */
+void kring_wake(struct kring *r){
+	kring_signal(r->data[1]);
+	kring_signal(r->room[1]);
+}
+
+/* Frees the ring and its pipes. Events which have not been popped are
+	dropped
+	Param: r = A valid pointer to a kring structure
+	Return: 0 on success, -1 on failure */
+int kring_free(struct kring *r){
+	if(r == NULL)
+		return -1;
+	close(r->data[0]);
+	close(r->data[1]);
+	close(r->room[0]);
+	close(r->room[1]);
+	free(r->events);
+	free(r);
+	return 0;
+}
+
+/* Writes a byte into a pipe. A full pipe already wakes its reader
+	Param: fd = The write end
+	Return: nothing */
+static void kring_signal(int fd){
+	if(write(fd, "", 1) < 0)
+		return;
+}
+
+/* Empties a pipe
+	Param: fd = The read end
+	Return: nothing */
+static void kring_drain(int fd){
+	char buf[16];
+	while(read(fd, buf, sizeof(buf)) > 0)
+		;
+}
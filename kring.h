@@ -0,0 +1,55 @@
+/*
+ ---single producer single consumer ring of key events---
+ ---begin---
+ */
+
+#include <stddef.h>
+
+/* size of a cache line. head and tail are kept apart by it, so the
+   reader and the dispatcher never write into the same line */
+#define KRING_LINE 64
+
+/* policies of kact_config.ring_policy if the ring is full */
+#define KACT_RING_BLOCK 0
+#define KACT_RING_DROP 1
+
+/* The producer only writes head and prod_sleep, the consumer only tail
+   and cons_sleep. A side which runs out of events or room sets its flag
+   and sleeps on its pipe until the other side writes a byte */
+struct kring {
+	unsigned long head;
+	int prod_sleep;
+	char pad0[KRING_LINE - sizeof(unsigned long) - sizeof(int)];
+	unsigned long tail;
+	int cons_sleep;
+	char pad1[KRING_LINE - sizeof(unsigned long) - sizeof(int)];
+	/* immutable after kring_init */
+	unsigned long mask;
+	int data[2];
+	int room[2];
+	struct kact_event *events;
+};
+
+/* build an empty ring of at least len events */
+struct kring *kring_init(size_t len);
+
+/* append events, full rings are handled by policy. Only the producer */
+int kring_push(struct kring *r, const struct kact_event *batch, int n,
+		int policy, const int *cancel, unsigned long *dropped,
+		unsigned long *waits);
+
+/* take up to max events. Only the consumer */
+int kring_pop(struct kring *r, struct kact_event *batch, int max);
+
+/* sleep until there are events or timeout ms have passed. Only the
+   consumer */
+void kring_wait(struct kring *r, int timeout);
+
+/* number of events in the ring */
+unsigned long kring_len(struct kring *r);
+
+/* wake both sides up, e.g. to let them see a cancel flag */
+void kring_wake(struct kring *r);
+
+/* free the ring, no thread may use it anymore */
+int kring_free(struct kring *r);
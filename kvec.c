@@ -0,0 +1,196 @@
+/*
+ 0-Software. Implements a growable array of pointers. Appending is
+ amortized O(1) by doubling the capacity, indexing is O(1) and removing
+ swaps the last item into the gap, so the order is not kept.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "kvec.h"
+
+#ifdef TESTX
+#include <CUnit/Cunit.h>
+#include <CUnit/Basic.h>
+#endif
+
+#define KVEC_MIN_CAP 8
+
+/* Initializes an empty array which is able to hold hint items without
+	being resized
+	Param: hint = The expected number of items. May be 0
+	Return: A valid pointer to a kvec structure or NULL on failure */
+struct kvec *kvec_init(size_t hint){
+	struct kvec *v = (struct kvec *) malloc(sizeof(struct kvec));
+	if(v == NULL)
+		return NULL;
+
+	v->cap = hint > KVEC_MIN_CAP ? hint : KVEC_MIN_CAP;
+	v->items = (void **) malloc(sizeof(void *) * v->cap);
+	if(v->items == NULL){
+		free(v);
+		return NULL;
+	}
+	v->len = 0;
+	return v;
+}
+
+/* Appends an item. The capacity is doubled if the array is full
+	Param: v = A valid pointer to a kvec structure
+		item = An arbitrary pointer
+	Return: 0 on success, -1 on failure */
+int kvec_add(struct kvec *v, void *item){
+	void **next;
+	if(v == NULL)
+		return -1;
+
+	if(v->len == v->cap){
+		next = (void **) realloc(v->items, sizeof(void *) * v->cap * 2);
+		if(next == NULL)
+			return -1;
+		v->items = next;
+		v->cap *= 2;
+	}
+	v->items[v->len++] = item;
+	return 0;
+}
+
+/* Returns the item at the index-th index. Indexes begin at 0
+	Param: v = A valid pointer to a kvec structure
+		index = The index of the item
+	Return: The item or NULL if index is out of range */
+void *kvec_get(const struct kvec *v, size_t index){
+	if(v == NULL || index >= v->len)
+		return NULL;
+	return v->items[index];
+}
+
+/* Removes the index-th item. The last item is moved into its place
+	Param: v = A valid pointer to a kvec structure
+		index = The index of the item
+	Return: 0 on success, -1 if index is out of range */
+int kvec_rm_at(struct kvec *v, size_t index){
+	if(v == NULL || index >= v->len)
+		return -1;
+	v->items[index] = v->items[--v->len];
+	return 0;
+}
+
+/* Removes the first item which equals item
+	Param: v = A valid pointer to a kvec structure
+		item = The item which should be removed
+	Return: 0 on success, -1 if item is not stored */
+int kvec_rm_content(struct kvec *v, void *item){
+	size_t i;
+	if(v == NULL)
+		return -1;
+
+	KVEC_EACH(v, i)
+		if(v->items[i] == item)
+			return kvec_rm_at(v, i);
+	return -1;
+}
+
+/* Calls f for every item in the order of the indexes. The array must not
+	be modified by f
+	Param: v = A valid pointer to a kvec structure
+		f = A function which returns 0 to continue
+		ctx = An arbitrary pointer passed to f
+	Return: 0 if every item has been visited, else the return of f */
+int kvec_foreach(const struct kvec *v, int (*f)(void *item, void *ctx),
+		void *ctx){
+	size_t i;
+	int rc;
+	if(v == NULL || f == NULL)
+		return -1;
+
+	KVEC_EACH(v, i)
+		if((rc = f(v->items[i], ctx)) != 0)
+			return rc;
+	return 0;
+}
+
+/* Frees the array. The items are not freed
+	Param: v = A valid pointer to a kvec structure
+	Return: 0 on success, -1 on failure */
+int kvec_free(struct kvec *v){
+	if(v == NULL)
+		return -1;
+	free(v->items);
+	free(v);
+	return 0;
+}
+
+#ifdef TESTX
+
+int init_test(void){return 0;}
+
+static int sum_items(void *item, void *ctx){
+	*(long *) ctx += (long) item;
+	return (long) item == 500 ? 500 : 0;
+}
+
+void test_usage(void){
+	struct kvec *v = kvec_init(0);
+	long i, sum = 0;
+	size_t j;
+
+	CU_ASSERT(v != NULL);
+	CU_ASSERT(v->len == 0);
+	CU_ASSERT(kvec_get(v, 0) == NULL);
+
+	/* enough items to force some resizes */
+	for(i=1; i<=1000; i++)
+		CU_ASSERT(kvec_add(v, (void *) i) == 0);
+	CU_ASSERT(v->len == 1000);
+	CU_ASSERT(v->cap >= 1000);
+	for(i=0; i<1000; i++)
+		CU_ASSERT(kvec_get(v, i) == (void *) (i + 1));
+	CU_ASSERT(kvec_get(v, 1000) == NULL);
+
+	/* the last item fills the gap */
+	CU_ASSERT(kvec_rm_at(v, 0) == 0);
+	CU_ASSERT(kvec_get(v, 0) == (void *) 1000);
+	CU_ASSERT(v->len == 999);
+	CU_ASSERT(kvec_rm_content(v, (void *) 1000) == 0);
+	CU_ASSERT(kvec_get(v, 0) == (void *) 999);
+	CU_ASSERT(kvec_rm_content(v, (void *) 4711) == -1);
+	CU_ASSERT(kvec_rm_at(v, 998) == -1);
+	CU_ASSERT(v->len == 998);
+
+	KVEC_EACH(v, j)
+		sum += (long) v->items[j];
+	CU_ASSERT(sum == 1000 * 1001 / 2 - 1 - 1000);
+
+	/* foreach stops with the first return which isn't 0 */
+	sum = 0;
+	CU_ASSERT(kvec_foreach(v, sum_items, &sum) == 500);
+	CU_ASSERT(sum == 999 + 500 * 501 / 2 - 1);
+
+	CU_ASSERT(kvec_free(v) == 0);
+}
+
+int main(int argc, char **argv){
+	CU_pSuite suite = NULL;
+
+	if(CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	suite = CU_add_suite("Test growable array impl", init_test, init_test);
+	if(NULL == suite){
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if(NULL == CU_add_test(suite, "Einfügen und Löschen", test_usage)){
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* run tests */
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+	return CU_get_error();
+}
+#endif
@@ -0,0 +1,39 @@
+/*
+ ---growable array implementation---
+ ---begin---
+ */
+
+#include <stddef.h>
+
+/* The items are stored contiguously, so items[i] is valid for every
+   i < len. Removing an item moves the last one into its place */
+struct kvec {
+	size_t len;
+	size_t cap;
+	void **items;
+};
+
+/* visit every item of v, e.g. KVEC_EACH(v, i) use(v->items[i]); */
+#define KVEC_EACH(v, i) for((i)=0; (i)<(v)->len; (i)++)
+
+/* build an empty array which can hold hint items without growing */
+struct kvec *kvec_init(size_t hint);
+
+/* add something to the end of the array */
+int kvec_add(struct kvec *v, void *item);
+
+/* get something from an index */
+void *kvec_get(const struct kvec *v, size_t index);
+
+/* removes the item at index, the last item takes its place */
+int kvec_rm_at(struct kvec *v, size_t index);
+
+/* removes the first item which equals item */
+int kvec_rm_content(struct kvec *v, void *item);
+
+/* call f for every item until it returns something else than 0 */
+int kvec_foreach(const struct kvec *v, int (*f)(void *item, void *ctx),
+		void *ctx);
+
+/* frees the array but not the items */
+int kvec_free(struct kvec *v);
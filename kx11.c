@@ -0,0 +1,313 @@
+/*
+ 0-Software. The Xlib backend. Hotkeys are passive grabs on the root
+ windows of all screens.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/XKBlib.h>
+#include "keyact.h"
+#include "kbackend.h"
+#include "kmap.h"
+
+static int x11_open(struct keyact *k, const struct kact_config *cfg);
+static int x11_close(struct keyact *k);
+static int x11_setup(struct keyact *k);
+static int x11_fd(struct keyact *k);
+static int x11_pending(struct keyact *k);
+static int x11_read(struct keyact *k, struct kact_event *batch, int max);
+static int x11_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc);
+static int x11_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode);
+static int x11_modifier(struct keyact *k, const char *name,
+		unsigned int *mask);
+static int x11_fingerprint(struct keyact *k, uint64_t *fp);
+static int *on_error(Display *d, XErrorEvent *e);
+static int on_grab_error(Display *d, XErrorEvent *e);
+
+const struct kact_backend kact_x11 = {
+	"x11",
+	x11_open,
+	x11_close,
+	x11_setup,
+	x11_fd,
+	x11_pending,
+	x11_read,
+	x11_grab,
+	x11_keycode,
+	x11_modifier,
+	x11_fingerprint
+};
+
+/* State of the x11_grab which is currently waiting for errors. old is
+   the handler which was installed before, it gets every other error */
+static struct {
+	pthread_mutex_t mutex;
+	Display *display;
+	unsigned long *serials;
+	int *rc;
+	size_t n;
+	XErrorHandler old;
+} grab_err = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL, 0, NULL };
+
+/* Returns the display of a keyact structure using this backend
+	Param: k = A valid pointer to a keyact structure
+	Return: The display or NULL if k uses another backend */
+Display *kact_x11_display(struct keyact *k){
+	if(k == NULL || k->be != &kact_x11)
+		return NULL;
+	return (Display *) k->be_data;
+}
+
+/* Opens the connection to the x-server
+	Param: k = A valid pointer to a keyact structure
+		cfg = The configuration or NULL. Its display is opened
+	Return: 0 on success, -1 on failure */
+static int x11_open(struct keyact *k, const struct kact_config *cfg){
+	/* the display is shared by the event loop and the registering
+	 	threads */
+	XInitThreads();
+	k->be_data = (void *) XOpenDisplay(XDisplayName(cfg != NULL ?
+			cfg->display : NULL));
+	if(k->be_data == NULL)
+		return -1;
+	return 0;
+}
+
+/* Closes the connection to the x-server
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success */
+static int x11_close(struct keyact *k){
+	XCloseDisplay((Display *) k->be_data);
+	k->be_data = NULL;
+	return 0;
+}
+
+/* Prepares the connection for the event loop
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success */
+static int x11_setup(struct keyact *k){
+	Display *display = (Display *) k->be_data;
+	int i;
+
+	/* XAllowEvents is described in chapter 12
+		of the official Xlib documentation.
+	 	http://www.x.org/releases/X11R7.7/doc/libX11/libX11/libX11.html*/
+	XAllowEvents(display, AsyncBoth, CurrentTime);
+
+	/* Select press, release and motion events from the root windows
+	 	of all screens */
+	for(i=0; i<XScreenCount(display); i++)
+		XSelectInput(display, XRootWindow(display, i),
+			KeyPressMask | KeyReleaseMask | ExposureMask);
+
+	XSetErrorHandler((XErrorHandler) on_error);
+
+	/* a held key must not produce KeyRelease events before every repeated
+	 	KeyPress, otherwise the repeat policies can't tell repeats from
+	 	real presses */
+	XkbSetDetectableAutoRepeat(display, True, NULL);
+	return 0;
+}
+
+/* Param: k = A valid pointer to a keyact structure
+	Return: The socket of the connection to the x-server */
+static int x11_fd(struct keyact *k){
+	return ConnectionNumber((Display *) k->be_data);
+}
+
+/* XPending also reads everything available on the connection
+	Param: k = A valid pointer to a keyact structure
+	Return: The number of queued events */
+static int x11_pending(struct keyact *k){
+	return XPending((Display *) k->be_data);
+}
+
+/* Reads all events which are queued on the connection of k, but at most
+	max, and decodes the key events and changes of the keyboard mapping
+	into batch. Other events are dropped
+	Param: k = A valid pointer to a keyact structure
+		batch = An array of at least max kact_event structures
+		max = The size of batch
+	Return: The number of decoded events */
+static int x11_read(struct keyact *k, struct kact_event *batch, int max){
+	Display *display = (Display *) k->be_data;
+	XEvent event;
+	int queued, n = 0;
+
+	queued = XEventsQueued(display, QueuedAfterReading);
+	while(queued-- > 0 && n < max){
+		XNextEvent(display, &event);
+		switch(event.type){
+			case KeyPress:
+			case KeyRelease:
+				batch[n].type = event.type;
+				batch[n].keycode = event.xkey.keycode;
+				batch[n].state = event.xkey.state;
+				batch[n].time = event.xkey.time;
+				n++;
+				break;
+			case MappingNotify:
+				/* the cached keyboard mapping is outdated now. The loop
+				 	resolves the hotkeys again */
+				XRefreshKeyboardMapping(&event.xmapping);
+				if(event.xmapping.request == MappingPointer)
+					break;
+				kmap_invalidate(DisplayString(display));
+				batch[n].type = MappingNotify;
+				batch[n].keycode = 0;
+				batch[n].state = 0;
+				batch[n].time = 0;
+				n++;
+				break;
+			case ButtonPress:
+				//currently not implemented
+				break;
+			case ButtonRelease:
+				//same as above
+				break;
+			default:
+				break;
+		}
+	}
+	return n;
+}
+
+/* Grabs or ungrabs n hotkeys on all screens. The requests are only
+	flushed once. If rc is given, the errors of all of them are collected
+	by a single XSync
+	Param: k = A valid pointer to a keyact structure
+		keys = An array of n hotkeys
+		n = The number of hotkeys
+		grab = 1 to grab the hotkeys, 0 to ungrab them
+		rc = An array of n integers or NULL. rc[i] is set to -1 if the
+			x-server rejected a request for keys[i]
+	Return: 0 on success, -1 on failure */
+static int x11_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc){
+	Display *display = (Display *) k->be_data;
+	unsigned long *serials = NULL;
+	size_t i;
+	int j;
+
+	if(rc != NULL){
+		serials = (unsigned long *) malloc(sizeof(unsigned long) * (n + 1));
+		if(serials == NULL)
+			return -1;
+
+		/* the error handler is process wide, so only one batch at a time */
+		pthread_mutex_lock(&grab_err.mutex);
+		XSync(display, False);
+		grab_err.display = display;
+		grab_err.serials = serials;
+		grab_err.rc = rc;
+		grab_err.n = n;
+		grab_err.old = XSetErrorHandler(on_grab_error);
+	}
+
+	for(i=0; i<n; i++){
+		if(rc != NULL){
+			serials[i] = NextRequest(display);
+			if(rc[i])
+				continue;
+		}
+		for(j=0; j<XScreenCount(display); j++){
+			if(grab)
+				XGrabKey(display, keys[i].keycode, keys[i].mod_mask,
+						XRootWindow(display, j), 0, GrabModeAsync,
+						GrabModeAsync);
+			else
+				XUngrabKey(display, keys[i].keycode, keys[i].mod_mask,
+						XRootWindow(display, j));
+		}
+	}
+
+	if(rc == NULL){
+		XFlush(display);
+		return 0;
+	}
+	serials[n] = NextRequest(display);
+	XSync(display, False);
+
+	XSetErrorHandler(grab_err.old);
+	grab_err.display = NULL;
+	grab_err.old = NULL;
+	pthread_mutex_unlock(&grab_err.mutex);
+	free(serials);
+
+	/* XSync might have queued events which the socket doesn't signal
+		anymore, so the event loop has to look again */
+	if(write(k->wakeup[1], "", 1) < 0)
+		return 0;
+	return 0;
+}
+
+/* Resolves a keysym by the cached mapping of the display of k
+	Param: k = A valid pointer to a keyact structure
+		keysym = A X11 keysym
+		keycode = A valid pointer where the keycode is stored
+	Return: 0 on success, -1 on failure */
+static int x11_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode){
+	return kmap_keycode(DisplayString((Display *) k->be_data), keysym,
+			keycode);
+}
+
+/* Resolves a modifier name by the cached mapping of the display of k
+	Param: k = A valid pointer to a keyact structure
+		name = The name of the modifier
+		mask = A valid pointer where the mask is stored
+	Return: 0 on success, -1 on failure */
+static int x11_modifier(struct keyact *k, const char *name,
+		unsigned int *mask){
+	return kmap_modifier(DisplayString((Display *) k->be_data), name, mask);
+}
+
+/* Param: k = A valid pointer to a keyact structure
+		fp = A valid pointer where the hash is stored
+	Return: The result of kmap_fingerprint */
+static int x11_fingerprint(struct keyact *k, uint64_t *fp){
+	return kmap_fingerprint(DisplayString((Display *) k->be_data), fp);
+}
+
+/* Little Errorhandler for the X11-System. It currently does nothing */
+static int *on_error(Display *d, XErrorEvent *e){
+	static int already = 0;
+	if(already != 0)
+		return NULL;
+	already = 1;
+
+	//TODO: Error handling...
+	return NULL;
+}
+
+/* Errorhandler which is installed while x11_grab waits for the reply
+	of the x-server. It maps the failed request back to its hotkey. Errors
+	of other displays or requests are passed on to the previous handler
+	Param: d = The display the error occured on
+		e = The description of the error
+	Return: 0 or the result of the previous handler */
+static int on_grab_error(Display *d, XErrorEvent *e){
+	size_t lo = 0, hi = grab_err.n, mid;
+	if(d != grab_err.display || e->serial < grab_err.serials[0] ||
+			e->serial >= grab_err.serials[grab_err.n])
+		return grab_err.old != NULL ? grab_err.old(d, e) : 0;
+
+	/* find the last entry whose first request is not after the error */
+	while(hi - lo > 1){
+		mid = (lo + hi) / 2;
+		if(grab_err.serials[mid] <= e->serial)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	grab_err.rc[lo] = -1;
+	return 0;
+}
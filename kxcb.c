@@ -0,0 +1,414 @@
+/*
+ 0-Software. The XCB backend. Unlike the Xlib backend it never waits for
+ the x-server behind the back of the caller: grabs are sent as cookies
+ whose errors are collected afterwards, events are polled without
+ blocking and every error belongs to the request which caused it. No
+ process wide error handler is involved. Only built with -DKACT_XCB.
+ */
+
+#ifdef KACT_XCB
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xkb.h>
+#include "keyact.h"
+#include "kbackend.h"
+#include "kmap.h"
+
+static int xc_open(struct keyact *k, const struct kact_config *cfg);
+static int xc_close(struct keyact *k);
+static int xc_setup(struct keyact *k);
+static int xc_fd(struct keyact *k);
+static int xc_pending(struct keyact *k);
+static int xc_read(struct keyact *k, struct kact_event *batch, int max);
+static int xc_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc);
+static int xc_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode);
+static int xc_modifier(struct keyact *k, const char *name,
+		unsigned int *mask);
+static int xc_fingerprint(struct keyact *k, uint64_t *fp);
+struct kxcb;
+
+static int xc_build(struct kxcb *x);
+static int xc_autorepeat(struct kxcb *x);
+
+const struct kact_backend kact_xcb = {
+	"xcb",
+	xc_open,
+	xc_close,
+	xc_setup,
+	xc_fd,
+	xc_pending,
+	xc_read,
+	xc_grab,
+	xc_keycode,
+	xc_modifier,
+	xc_fingerprint
+};
+
+/* The private data of the backend. The mapping is protected by mutex,
+   everything else is owned by the event loop or immutable */
+struct kxcb {
+	xcb_connection_t *conn;
+	xcb_window_t *roots;
+	int nroots;
+	pthread_mutex_t mutex;
+	struct kmap map;
+	/* an event which has been polled by xc_pending but not read yet */
+	xcb_generic_event_t *stash;
+	/* errors of requests which were sent without a cookie. Counted by
+	   the loop, read by any thread */
+	unsigned long errors;
+	/* the x-server reports held keys without releases, see xc_setup */
+	int autorepeat;
+};
+
+/* Connects to the x-server and remembers the root windows of all screens
+	Param: k = A valid pointer to a keyact structure
+		cfg = The configuration or NULL. Its display is opened
+	Return: 0 on success, -1 on failure */
+static int xc_open(struct keyact *k, const struct kact_config *cfg){
+	struct kxcb *x = (struct kxcb *) calloc(1, sizeof(struct kxcb));
+	xcb_screen_iterator_t it;
+	int i;
+	if(x == NULL)
+		return -1;
+
+	x->conn = xcb_connect(cfg != NULL ? cfg->display : NULL, NULL);
+	if(xcb_connection_has_error(x->conn)){
+		xcb_disconnect(x->conn);
+		free(x);
+		return -1;
+	}
+	it = xcb_setup_roots_iterator(xcb_get_setup(x->conn));
+	x->nroots = it.rem;
+	x->roots = (xcb_window_t *) malloc(sizeof(xcb_window_t) * it.rem);
+	if(x->roots == NULL){
+		xcb_disconnect(x->conn);
+		free(x);
+		return -1;
+	}
+	for(i=0; it.rem > 0; i++, xcb_screen_next(&it))
+		x->roots[i] = it.data->root;
+	pthread_mutex_init(&x->mutex, NULL);
+	k->be_data = (void *) x;
+	return 0;
+}
+
+/* Disconnects from the x-server
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success */
+static int xc_close(struct keyact *k){
+	struct kxcb *x = (struct kxcb *) k->be_data;
+
+	free(x->stash);
+	kmap_clear(&x->map);
+	pthread_mutex_destroy(&x->mutex);
+	xcb_disconnect(x->conn);
+	free(x->roots);
+	free(x);
+	k->be_data = NULL;
+	return 0;
+}
+
+/* Selects the key events of all root windows and enables detectable
+	autorepeat like the Xlib backend does. Only the latter waits for a
+	reply
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success */
+static int xc_setup(struct keyact *k){
+	struct kxcb *x = (struct kxcb *) k->be_data;
+	uint32_t mask = XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE |
+			XCB_EVENT_MASK_EXPOSURE;
+	int i;
+
+	xcb_allow_events(x->conn, XCB_ALLOW_ASYNC_BOTH, XCB_CURRENT_TIME);
+	for(i=0; i<x->nroots; i++)
+		xcb_change_window_attributes(x->conn, x->roots[i],
+				XCB_CW_EVENT_MASK, &mask);
+	__atomic_store_n(&x->autorepeat, xc_autorepeat(x), __ATOMIC_RELAXED);
+	xcb_flush(x->conn);
+	return 0;
+}
+
+/* A held key must not produce a KeyRelease before every repeated
+	KeyPress, otherwise the repeat policies can't tell repeats from real
+	presses. Without XKB the server sends the pairs anyway
+	Param: x = A valid pointer to the private data of the backend
+	Return: 1 if detectable autorepeat is enabled, otherwise 0 */
+static int xc_autorepeat(struct kxcb *x){
+	const xcb_query_extension_reply_t *ext;
+	xcb_xkb_use_extension_cookie_t uc;
+	xcb_xkb_use_extension_reply_t *ur;
+	xcb_xkb_per_client_flags_cookie_t fc;
+	xcb_xkb_per_client_flags_reply_t *fr;
+	int res;
+
+	ext = xcb_get_extension_data(x->conn, &xcb_xkb_id);
+	if(ext == NULL || !ext->present)
+		return 0;
+	/* both requests are sent before the first reply is awaited */
+	uc = xcb_xkb_use_extension(x->conn, XCB_XKB_MAJOR_VERSION,
+			XCB_XKB_MINOR_VERSION);
+	fc = xcb_xkb_per_client_flags(x->conn, XCB_XKB_ID_USE_CORE_KBD,
+			XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT,
+			XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT, 0, 0, 0);
+	ur = xcb_xkb_use_extension_reply(x->conn, uc, NULL);
+	fr = xcb_xkb_per_client_flags_reply(x->conn, fc, NULL);
+	res = ur != NULL && ur->supported && fr != NULL && (fr->value &
+			XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT);
+	free(ur);
+	free(fr);
+	return res;
+}
+
+/* Param: k = A valid pointer to a keyact structure
+	Return: The socket of the connection to the x-server */
+static int xc_fd(struct keyact *k){
+	return xcb_get_file_descriptor(((struct kxcb *) k->be_data)->conn);
+}
+
+/* Polls a single event without blocking and keeps it for xc_read
+	Param: k = A valid pointer to a keyact structure
+	Return: 1 if an event is available, otherwise 0 */
+static int xc_pending(struct keyact *k){
+	struct kxcb *x = (struct kxcb *) k->be_data;
+	if(x->stash == NULL)
+		x->stash = xcb_poll_for_event(x->conn);
+	return x->stash != NULL;
+}
+
+/* Reads the events which are available without blocking, but at most
+	max, and decodes the key events and changes of the keyboard mapping
+	into batch. Other events are dropped
+	Param: k = A valid pointer to a keyact structure
+		batch = An array of at least max kact_event structures
+		max = The size of batch
+	Return: The number of decoded events */
+static int xc_read(struct keyact *k, struct kact_event *batch, int max){
+	struct kxcb *x = (struct kxcb *) k->be_data;
+	xcb_generic_event_t *ev;
+	xcb_key_press_event_t *key;
+	int n = 0;
+
+	while(n < max){
+		ev = x->stash != NULL ? x->stash : xcb_poll_for_event(x->conn);
+		x->stash = NULL;
+		if(ev == NULL)
+			break;
+		/* the highest bit marks events sent by other clients */
+		switch(ev->response_type & 0x7f){
+			case 0:
+				/* the error of a request without cookie */
+				__atomic_add_fetch(&x->errors, 1, __ATOMIC_RELAXED);
+				break;
+			case XCB_KEY_PRESS:
+			case XCB_KEY_RELEASE:
+				/* the codes of the protocol are the ones of Xlib */
+				key = (xcb_key_press_event_t *) ev;
+				batch[n].type = ev->response_type & 0x7f;
+				batch[n].keycode = key->detail;
+				batch[n].state = key->state;
+				batch[n].time = key->time;
+				n++;
+				break;
+			case XCB_MAPPING_NOTIFY:
+				/* the cached keyboard mapping is outdated now. The loop
+				 	resolves the hotkeys again */
+				if(((xcb_mapping_notify_event_t *) ev)->request ==
+						XCB_MAPPING_POINTER)
+					break;
+				pthread_mutex_lock(&x->mutex);
+				kmap_clear(&x->map);
+				pthread_mutex_unlock(&x->mutex);
+				batch[n].type = XCB_MAPPING_NOTIFY;
+				batch[n].keycode = 0;
+				batch[n].state = 0;
+				batch[n].time = 0;
+				n++;
+				break;
+			default:
+				break;
+		}
+		free(ev);
+	}
+	return n;
+}
+
+/* Grabs or ungrabs n hotkeys on all screens. Without rc the requests are
+	only sent and their errors arrive as events. With rc every request
+	gets a cookie. All of them are flushed at once and checked afterwards,
+	so there is only a single round trip
+	Param: k = A valid pointer to a keyact structure
+		keys = An array of n hotkeys
+		n = The number of hotkeys
+		grab = 1 to grab the hotkeys, 0 to ungrab them
+		rc = An array of n integers or NULL. rc[i] is set to -1 if the
+			x-server rejected a request for keys[i]
+	Return: 0 on success, -1 on failure */
+static int xc_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc){
+	struct kxcb *x = (struct kxcb *) k->be_data;
+	xcb_void_cookie_t *cookies = NULL;
+	xcb_generic_error_t *err;
+	size_t i;
+	int j;
+
+	if(rc != NULL){
+		cookies = (xcb_void_cookie_t *)
+				calloc(n * x->nroots, sizeof(xcb_void_cookie_t));
+		if(cookies == NULL)
+			return -1;
+	}
+
+	for(i=0; i<n; i++){
+		if(rc != NULL && rc[i])
+			continue;
+		for(j=0; j<x->nroots; j++){
+			if(rc == NULL && grab)
+				xcb_grab_key(x->conn, 0, x->roots[j], keys[i].mod_mask,
+						keys[i].keycode, XCB_GRAB_MODE_ASYNC,
+						XCB_GRAB_MODE_ASYNC);
+			else if(rc == NULL)
+				xcb_ungrab_key(x->conn, keys[i].keycode, x->roots[j],
+						keys[i].mod_mask);
+			else if(grab)
+				cookies[i * x->nroots + j] = xcb_grab_key_checked(x->conn,
+						0, x->roots[j], keys[i].mod_mask, keys[i].keycode,
+						XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+			else
+				cookies[i * x->nroots + j] = xcb_ungrab_key_checked(x->conn,
+						keys[i].keycode, x->roots[j], keys[i].mod_mask);
+		}
+	}
+	xcb_flush(x->conn);
+	if(rc == NULL)
+		return 0;
+
+	/* the first check waits for the server, the others are answered */
+	for(i=0; i<n; i++){
+		if(rc[i])
+			continue;
+		for(j=0; j<x->nroots; j++){
+			err = xcb_request_check(x->conn, cookies[i * x->nroots + j]);
+			if(err == NULL)
+				continue;
+			rc[i] = -1;
+			free(err);
+		}
+	}
+	free(cookies);
+
+	/* waiting for the replies might have queued events which the socket
+	 	doesn't signal anymore, so the event loop has to look again */
+	if(write(k->wakeup[1], "", 1) < 0)
+		return 0;
+	return 0;
+}
+
+/* Resolves a keysym by the keyboard mapping of the connection. Like
+	XKeysymToKeycode the keycode with the lowest column wins
+	Param: k = A valid pointer to a keyact structure
+		keysym = A X11 keysym
+		keycode = A valid pointer where the keycode is stored
+	Return: 0 on success, -1 on failure */
+static int xc_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode){
+	struct kxcb *x = (struct kxcb *) k->be_data;
+	int rc;
+
+	pthread_mutex_lock(&x->mutex);
+	rc = xc_build(x) ? -1 : kmap_find_key(&x->map, keysym, keycode);
+	pthread_mutex_unlock(&x->mutex);
+	return rc;
+}
+
+/* Resolves the name of a modifier like kmap_modifier does
+	Param: k = A valid pointer to a keyact structure
+		name = The name of the modifier
+		mask = A valid pointer where the mask is stored
+	Return: 0 on success, -1 if the name is unknown */
+static int xc_modifier(struct keyact *k, const char *name,
+		unsigned int *mask){
+	struct kxcb *x = (struct kxcb *) k->be_data;
+	int rc;
+
+	pthread_mutex_lock(&x->mutex);
+	rc = xc_build(x) ? -1 : kmap_find_mod(&x->map, name, mask);
+	pthread_mutex_unlock(&x->mutex);
+	return rc;
+}
+
+/* Returns a hash of the keyboard and the modifier mapping like
+	kmap_fingerprint does
+	Param: k = A valid pointer to a keyact structure
+		fp = A valid pointer where the hash is stored
+	Return: 0 on success, -1 on failure */
+static int xc_fingerprint(struct keyact *k, uint64_t *fp){
+	struct kxcb *x = (struct kxcb *) k->be_data;
+	int rc;
+
+	pthread_mutex_lock(&x->mutex);
+	rc = xc_build(x);
+	if(rc == 0)
+		*fp = x->map.fingerprint;
+	pthread_mutex_unlock(&x->mutex);
+	return rc;
+}
+
+/* Builds the mapping if it is not valid. Both mappings are requested
+	before the first reply is awaited. Has to be called with the mutex
+	held
+	Param: x = A valid pointer to the private data of the backend
+	Return: 0 on success, -1 on failure */
+static int xc_build(struct kxcb *x){
+	const xcb_setup_t *setup = xcb_get_setup(x->conn);
+	xcb_get_keyboard_mapping_cookie_t kc;
+	xcb_get_modifier_mapping_cookie_t mc;
+	xcb_get_keyboard_mapping_reply_t *kr;
+	xcb_get_modifier_mapping_reply_t *mr;
+	int n, rc = -1;
+
+	if(x->map.valid)
+		return 0;
+	n = setup->max_keycode - setup->min_keycode + 1;
+	kc = xcb_get_keyboard_mapping(x->conn, setup->min_keycode, n);
+	mc = xcb_get_modifier_mapping(x->conn);
+	kr = xcb_get_keyboard_mapping_reply(x->conn, kc, NULL);
+	mr = xcb_get_modifier_mapping_reply(x->conn, mc, NULL);
+	if(kr != NULL && mr != NULL)
+		rc = kmap_fill(&x->map, xcb_get_keyboard_mapping_keysyms(kr),
+				setup->min_keycode, n, kr->keysyms_per_keycode,
+				xcb_get_modifier_mapping_keycodes(mr),
+				mr->keycodes_per_modifier);
+	free(kr);
+	free(mr);
+	return rc;
+}
+
+/* Param: k = A valid pointer to a keyact structure using kact_xcb
+	Return: The number of errors which the x-server reported for grabs
+		and ungrabs sent without rc, e.g. by kact_reg_hk */
+unsigned long kact_xcb_errors(struct keyact *k){
+	if(k == NULL || k->be != &kact_xcb)
+		return 0;
+	return __atomic_load_n(&((struct kxcb *) k->be_data)->errors,
+			__ATOMIC_RELAXED);
+}
+
+/* Param: k = A valid pointer to a keyact structure using kact_xcb
+	Return: 1 if the loop has enabled detectable autorepeat, otherwise 0 */
+int kact_xcb_autorepeat(struct keyact *k){
+	if(k == NULL || k->be != &kact_xcb)
+		return 0;
+	return __atomic_load_n(&((struct kxcb *) k->be_data)->autorepeat,
+			__ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,286 @@
+/*
+ 0-Software. The XInput2 backend. It selects the raw key events of the
+ root windows instead of grabbing the hotkeys, so the x-server doesn't
+ know about the hotkeys at all and the keys still reach the focused
+ client. Raw events carry no modifier state, so the backend tracks the
+ modifiers itself. Only built with -DKACT_XI2.
+ */
+
+#ifdef KACT_XI2
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XInput2.h>
+#include "keyact.h"
+#include "kbackend.h"
+#include "kmap.h"
+
+static int xi2_open(struct keyact *k, const struct kact_config *cfg);
+static int xi2_close(struct keyact *k);
+static int xi2_setup(struct keyact *k);
+static int xi2_fd(struct keyact *k);
+static int xi2_pending(struct keyact *k);
+static int xi2_read(struct keyact *k, struct kact_event *batch, int max);
+static int xi2_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc);
+static int xi2_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode);
+static int xi2_modifier(struct keyact *k, const char *name,
+		unsigned int *mask);
+static int xi2_fingerprint(struct keyact *k, uint64_t *fp);
+
+const struct kact_backend kact_xi2 = {
+	"xi2",
+	xi2_open,
+	xi2_close,
+	xi2_setup,
+	xi2_fd,
+	xi2_pending,
+	xi2_read,
+	xi2_grab,
+	xi2_keycode,
+	xi2_modifier,
+	xi2_fingerprint
+};
+
+/* The private data of the backend. Everything but display is owned by
+   the event loop */
+struct kxi2 {
+	Display *display;
+	int opcode;
+	/* the modifier mask of every keycode and the modifier keys which are
+	   currently held down */
+	unsigned int mods[256];
+	unsigned char down[256];
+	unsigned int state;
+};
+
+/* Connects to the x-server and checks for XInput 2.0
+	Param: k = A valid pointer to a keyact structure
+		cfg = The configuration or NULL
+	Return: 0 on success, -1 on failure */
+static int xi2_open(struct keyact *k, const struct kact_config *cfg){
+	struct kxi2 *x;
+	int event, error, major = 2, minor = 0;
+
+	x = (struct kxi2 *) calloc(1, sizeof(struct kxi2));
+	if(x == NULL)
+		return -1;
+	XInitThreads();
+	x->display = XOpenDisplay(XDisplayName(cfg != NULL ? cfg->display :
+			NULL));
+	if(x->display == NULL){
+		free(x);
+		return -1;
+	}
+	if(!XQueryExtension(x->display, "XInputExtension", &x->opcode, &event,
+			&error) || XIQueryVersion(x->display, &major, &minor) != Success){
+		XCloseDisplay(x->display);
+		free(x);
+		return -1;
+	}
+	k->be_data = (void *) x;
+	return 0;
+}
+
+/* Closes the connection to the x-server
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success */
+static int xi2_close(struct keyact *k){
+	struct kxi2 *x = (struct kxi2 *) k->be_data;
+	XCloseDisplay(x->display);
+	free(x);
+	k->be_data = NULL;
+	return 0;
+}
+
+/* Reads the modifier mapping and the current modifier state. Only called
+	by the event loop
+	Param: x = A valid pointer to the private data of the backend
+	Return: nothing */
+static void xi2_modmap(struct kxi2 *x){
+	XModifierKeymap *map = XGetModifierMapping(x->display);
+	XkbStateRec st;
+	KeyCode code;
+	int i;
+
+	memset(x->mods, 0, sizeof(x->mods));
+	if(map != NULL){
+		for(i=0; i<8 * map->max_keypermod; i++){
+			code = map->modifiermap[i];
+			if(code != 0)
+				x->mods[code] |= 1U << (i / map->max_keypermod);
+		}
+		XFreeModifiermap(map);
+	}
+	x->state = 0;
+	if(XkbGetState(x->display, XkbUseCoreKbd, &st) == Success)
+		x->state = st.mods;
+}
+
+/* Selects the raw key events of all master keyboards on the root window
+	of the first screen. Raw events are always delivered there
+	Param: k = A valid pointer to a keyact structure
+	Return: 0 on success, -1 on failure */
+static int xi2_setup(struct keyact *k){
+	struct kxi2 *x = (struct kxi2 *) k->be_data;
+	unsigned char bits[XIMaskLen(XI_LASTEVENT)];
+	XIEventMask mask;
+
+	memset(bits, 0, sizeof(bits));
+	XISetMask(bits, XI_RawKeyPress);
+	XISetMask(bits, XI_RawKeyRelease);
+	mask.deviceid = XIAllMasterDevices;
+	mask.mask_len = sizeof(bits);
+	mask.mask = bits;
+	if(XISelectEvents(x->display, XDefaultRootWindow(x->display),
+			&mask, 1) != Success)
+		return -1;
+	xi2_modmap(x);
+	XFlush(x->display);
+	return 0;
+}
+
+/* Param: k = A valid pointer to a keyact structure
+	Return: The socket of the connection to the x-server */
+static int xi2_fd(struct keyact *k){
+	return ConnectionNumber(((struct kxi2 *) k->be_data)->display);
+}
+
+/* Param: k = A valid pointer to a keyact structure
+	Return: The number of queued events */
+static int xi2_pending(struct keyact *k){
+	return XPending(((struct kxi2 *) k->be_data)->display);
+}
+
+/* Updates the tracked modifiers by a raw key event. A modifier stays set
+	while any of its keys is held down, lock toggles on every press
+	Param: x = A valid pointer to the private data of the backend
+		keycode = The keycode of the event
+		press = 1 for a press, 0 for a release
+	Return: 1 if the key is a modifier, 0 otherwise */
+static int xi2_track(struct kxi2 *x, unsigned int keycode, int press){
+	unsigned int mask = x->mods[keycode & 0xff];
+	int i;
+	if(mask == 0)
+		return 0;
+
+	x->down[keycode & 0xff] = press;
+	if(mask & LockMask){
+		if(press)
+			x->state ^= LockMask;
+		mask &= ~LockMask;
+	}
+	if(press){
+		x->state |= mask;
+		return 1;
+	}
+	x->state &= ~mask;
+	for(i=0; i<256; i++)
+		if(x->down[i])
+			x->state |= x->mods[i] & ~LockMask;
+	return 1;
+}
+
+/* Reads all events which are queued, but at most max, and decodes the
+	raw key events into batch. Like for core events the state is the one
+	before the key has been pressed or released. Modifier keys only
+	change the state, they are not passed to the loop
+	Param: k = A valid pointer to a keyact structure
+		batch = An array of at least max kact_event structures
+		max = The size of batch
+	Return: The number of decoded events */
+static int xi2_read(struct keyact *k, struct kact_event *batch, int max){
+	struct kxi2 *x = (struct kxi2 *) k->be_data;
+	XGenericEventCookie *cookie;
+	XIRawEvent *raw;
+	XEvent event;
+	int queued, n = 0;
+
+	queued = XEventsQueued(x->display, QueuedAfterReading);
+	while(queued-- > 0 && n < max){
+		XNextEvent(x->display, &event);
+		if(event.type == MappingNotify){
+			XRefreshKeyboardMapping(&event.xmapping);
+			if(event.xmapping.request != MappingPointer){
+				kmap_invalidate(DisplayString(x->display));
+				xi2_modmap(x);
+				/* the loop resolves the hotkeys again */
+				batch[n].type = MappingNotify;
+				batch[n].keycode = 0;
+				batch[n].state = 0;
+				batch[n].time = 0;
+				n++;
+			}
+			continue;
+		}
+		cookie = &event.xcookie;
+		if(event.type != GenericEvent || cookie->extension != x->opcode ||
+				!XGetEventData(x->display, cookie))
+			continue;
+		if(cookie->evtype == XI_RawKeyPress ||
+				cookie->evtype == XI_RawKeyRelease){
+			raw = (XIRawEvent *) cookie->data;
+			batch[n].type = cookie->evtype == XI_RawKeyPress ?
+					KeyPress : KeyRelease;
+			batch[n].keycode = (unsigned int) raw->detail;
+			batch[n].state = x->state;
+			batch[n].time = raw->time;
+			if(!xi2_track(x, batch[n].keycode, batch[n].type == KeyPress))
+				n++;
+		}
+		XFreeEventData(x->display, cookie);
+	}
+	return n;
+}
+
+/* Nothing is grabbed, the event loop matches the raw events against the
+	table of the hotkeys itself. So a hotkey can't fail because another
+	client grabbed it
+	Param: k = A valid pointer to a keyact structure
+		keys = An array of n hotkeys
+		n = The number of hotkeys
+		grab = 1 to grab the hotkeys, 0 to ungrab them
+		rc = An array of n integers or NULL. It is left untouched
+	Return: 0 */
+static int xi2_grab(struct keyact *k, const struct hotkey *keys, size_t n,
+		int grab, int *rc){
+	return 0;
+}
+
+/* Resolves a keysym by the cached mapping of the display of k
+	Param: k = A valid pointer to a keyact structure
+		keysym = A X11 keysym
+		keycode = A valid pointer where the keycode is stored
+	Return: 0 on success, -1 on failure */
+static int xi2_keycode(struct keyact *k, unsigned long keysym,
+		unsigned int *keycode){
+	struct kxi2 *x = (struct kxi2 *) k->be_data;
+	return kmap_keycode(DisplayString(x->display), keysym, keycode);
+}
+
+/* Resolves a modifier name by the cached mapping of the display of k
+	Param: k = A valid pointer to a keyact structure
+		name = The name of the modifier
+		mask = A valid pointer where the mask is stored
+	Return: 0 on success, -1 on failure */
+static int xi2_modifier(struct keyact *k, const char *name,
+		unsigned int *mask){
+	struct kxi2 *x = (struct kxi2 *) k->be_data;
+	return kmap_modifier(DisplayString(x->display), name, mask);
+}
+
+/* Param: k = A valid pointer to a keyact structure
+		fp = A valid pointer where the hash is stored
+	Return: The result of kmap_fingerprint */
+static int xi2_fingerprint(struct keyact *k, uint64_t *fp){
+	struct kxi2 *x = (struct kxi2 *) k->be_data;
+	return kmap_fingerprint(DisplayString(x->display), fp);
+}
+
+#endif
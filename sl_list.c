@@ -15,45 +15,73 @@
 /* Initializes a structrue of type slist 
  	Return: A valid pointer to a slist structure or NULL on failure */
 struct slist *slist_init(){
-	struct slist *list = (struct slist *) malloc(sizeof(struct slist));
+	return slist_init_alloc(NULL, NULL, NULL);
+}
+
+/* Initializes a structure of type slist whose nodes and the structure
+	itself are allocated by alloc
+	Param: alloc = A function returning size bytes or NULL for malloc
+		release = A function freeing memory of alloc. May be NULL if 
+			alloc is an arena that frees all at once
+		ctx = An arbitrary pointer passed to alloc and release
+ 	Return: A valid pointer to a slist structure or NULL on failure */
+struct slist *slist_init_alloc(void *(*alloc)(void *ctx, size_t size),
+		void (*release)(void *ctx, void *p), void *ctx){
+	struct slist *list = alloc != NULL ? 
+		(struct slist *) alloc(ctx, sizeof(struct slist)) :
+		(struct slist *) malloc(sizeof(struct slist));
 	if(list == NULL)
 		return NULL;
 	list->len = 0;
 	list->start = NULL;
+	list->tail = NULL;
+	list->alloc = alloc;
+	list->release = release;
+	list->ctx = ctx;
 	return list;
 }
 
+/* Allocates memory for a node or the list by the allocator of list
+	Param: list = A valid pointer to a slist structure
+		size = The number of bytes
+	Return: A pointer to the memory or NULL on failure */
+static void *slist_mem(struct slist *list, size_t size){
+	if(list->alloc != NULL)
+		return list->alloc(list->ctx, size);
+	return malloc(size);
+}
+
+/* Frees memory returned by slist_mem
+	Param: list = A valid pointer to a slist structure
+		p = The memory which has to be freed
+	Return: nothing */
+static void slist_unmem(struct slist *list, void *p){
+	if(list->alloc == NULL)
+		free(p);
+	else if(list->release != NULL)
+		list->release(list->ctx, p);
+}
+
 /* Appends an item on the list if the list is empty, the first item will 
-   be created.
+   be created. The tail is remembered, so this takes constant time
  	Param: list = A vaild pointer to a slist structure
  		content = A arbitrary pointer 
  	Return: 0 on success, -1 on failure */
 int slist_add(struct slist *list, void *content){
+	struct snode *node;
 	if(list == NULL) 
 		return -1;
 
-	if((list->start) == NULL) {
-		struct snode *node = (struct snode *) malloc(sizeof(struct snode));
-		node->content = content;
-		node->next = NULL;
+	node = (struct snode *) slist_mem(list, sizeof(struct snode));
+	if(node == NULL)
+		return -1;
+	node->content = content;
+	node->next = NULL;
+	if(list->start == NULL)
 		list->start = node;
-	} else {
-		struct snode *temp = list->start;
-		while(1){
-			if((temp->next) != NULL) {
-				temp = temp->next;
-			} else {
-				struct snode *n = (struct snode *) 
-										malloc(sizeof(struct snode));
-				if(n == NULL)
-					return -1;
-				n->content = content;
-				n->next = NULL;
-				temp->next = n;
-				break;
-			}
-		}
-	}
+	else
+		list->tail->next = node;
+	list->tail = node;
 	list->len++;
 	return 0;
 }
@@ -95,12 +123,15 @@ int slist_prepend(struct slist *list, void *content){
 	if(list == NULL || content == NULL)
 		return -1;
 
-	struct snode *node = (struct snode *) malloc(sizeof(struct snode));
+	struct snode *node = (struct snode *) 
+							slist_mem(list, sizeof(struct snode));
 	if(node == NULL)
 		return -1;
 	node->content = content;
 	node->next = list->start;
 	list->start = node;
+	if(list->tail == NULL)
+		list->tail = node;
 	list->len++;
 	return 0;
 }
@@ -120,12 +151,13 @@ int slist_add_at(struct slist *list, int index, void *content){
 
 	if(list->len == 0 && index == 0) { 
 		struct snode *node = (struct snode *) 
-										malloc(sizeof(struct snode));
+								slist_mem(list, sizeof(struct snode));
 		if(node == NULL)
 			return -1;
 		node->next = NULL;
 		node->content = content;
 		list->start = node;
+		list->tail = node;
 	} else {
 		int i;
 		struct snode *temp = list->start;
@@ -135,7 +167,8 @@ int slist_add_at(struct slist *list, int index, void *content){
 				return -1;
 			temp = temp->next;
 		}
-		struct snode *new = (struct snode *) malloc(sizeof(struct snode));
+		struct snode *new = (struct snode *) 
+							slist_mem(list, sizeof(struct snode));
 		if(new == NULL)
 			return -1;
 
@@ -157,14 +190,16 @@ int slist_rm_at(struct slist *list, int index){
 	int i; 
 	struct snode *save;
 
-	if(list == NULL || list->len < 0 || index < 0) 
+	if(list == NULL || index < 0 || index >= list->len) 
 		return -1;
 
 	struct snode *temp = list->start, *prev = NULL;
 	if(index == 0) {
 		save = list->start;
 		list->start = list->start->next;
-		free(save);
+		if(list->start == NULL)
+			list->tail = NULL;
+		slist_unmem(list, save);
 		list->len--;
 		return 0;
 	} else {
@@ -178,13 +213,14 @@ int slist_rm_at(struct slist *list, int index){
 	//We have to delete the last node in the list
 	if(temp->next == NULL){
 		prev->next = NULL;
-		free(temp);
+		list->tail = prev;
+		slist_unmem(list, temp);
 		list->len--;
 		return 0;
 	}
 
 	save = temp->next;
-	free(temp);
+	slist_unmem(list, temp);
 	prev->next = save;
 	list->len--;
 	return 0;
@@ -216,13 +252,39 @@ int slist_rm_content(struct slist *list, void *content){
 				return -1;
 			temp = temp->next;
 		}
-		struct snode *save = temp->next;
-		prev->next = save;
-		free(temp);
+		/* the first node has no predecessor */
+		if(prev == NULL)
+			list->start = temp->next;
+		else
+			prev->next = temp->next;
+		if(list->tail == temp)
+			list->tail = prev;
+		slist_unmem(list, temp);
+		list->len--;
 	}
 	return 0;
 }
 
+/* Calls f for every item from the first to the last one. The list must
+	not be modified by f. Unlike slist_get_at in a loop this walks the
+	list only once
+	Param: list = A valid pointer to a slist structure
+		f = A function which returns 0 to continue
+		ctx = An arbitrary pointer passed to f
+	Return: 0 if every item has been visited, else the return of f */
+int slist_foreach(struct slist *list, int (*f)(void *content, void *ctx),
+		void *ctx){
+	struct snode *temp;
+	int rc;
+	if(list == NULL || f == NULL)
+		return -1;
+
+	for(temp = list->start; temp != NULL; temp = temp->next)
+		if((rc = f(temp->content, ctx)) != 0)
+			return rc;
+	return 0;
+}
+
 /* Frees the entire datastructure including all nodes 
    	Note, that this function does not attempt to free
 	the value pointer!
@@ -231,21 +293,20 @@ int slist_rm_content(struct slist *list, void *content){
 int slist_free(struct slist *list){
 	if(list == NULL) 
 		return -1;
-	if(list->start == NULL) {
-		free(list);
-	} else {
+	if(list->start != NULL) {
 		struct snode *temp = list->start;
 		struct snode *old;
 		while(1) {
 			if((temp->next) == NULL) { 
-				free(temp); 
+				slist_unmem(list, temp); 
 				break; 
 			}
 			old = temp;
 			temp = temp->next;
-			free(old);
+			slist_unmem(list, old);
 		}
 	}
+	slist_unmem(list, list);
 	return 0;
 }
 
@@ -265,7 +326,7 @@ void test_usage(void){
 	char **str = (char **) malloc(sizeof(char *) * 10);
 	char *str3 = (char *) malloc(sizeof(char));
 	char *str4 = (char *) malloc(sizeof(char));
-	int i, *rc, cnt;
+	int i, r, *rc = &r, cnt;
 
 	/* test of functions slist_add and slist_get_at */
 	for(i=0; i<10; i++){
@@ -308,9 +369,45 @@ void test_usage(void){
 	for(i=0; i<list->len; i++){
 		printf("Nr: %d - String: %s\n", i, slist_get_at(i, list, rc));
 	}
+	CU_ASSERT(list->start == NULL && list->tail == NULL);
+	CU_ASSERT(slist_rm_at(list, 0) == -1);
 	/* further checks to come */
 }
 
+static int count_items(void *content, void *ctx){
+	(*(int *) ctx)++;
+	return 0;
+}
+
+void test_tail(void){
+	struct slist *list = slist_init();
+	int i, rc, cnt = 0;
+
+	/* appending after removing the last node must not use a stale tail */
+	for(i=1; i<=3; i++)
+		CU_ASSERT(slist_add(list, (void *) (long) i) == 0);
+	CU_ASSERT(slist_rm_last(list) == 0);
+	CU_ASSERT(slist_add(list, (void *) 4L) == 0);
+	CU_ASSERT(slist_get_at(2, list, &rc) == (void *) 4L);
+
+	/* removing the first node by its content */
+	CU_ASSERT(slist_rm_content(list, (void *) 1L) == 0);
+	CU_ASSERT(list->len == 2);
+	CU_ASSERT(slist_get_at(0, list, &rc) == (void *) 2L);
+	CU_ASSERT(slist_rm_content(list, (void *) 4L) == 0);
+	CU_ASSERT(list->tail == list->start);
+	CU_ASSERT(slist_rm_content(list, (void *) 4711L) == -1);
+	CU_ASSERT(slist_rm_content(list, (void *) 2L) == 0);
+	CU_ASSERT(list->len == 0 && list->tail == NULL);
+
+	CU_ASSERT(slist_prepend(list, (void *) 5L) == 0);
+	CU_ASSERT(slist_add(list, (void *) 6L) == 0);
+	CU_ASSERT(slist_get_at(1, list, &rc) == (void *) 6L);
+	CU_ASSERT(slist_foreach(list, count_items, &cnt) == 0);
+	CU_ASSERT(cnt == 2);
+	CU_ASSERT(slist_free(list) == 0);
+}
+
 int main(int argc, char **argv){
 	CU_pSuite suite = NULL;
 
@@ -324,7 +421,8 @@ int main(int argc, char **argv){
 	}
 
 	if((NULL == CU_add_test(suite, "Initialisierungstest", test_init)) ||
-		(NULL == CU_add_test(suite, "Hinzufügen von Elementen", test_usage))
+		(NULL == CU_add_test(suite, "Hinzufügen von Elementen", test_usage)) ||
+		(NULL == CU_add_test(suite, "Ende der Liste", test_tail))
 
 	){
 		CU_cleanup_registry();
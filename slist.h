@@ -3,9 +3,18 @@
  ---begin---
  */
 
+#include <stddef.h>
+
 struct slist {
 	int len;
 	struct snode *start;
+	/* the last node, so appending doesn't walk the list */
+	struct snode *tail;
+	/* allocator for the nodes. NULL means malloc and free. If only
+	   release is NULL, nodes are never freed one by one */
+	void *(*alloc)(void *ctx, size_t size);
+	void (*release)(void *ctx, void *p);
+	void *ctx;
 };
 
 struct snode {
@@ -16,6 +25,10 @@ struct snode {
 /* build an single linked list */
 struct slist *slist_init();
 
+/* build an single linked list whose nodes come from alloc */
+struct slist *slist_init_alloc(void *(*alloc)(void *ctx, size_t size),
+		void (*release)(void *ctx, void *p), void *ctx);
+
 /* add something to the end of the list */
 int slist_add(struct slist *list, void *content);
 
@@ -37,6 +50,10 @@ int slist_rm_last(struct slist *list);
 /* removes the node with the specified content */
 int slist_rm_content(struct slist *list, void *content);
 
+/* call f for every item until it returns something else than 0 */
+int slist_foreach(struct slist *list, int (*f)(void *content, void *ctx),
+		void *ctx);
+
 /* frees the entire datastructure including all nodes content */
 int slist_free(struct slist *list);
 